@@ -19,13 +19,36 @@ bool checkVisited(long long vertex, set<long long> &visited)
 // Return these distances in a map (distances)
 // Also build the spanning tree for the graph using the unordered_map (predecessors)
 //
-void Dijkstra(graph<long long , double>& G, 
+template<typename MemoryT>
+void Dijkstra(graph<long long , double, MemoryT>& G, 
 			  long long startV, unordered_map<long long, long long> &predecessors,
               map<long long, double>& distances)
 {
+    vector<pair<long long, double>> sources;
+    sources.push_back(make_pair(startV, 0.0));
+
+    Dijkstra(G, sources, predecessors, distances);
+}
+
+//
+// Multi-source Dijkstra: same as above, but the search starts from several
+// vertices at once, each with an initial distance (e.g. the distance from
+// a building to each of its footway access nodes).  The resulting tree is
+// a forest; following predecessors from any vertex ends at the source that
+// reaches it most cheaply.  The queue holds MapRoute::entry's -- (distance,
+// vertex ID) -- in the order of MapRoute::before.
+//
+template<typename MemoryT>
+void Dijkstra(graph<long long , double, MemoryT>& G, 
+			  const vector<pair<long long, double>>& sources,
+			  unordered_map<long long, long long> &predecessors,
+              map<long long, double>& distances)
+{
+    typedef MapRoute::entry entry;
+
 	set<long long> visited;
 	vector<long long> vertices = G.getVertices();
-	priority_queue<pair<long long, double>, vector<pair<long long, double>>, prioritize> unvisitedQueue;
+	MapRoute::heap_type unvisitedQueue;
 	set<long long> neighbors;
 
     //
@@ -34,16 +57,21 @@ void Dijkstra(graph<long long , double>& G,
     //
 	for (auto& vertex : vertices) {
 		distances[vertex] = INF;
-		unvisitedQueue.push(make_pair(vertex, INF));
+		unvisitedQueue.push(entry(INF, vertex));
 	}
 
     //
-	// Push start vertex to unvisitedQueue. 
-    // Distance from the note to itself is 0.0 miles
+	// Push start vertices to unvisitedQueue. 
+    // Distance from the note to itself is 0.0 miles, plus its offset
     //
-    predecessors[startV] = -1;
-	distances[startV] = 0.0;
-	unvisitedQueue.push(make_pair(startV, 0.0));
+    for (auto& source : sources) {
+        if (source.second >= distances[source.first])
+            continue;
+
+        predecessors[source.first] = -1;
+        distances[source.first] = source.second;
+        unvisitedQueue.push(entry(source.second, source.first));
+    }
 
 
     long long currentV;
@@ -51,8 +79,8 @@ void Dijkstra(graph<long long , double>& G,
     while (!unvisitedQueue.empty())
     {
         // Pop the top of the queue:
-        currentV = (unvisitedQueue.top()).first;
-        currentDist = (unvisitedQueue.top()).second;
+        currentV = (unvisitedQueue.top()).vertex;
+        currentDist = (unvisitedQueue.top()).dist;
         unvisitedQueue.pop();
 
         // Stop the loop when you hit infinity - there will be no shorter distances    
@@ -77,9 +105,145 @@ void Dijkstra(graph<long long , double>& G,
             if (altDist < distances[neighbor]) {
                 predecessors[neighbor] = currentV;
                 distances[neighbor] = altDist;
-                unvisitedQueue.push(make_pair(neighbor, altDist));
+                unvisitedQueue.push(entry(altDist, neighbor));
+            }
+        }
+    }
+
+}
+
+//
+// Same search over a FlatGraph, with the vertices as dense indices: the
+// arrays replace the maps and sets, and the queue starts with just the
+// sources rather than every vertex at INF.  A vertex is only pushed when
+// its distance strictly drops, so an entry is stale -- and skipped --
+// exactly when its distance is above the vertex's current one; no
+// visited set is needed.  With LowerIndexFirst, vertices are visited in
+// order of (distance, ID) -- dense indices are in ID order -- and their
+// edges in order of target, so with DoubleRoute the tree is exactly the
+// one the map-based version builds.
+//
+template<typename Traits>
+void Dijkstra(const FlatGraph<Traits>& G,
+			  const vector<pair<int, double>>& sources,
+			  vector<int>& pred,
+			  vector<double>& dist)
+{
+    NoSearchStats none;
+
+    Dijkstra(G, sources, pred, dist, none);
+}
+
+//
+// The search itself; with NoSearchStats, the calls on stats compile to
+// nothing.
+//
+template<typename Traits, typename StatsT>
+void Dijkstra(const FlatGraph<Traits>& G,
+			  const vector<pair<int, double>>& sources,
+			  vector<int>& pred,
+			  vector<double>& dist,
+			  StatsT& stats)
+{
+    typedef typename Traits::accum_type accum_type;
+    typedef typename Traits::index_type index_type;
+    typedef typename Traits::entry entry;
+
+    stats.begin(SEARCH_INIT);
+
+    const int n = (int)G.numVertices();
+
+    vector<accum_type> distances(n, Traits::infinity());
+    typename Traits::heap_type unvisitedQueue;
+
+    pred.assign(n, -1);
+
+    for (auto& source : sources) {
+        if (source.first < 0 || source.first >= n)
+            continue;
+
+        // (the unit leaves half the range of a sum for the offset: one
+        // longer than that -- than all the edges put together -- is capped
+        // there, so no sum can wrap)
+        accum_type offset = min(G.encode(source.second), Traits::infinity() / 2);
+        if (offset >= distances[source.first])
+            continue;
+
+        pred[source.first] = -1;
+        distances[source.first] = offset;
+        unvisitedQueue.push(entry(offset, (index_type)source.first));
+        stats.push(unvisitedQueue.size());
+    }
+
+    stats.end(SEARCH_INIT);
+    stats.begin(SEARCH_LOOP);
+
+    while (!unvisitedQueue.empty())
+    {
+        entry current = unvisitedQueue.top();
+        unvisitedQueue.pop();
+        stats.pop();
+
+        if (current.dist > distances[current.vertex]) {
+            stats.stale();
+            continue;
+        }
+
+        stats.settle();
+
+        for (uint32_t e = G.begin(current.vertex); e < G.end(current.vertex); ++e) {
+            index_type neighbor = G.target(e);
+            accum_type altDist = current.dist + (accum_type)G.weight(e);
+            stats.relax();
+
+            if (altDist < distances[neighbor]) {
+                pred[neighbor] = (int)current.vertex;
+                distances[neighbor] = altDist;
+                unvisitedQueue.push(entry(altDist, neighbor));
+                stats.improve();
+                stats.push(unvisitedQueue.size());
             }
         }
     }
 
+    stats.end(SEARCH_LOOP);
+    stats.begin(SEARCH_FINISH);
+
+    dist.resize(n);
+    for (int v = 0; v < n; ++v)
+        dist[v] = (distances[v] == Traits::infinity()) ? INF : G.decode(distances[v]);
+
+    stats.end(SEARCH_FINISH);
 }
+
+//
+// The graph types we route on:
+//
+template void Dijkstra(graph<long long, double, HeapMemory>&, long long,
+                       unordered_map<long long, long long>&, map<long long, double>&);
+template void Dijkstra(graph<long long, double, HeapMemory>&, const vector<pair<long long, double>>&,
+                       unordered_map<long long, long long>&, map<long long, double>&);
+template void Dijkstra(graph<long long, double, ArenaMemory>&, long long,
+                       unordered_map<long long, long long>&, map<long long, double>&);
+template void Dijkstra(graph<long long, double, ArenaMemory>&, const vector<pair<long long, double>>&,
+                       unordered_map<long long, long long>&, map<long long, double>&);
+template void Dijkstra(const FlatGraph<DoubleRoute>&, const vector<pair<int, double>>&,
+                       vector<int>&, vector<double>&);
+template void Dijkstra(const FlatGraph<FloatRoute>&, const vector<pair<int, double>>&,
+                       vector<int>&, vector<double>&);
+template void Dijkstra(const FlatGraph<FixedRoute>&, const vector<pair<int, double>>&,
+                       vector<int>&, vector<double>&);
+template void Dijkstra(const FlatGraph<Fixed16Route>&, const vector<pair<int, double>>&,
+                       vector<int>&, vector<double>&);
+template void Dijkstra(const FlatGraph<Fixed32Route>&, const vector<pair<int, double>>&,
+                       vector<int>&, vector<double>&);
+template void Dijkstra(const FlatGraph<DoubleRoute>&, const vector<pair<int, double>>&,
+                       vector<int>&, vector<double>&, SearchStats&);
+template void Dijkstra(const FlatGraph<FloatRoute>&, const vector<pair<int, double>>&,
+                       vector<int>&, vector<double>&, SearchStats&);
+template void Dijkstra(const FlatGraph<FixedRoute>&, const vector<pair<int, double>>&,
+                       vector<int>&, vector<double>&, SearchStats&);
+template void Dijkstra(const FlatGraph<Fixed16Route>&, const vector<pair<int, double>>&,
+                       vector<int>&, vector<double>&, SearchStats&);
+template void Dijkstra(const FlatGraph<Fixed32Route>&, const vector<pair<int, double>>&,
+                       vector<int>&, vector<double>&, SearchStats&);
@@ -14,6 +14,9 @@
 #include <queue>
 
 #include "graph.h"
+#include "flatgraph.h"
+#include "routetraits.h"
+#include "searchstats.h"
 #include "osm.h"
 
 using namespace std;
@@ -22,26 +25,39 @@ const double INF = numeric_limits<double>::max();
 
 bool checkVisited(long long vertex, vector<long long>& visited);   
 
-void Dijkstra(graph<long long, double>& G, long long startV,
+// Instantiated (in Dijkstra.cpp) for graphs using HeapMemory and ArenaMemory.
+// Distances are the graph's doubles; the queue is MapRoute's (see
+// routetraits.h), so ties go to the smaller vertex ID as in the FlatGraph
+// search with LowerIndexFirst.
+template<typename MemoryT>
+void Dijkstra(graph<long long, double, MemoryT>& G, long long startV,
 			  unordered_map<long long, long long>& predecessors, 
 			  map<long long, double>& distances);
 
-// The priority queue is a min heap
-// First order by the distance
-// When distances are same, order by ID
-class prioritize
-{
-public:
-	bool operator() (const pair<long long, double>& p1, const pair<long long, double>& p2)
-	{
-		if (p1.second > p2.second)
-			return true;
-
-		else if (p1.second == p2.second) {
-			return p1.first > p2.first;
-		}
-
-		else
-			return false;
-	}
-};
\ No newline at end of file
+// Multi-source variant: each (vertex, offset) pair in sources starts at
+// the given initial distance, and has predecessor -1
+template<typename MemoryT>
+void Dijkstra(graph<long long, double, MemoryT>& G, 
+			  const vector<pair<long long, double>>& sources,
+			  unordered_map<long long, long long>& predecessors, 
+			  map<long long, double>& distances);
+
+// Multi-source Dijkstra over a FlatGraph: sources are (dense index, offset
+// in miles) pairs; pred and dist come back indexed by dense index, as in
+// ShortestPathTree (dist in miles, INF if unreachable).  Types, heap and
+// tie-breaking come from Traits (see routetraits.h); instantiated (in
+// Dijkstra.cpp) for the RouteTraits typedefs there.
+template<typename Traits>
+void Dijkstra(const FlatGraph<Traits>& G,
+			  const vector<pair<int, double>>& sources,
+			  vector<int>& pred,
+			  vector<double>& dist);
+
+// Same, reporting the work done to stats (see searchstats.h); the counts
+// are added to what stats already holds.  Instantiated for SearchStats.
+template<typename Traits, typename StatsT>
+void Dijkstra(const FlatGraph<Traits>& G,
+			  const vector<pair<int, double>>& sources,
+			  vector<int>& pred,
+			  vector<double>& dist,
+			  StatsT& stats);
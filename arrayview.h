@@ -0,0 +1,78 @@
+/*arrayview.h*/
+
+//
+// A read-only view of an array: a pointer and a count, owning nothing.
+//
+// The routing structures (FlatGraph, CoordStore, FootwayChains) read
+// their arrays through views, so the same code runs whether the arrays
+// are the structure's own vectors or sections of a frozen map shared by
+// several processes (see frozen.h).  A view of a vector is valid until
+// the vector reallocates; moving the vector keeps it valid.
+//
+
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+using namespace std;
+
+template<typename T>
+class ArrayView
+{
+private:
+  const T* items;
+  size_t   count;
+
+public:
+  ArrayView()
+    : items(nullptr), count(0)
+  {
+  }
+
+  ArrayView(const T* items, size_t count)
+    : items(items), count(count)
+  {
+  }
+
+  // (implicit, so a vector can be passed where a view is taken)
+  ArrayView(const vector<T>& v)
+    : items(v.data()), count(v.size())
+  {
+  }
+
+  const T& operator[](size_t i) const
+  {
+    return items[i];
+  }
+
+  const T* data() const
+  {
+    return items;
+  }
+
+  size_t size() const
+  {
+    return count;
+  }
+
+  bool empty() const
+  {
+    return count == 0;
+  }
+
+  const T* begin() const
+  {
+    return items;
+  }
+
+  const T* end() const
+  {
+    return items + count;
+  }
+
+  const T& back() const
+  {
+    return items[count - 1];
+  }
+};
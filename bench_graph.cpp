@@ -0,0 +1,241 @@
+/*bench_graph.cpp*/
+
+//
+// Benchmark: building a graph with the default heap allocation vs. the
+// monotonic arena (graph<..., ArenaMemory>), and edge by edge (addVertex /
+// addEdge) vs. from an edge list (bulkBuild), and with each edge added in
+// both directions vs. stored once as an undirected edge
+// (bulkBuildUndirected, as main does for footways).  Counts the calls to
+// the global operator new during construction and the heap memory the
+// built graph holds on to, and times construction and teardown, on a synthetic grid graph (side x
+// side vertices).  The edge lists are prepared outside the timed region.
+//
+//   g++ -std=c++17 -O2 -pthread -o bench_graph bench_graph.cpp
+//   ./bench_graph [side] [runs]
+//
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include <malloc.h>
+
+#include "graph.h"
+
+using namespace std;
+
+//
+// Count every allocation made through the global operator new; the arena
+// gets its (few, large) blocks from here too, so its count is honest.
+// Every form of operator new (plain, array, nothrow, aligned -- pmr's
+// default upstream resource allocates through the aligned ones) is
+// replaced, and every form of operator delete frees what they return.
+//
+static size_t allocations = 0;
+static long long liveBytes = 0;   // malloc'ed and not yet freed
+
+// (not inlined into the operators' callers, where the compiler would take
+// free for the mismatched release of an operator new)
+__attribute__((noinline)) static void* allocate(size_t size, size_t align)
+{
+  if (size == 0)
+    size = 1;
+
+  void* p = (align <= alignof(max_align_t)) ? malloc(size)
+                                            : aligned_alloc(align, (size + align - 1) & ~(align - 1));
+  if (p == nullptr)
+    return nullptr;
+
+  allocations++;
+  liveBytes += malloc_usable_size(p);
+  return p;
+}
+
+__attribute__((noinline)) static void release(void* p)
+{
+  if (p == nullptr)
+    return;
+
+  liveBytes -= malloc_usable_size(p);
+  free(p);
+}
+
+static void* allocateOrThrow(size_t size, size_t align)
+{
+  void* p = allocate(size, align);
+  if (p == nullptr)
+    throw bad_alloc();
+
+  return p;
+}
+
+void* operator new(size_t size) { return allocateOrThrow(size, 0); }
+void* operator new[](size_t size) { return allocateOrThrow(size, 0); }
+void* operator new(size_t size, align_val_t align) { return allocateOrThrow(size, (size_t)align); }
+void* operator new[](size_t size, align_val_t align) { return allocateOrThrow(size, (size_t)align); }
+
+void* operator new(size_t size, const nothrow_t&) noexcept { return allocate(size, 0); }
+void* operator new[](size_t size, const nothrow_t&) noexcept { return allocate(size, 0); }
+void* operator new(size_t size, align_val_t align, const nothrow_t&) noexcept { return allocate(size, (size_t)align); }
+void* operator new[](size_t size, align_val_t align, const nothrow_t&) noexcept { return allocate(size, (size_t)align); }
+
+void operator delete(void* p) noexcept { release(p); }
+void operator delete[](void* p) noexcept { release(p); }
+void operator delete(void* p, size_t) noexcept { release(p); }
+void operator delete[](void* p, size_t) noexcept { release(p); }
+void operator delete(void* p, align_val_t) noexcept { release(p); }
+void operator delete[](void* p, align_val_t) noexcept { release(p); }
+void operator delete(void* p, size_t, align_val_t) noexcept { release(p); }
+void operator delete[](void* p, size_t, align_val_t) noexcept { release(p); }
+
+void operator delete(void* p, const nothrow_t&) noexcept { release(p); }
+void operator delete[](void* p, const nothrow_t&) noexcept { release(p); }
+void operator delete(void* p, align_val_t, const nothrow_t&) noexcept { release(p); }
+void operator delete[](void* p, align_val_t, const nothrow_t&) noexcept { release(p); }
+
+struct Result
+{
+  size_t allocations;
+  size_t bytes;
+  double buildMs;
+  double teardownMs;
+};
+
+typedef tuple<long long, long long, double> Edge;
+
+enum Build { EDGE_BY_EDGE, BULK, BULK_UNDIRECTED };
+
+static void gridEdges(int side, bool bothWays, vector<long long>& vertices, vector<Edge>& edges)
+{
+  for (long long v = 0; v < (long long)side * side; v++)
+    vertices.push_back(v);
+
+  for (int r = 0; r < side; r++)
+  {
+    for (int c = 0; c < side; c++)
+    {
+      long long v = (long long)r * side + c;
+
+      if (c + 1 < side)
+      {
+        edges.push_back(make_tuple(v, v + 1, 1.0));
+        if (bothWays)
+          edges.push_back(make_tuple(v + 1, v, 1.0));
+      }
+      if (r + 1 < side)
+      {
+        edges.push_back(make_tuple(v, v + side, 1.0));
+        if (bothWays)
+          edges.push_back(make_tuple(v + side, v, 1.0));
+      }
+    }
+  }
+}
+
+template<typename MemoryT>
+static Result run(int side, Build build)
+{
+  Result result;
+  vector<long long> vertices;
+  vector<Edge> edges;
+
+  gridEdges(side, build != BULK_UNDIRECTED, vertices, edges);
+
+  auto start = chrono::steady_clock::now();
+  size_t before = allocations;
+  long long beforeBytes = liveBytes;
+
+  {
+    auto G = new graph<long long, double, MemoryT>();
+
+    if (build == BULK_UNDIRECTED)
+    {
+      G->bulkBuildUndirected(vertices, edges);
+    }
+    else if (build == BULK)
+    {
+      G->bulkBuild(vertices, edges);
+    }
+    else
+    {
+      for (auto v : vertices)
+        G->addVertex(v);
+
+      for (auto& e : edges)
+        G->addEdge(get<0>(e), get<1>(e), get<2>(e));
+    }
+
+    auto built = chrono::steady_clock::now();
+    result.allocations = allocations - before;
+    result.bytes = (size_t)(liveBytes - beforeBytes);
+    result.buildMs = chrono::duration<double, milli>(built - start).count();
+
+    delete G;
+
+    result.teardownMs = chrono::duration<double, milli>(chrono::steady_clock::now() - built).count();
+  }
+
+  return result;
+}
+
+static double median(vector<double> v)
+{
+  sort(v.begin(), v.end());
+  return v[v.size() / 2];
+}
+
+template<typename MemoryT>
+static void report(const char* name, int side, int runs, Build how)
+{
+  vector<double> build, teardown;
+  size_t allocs = 0, bytes = 0;
+
+  for (int i = 0; i < runs; i++)
+  {
+    Result r = run<MemoryT>(side, how);
+    build.push_back(r.buildMs);
+    teardown.push_back(r.teardownMs);
+    allocs = r.allocations;
+    bytes = r.bytes;
+  }
+
+  cout << left << setw(16) << name << right
+       << setw(14) << allocs
+       << setw(14) << bytes / 1024
+       << setw(14) << fixed << setprecision(2) << median(build)
+       << setw(14) << median(teardown)
+       << setw(14) << *min_element(build.begin(), build.end()) << endl;
+}
+
+int main(int argc, char* argv[])
+{
+  int side = (argc > 1) ? atoi(argv[1]) : 300;
+  int runs = (argc > 2) ? atoi(argv[2]) : 5;
+
+  if (side < 2 || runs < 1)
+  {
+    cout << "usage: " << argv[0] << " [side >= 2] [runs >= 1]" << endl;
+    return 1;
+  }
+
+  long long V = (long long)side * side;
+  long long E = 4LL * side * (side - 1);
+
+  cout << "grid " << side << "x" << side << ": " << V << " vertices, "
+       << E << " directed edges, " << runs << " runs (median)" << endl;
+  cout << left << setw(16) << "build" << right
+       << setw(14) << "allocations" << setw(14) << "KB" << setw(14) << "build ms"
+       << setw(14) << "teardown ms" << setw(14) << "best build" << endl;
+
+  report<HeapMemory>("heap", side, runs, EDGE_BY_EDGE);
+  report<ArenaMemory>("arena", side, runs, EDGE_BY_EDGE);
+  report<HeapMemory>("heap bulk", side, runs, BULK);
+  report<ArenaMemory>("arena bulk", side, runs, BULK);
+  report<HeapMemory>("heap undirected", side, runs, BULK_UNDIRECTED);
+  report<ArenaMemory>("arena undirected", side, runs, BULK_UNDIRECTED);
+
+  return 0;
+}
@@ -0,0 +1,497 @@
+/*bench_pipeline.cpp*/
+
+//
+// Benchmark of the routing pipeline, stage by stage, as main runs it:
+//
+//   load_xml          LoadOpenStreetMap (tinyxml2 parse of the file)
+//   read_map_nodes    ReadMapNodes
+//   read_footways     ReadFootways
+//   read_buildings    ReadUniversityBuildings
+//   load_parallel     LoadOpenStreetMapParallel (all of the above, as main)
+//   prune_nodes       PruneMapNodes
+//   coord_store       CoordStore::build
+//   snap              BuildSnapTable (nearest footway nodes of buildings)
+//   chains            FootwayChains::build
+//   graph_build       bulkBuildUndirected into the arena graph
+//   flat_build        FlatGraph<FixedRoute>::build
+//   dijkstra          one multi-source search, building to building
+//   path              best destination access node, getPath and expand
+//
+// Each map is run once to warm up and then --runs times; the per-query
+// stages are timed once per query, on the same (seeded) building pairs
+// every run.  Maps are the files given, and/or synthetic grid maps of
+// the given sides (GenerateGridMap, written out to a temporary .osm file
+// so the XML stages see them too).  The timings (ms: min, median, mean,
+// standard deviation, 90th percentile, max) are written as JSON to
+// stdout or --json <file>, and as a table to stderr.
+//
+//   g++ -std=c++17 -O2 -pthread -o bench_pipeline bench_pipeline.cpp Dijkstra.cpp
+//       dist.cpp osm.cpp osmparallel.cpp snap.cpp sptcache.cpp chains.cpp
+//       coords.cpp roadgen.cpp tinyxml2.cpp
+//   (on one line)
+//   ./bench_pipeline [--runs N] [--queries Q] [--synthetic SIDE]...
+//                    [--label TEXT] [--json FILE] [map.osm]...
+//
+// With no maps at all, runs fixtures/small.osm and a 200 x 200 grid.
+//
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+#include <unistd.h>
+
+#include "tinyxml2.h"
+#include "osm.h"
+#include "coords.h"
+#include "snap.h"
+#include "chains.h"
+#include "graph.h"
+#include "flatgraph.h"
+#include "routetraits.h"
+#include "Dijkstra.h"
+#include "sptcache.h"
+#include "roadgen.h"
+
+using namespace std;
+using namespace tinyxml2;
+
+//
+// Timings of one stage, in ms
+//
+class Samples
+{
+private:
+  vector<double> ms;
+
+public:
+  void add(double t)
+  {
+    ms.push_back(t);
+  }
+
+  size_t count() const
+  {
+    return ms.size();
+  }
+
+  // the given percentile, interpolating between samples:
+  double percentile(double p) const
+  {
+    vector<double> v = ms;
+    sort(v.begin(), v.end());
+
+    double pos = p / 100.0 * (v.size() - 1);
+    size_t i = (size_t)pos;
+    if (i + 1 >= v.size())
+      return v.back();
+
+    return v[i] + (pos - i) * (v[i + 1] - v[i]);
+  }
+
+  double mean() const
+  {
+    double sum = 0.0;
+    for (auto t : ms)
+      sum += t;
+    return sum / ms.size();
+  }
+
+  double stddev() const
+  {
+    if (ms.size() < 2)
+      return 0.0;
+
+    double m = mean(), sum = 0.0;
+    for (auto t : ms)
+      sum += (t - m) * (t - m);
+    return sqrt(sum / (ms.size() - 1));
+  }
+
+  double min() const
+  {
+    return *min_element(ms.begin(), ms.end());
+  }
+
+  double max() const
+  {
+    return *max_element(ms.begin(), ms.end());
+  }
+};
+
+class Timer
+{
+private:
+  chrono::steady_clock::time_point start;
+
+public:
+  Timer() : start(chrono::steady_clock::now()) { }
+
+  double ms() const
+  {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+  }
+};
+
+struct MapResult
+{
+  string name;
+  size_t nodes, footways, buildings, vertices, edges, queries;
+  vector<pair<string, Samples>> stages;   // in pipeline order
+
+  Samples& stage(const string& stageName)
+  {
+    for (auto& s : stages)
+      if (s.first == stageName)
+        return s.second;
+
+    stages.push_back(make_pair(stageName, Samples()));
+    return stages.back().second;
+  }
+};
+
+//
+// One run of the whole pipeline over filename; timings go into result
+// unless this is the warm-up run.
+//
+static void runPipeline(const string& filename, int numQueries, bool record, MapResult& result)
+{
+  MapResult scratch;
+  MapResult& out = record ? result : scratch;
+
+  //
+  // the sequential XML stages, as the original main ran them:
+  //
+  {
+    XMLDocument xmldoc;
+    map<long long, Coordinates> Nodes;
+    vector<FootwayInfo> Footways;
+    vector<BuildingInfo> Buildings;
+
+    Timer t1;
+    if (!LoadOpenStreetMap(filename, xmldoc)) {
+      cerr << "**Error: unable to load " << filename << endl;
+      exit(1);
+    }
+    out.stage("load_xml").add(t1.ms());
+
+    Timer t2;
+    ReadMapNodes(xmldoc, Nodes);
+    out.stage("read_map_nodes").add(t2.ms());
+
+    Timer t3;
+    ReadFootways(xmldoc, Footways);
+    out.stage("read_footways").add(t3.ms());
+
+    Timer t4;
+    ReadUniversityBuildings(xmldoc, Nodes, Buildings);
+    out.stage("read_buildings").add(t4.ms());
+  }
+
+  //
+  // and the rest as main runs it now:
+  //
+  map<long long, Coordinates> Nodes;
+  vector<FootwayInfo> Footways;
+  vector<BuildingInfo> Buildings;
+  int nodeCount, footwayCount, buildingCount;
+
+  Timer t5;
+  LoadOpenStreetMapParallel(filename, Nodes, Footways, Buildings,
+                            nodeCount, footwayCount, buildingCount);
+  out.stage("load_parallel").add(t5.ms());
+
+  out.nodes = Nodes.size();
+  out.footways = Footways.size();
+  out.buildings = Buildings.size();
+
+  Timer t6;
+  PruneMapNodes(Nodes, Footways, Buildings);
+  out.stage("prune_nodes").add(t6.ms());
+
+  CoordStore Coords;
+  Timer t7;
+  Coords.build(Nodes);
+  out.stage("coord_store").add(t7.ms());
+
+  SnapTable snapTable;
+  Timer t8;
+  BuildSnapTable(Buildings, Footways, Coords, 3, snapTable);
+  out.stage("snap").add(t8.ms());
+
+  vector<long long> accessNodes;
+  for (auto& access : snapTable.Access)
+    for (auto& a : access)
+      accessNodes.push_back(a.ID);
+
+  FootwayChains chains;
+  vector<ChainEdge> edges;
+  Timer t9;
+  chains.build(Footways, Coords, accessNodes, edges);
+  out.stage("chains").add(t9.ms());
+
+  vector<long long> vertices = accessNodes;
+  vector<tuple<long long, long long, double>> edgeList;
+  for (auto& edge : edges) {
+    vertices.push_back(edge.From);
+    vertices.push_back(edge.To);
+    edgeList.push_back(make_tuple(edge.From, edge.To, edge.Weight));
+  }
+
+  graph<long long, double, ArenaMemory> G;
+  Timer t10;
+  G.bulkBuildUndirected(vertices, edgeList);
+  out.stage("graph_build").add(t10.ms());
+
+  out.vertices = G.NumVertices();
+  out.edges = G.NumEdges();
+
+  FlatGraph<FixedRoute> routingGraph;
+  Timer t11;
+  routingGraph.build(G);
+  out.stage("flat_build").add(t11.ms());
+
+  //
+  // queries between random pairs of buildings with access nodes:
+  //
+  vector<int> snapped;
+  for (size_t b = 0; b < Buildings.size(); b++)
+    if (!snapTable.Access[b].empty())
+      snapped.push_back((int)b);
+
+  out.queries = 0;
+  if (snapped.empty())
+    return;
+
+  SPTCache cache(routingGraph.vertices(), 1);
+  mt19937 rng(251);
+  uniform_int_distribution<size_t> pick(0, snapped.size() - 1);
+
+  for (int q = 0; q < numQueries; q++) {
+    vector<AccessNode>& startAccess = snapTable.Access[snapped[pick(rng)]];
+    vector<AccessNode>& destAccess = snapTable.Access[snapped[pick(rng)]];
+
+    vector<pair<int, double>> sources;
+    for (auto& a : startAccess)
+      sources.push_back(make_pair(routingGraph.index(a.ID), a.Dist));
+
+    vector<int> pred;
+    vector<double> dist;
+
+    Timer t12;
+    Dijkstra(routingGraph, sources, pred, dist);
+    out.stage("dijkstra").add(t12.ms());
+
+    const ShortestPathTree& tree = cache.insert(q, pred, dist);
+
+    Timer t13;
+    long long destId = -1;
+    double best = INF;
+    for (auto& a : destAccess) {
+      int v = cache.indexOf(a.ID);
+      if (v >= 0 && tree.Dist[v] != INF && tree.Dist[v] + a.Dist < best) {
+        best = tree.Dist[v] + a.Dist;
+        destId = a.ID;
+      }
+    }
+
+    vector<long long> path;
+    double pathDist;
+    if (destId != -1 && cache.getPath(tree, destId, path, pathDist))
+      path = chains.expand(path);
+    out.stage("path").add(t13.ms());
+
+    out.queries++;
+  }
+}
+
+static string jsonString(const string& s)
+{
+  string quoted = "\"";
+
+  for (char c : s) {
+    if (c == '"' || c == '\\')
+      quoted += '\\';
+    if ((unsigned char)c < 0x20)
+      continue;
+    quoted += c;
+  }
+
+  return quoted + "\"";
+}
+
+static void writeJSON(ostream& output, const string& label, int runs,
+                      vector<MapResult>& results)
+{
+  output << setprecision(6);
+  output << "{" << '\n';
+  output << "  \"benchmark\": \"pipeline\"," << '\n';
+  output << "  \"label\": " << jsonString(label) << "," << '\n';
+  output << "  \"runs\": " << runs << "," << '\n';
+  output << "  \"threads\": " << thread::hardware_concurrency() << "," << '\n';
+  output << "  \"compiler\": " << jsonString(__VERSION__) << "," << '\n';
+  output << "  \"maps\": [" << '\n';
+
+  for (size_t m = 0; m < results.size(); m++) {
+    MapResult& r = results[m];
+
+    output << "    {" << '\n';
+    output << "      \"map\": " << jsonString(r.name) << "," << '\n';
+    output << "      \"nodes\": " << r.nodes << ", \"footways\": " << r.footways
+           << ", \"buildings\": " << r.buildings << "," << '\n';
+    output << "      \"vertices\": " << r.vertices << ", \"edges\": " << r.edges
+           << ", \"queries\": " << r.queries << "," << '\n';
+    output << "      \"stages\": {" << '\n';
+
+    for (size_t s = 0; s < r.stages.size(); s++) {
+      Samples& x = r.stages[s].second;
+
+      output << "        " << jsonString(r.stages[s].first) << ": {"
+             << "\"unit\": \"ms\", \"n\": " << x.count()
+             << ", \"min\": " << x.min()
+             << ", \"median\": " << x.percentile(50)
+             << ", \"mean\": " << x.mean()
+             << ", \"stddev\": " << x.stddev()
+             << ", \"p90\": " << x.percentile(90)
+             << ", \"max\": " << x.max() << "}"
+             << (s + 1 < r.stages.size() ? "," : "") << '\n';
+    }
+
+    output << "      }" << '\n';
+    output << "    }" << (m + 1 < results.size() ? "," : "") << '\n';
+  }
+
+  output << "  ]" << '\n';
+  output << "}" << '\n';
+}
+
+static void writeTable(ostream& output, vector<MapResult>& results)
+{
+  for (auto& r : results) {
+    output << r.name << ": " << r.nodes << " nodes, " << r.footways << " footways, "
+           << r.buildings << " buildings, " << r.vertices << " vertices, "
+           << r.edges << " edges" << endl;
+    output << left << setw(16) << "  stage" << right << setw(8) << "n"
+           << setw(12) << "median ms" << setw(12) << "stddev" << setw(12) << "p90" << endl;
+
+    for (auto& s : r.stages) {
+      output << left << setw(16) << ("  " + s.first) << right
+             << setw(8) << s.second.count() << fixed << setprecision(3)
+             << setw(12) << s.second.percentile(50)
+             << setw(12) << s.second.stddev()
+             << setw(12) << s.second.percentile(90) << endl;
+    }
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  int runs = 5, queries = 20;
+  string label, jsonFile;
+  vector<string> maps;
+  vector<int> sides;
+
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+
+    if (arg == "--runs" && i + 1 < argc)
+      runs = atoi(argv[++i]);
+    else if (arg == "--queries" && i + 1 < argc)
+      queries = atoi(argv[++i]);
+    else if (arg == "--synthetic" && i + 1 < argc)
+      sides.push_back(atoi(argv[++i]));
+    else if (arg == "--label" && i + 1 < argc)
+      label = argv[++i];
+    else if (arg == "--json" && i + 1 < argc)
+      jsonFile = argv[++i];
+    else if (arg.size() > 0 && arg[0] != '-')
+      maps.push_back(arg);
+    else {
+      cerr << "usage: " << argv[0] << " [--runs N] [--queries Q] [--synthetic SIDE]..."
+           << " [--label TEXT] [--json FILE] [map.osm]..." << endl;
+      return 1;
+    }
+  }
+
+  if (runs < 1 || queries < 0) {
+    cerr << "**Error: need --runs >= 1 and --queries >= 0" << endl;
+    return 1;
+  }
+
+  if (maps.empty() && sides.empty()) {
+    maps.push_back("fixtures/small.osm");
+    sides.push_back(200);
+  }
+
+  //
+  // the synthetic maps go through a temporary file, like any other map:
+  //
+  vector<pair<string, string>> inputs;   // (name, filename)
+  vector<string> temporary;
+
+  for (auto& m : maps)
+    inputs.push_back(make_pair(m, m));
+
+  for (int side : sides) {
+    if (side < 2) {
+      cerr << "**Error: --synthetic needs a side >= 2" << endl;
+      return 1;
+    }
+
+    map<long long, Coordinates> Nodes;
+    vector<FootwayInfo> Footways;
+    vector<BuildingInfo> Buildings;
+
+    GenerateGridMap(side, 50, 251, Nodes, Footways, Buildings);
+
+    string filename = "/tmp/bench_pipeline_" + to_string(getpid()) + "_" + to_string(side) + ".osm";
+    if (!WriteOpenStreetMap(filename, Nodes, Footways, Buildings)) {
+      cerr << "**Error: unable to write " << filename << endl;
+      return 1;
+    }
+
+    inputs.push_back(make_pair("synthetic grid " + to_string(side) + "x" + to_string(side), filename));
+    temporary.push_back(filename);
+  }
+
+  vector<MapResult> results;
+
+  for (auto& input : inputs) {
+    MapResult result;
+    result.name = input.first;
+
+    runPipeline(input.second, queries, false, result);
+    for (int r = 0; r < runs; r++)
+      runPipeline(input.second, queries, true, result);
+
+    results.push_back(result);
+  }
+
+  for (auto& filename : temporary)
+    remove(filename.c_str());
+
+  writeTable(cerr, results);
+
+  if (jsonFile.empty()) {
+    writeJSON(cout, label, runs, results);
+  }
+  else {
+    ofstream output(jsonFile);
+    writeJSON(output, label, runs, results);
+    if (!output.good()) {
+      cerr << "**Error: unable to write " << jsonFile << endl;
+      return 1;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,170 @@
+/*bench_weights.cpp*/
+
+//
+// Accuracy report for the narrow edge weights of FlatGraph: builds the
+// (chain-compressed) footway graph of a map the way main does, flattens
+// it with each of the RouteTraits in routetraits.h (double, float,
+// uint32_t and uint16_t weights; uint32_t weights summed in uint32_t),
+// and runs Dijkstra from a sample of sources on each.  Reports, against the double
+// weights: the largest absolute and relative error of any distance, the
+// share of vertices whose shortest-path predecessor differs, the size of
+// the edge arrays and the median time per search.
+//
+//   g++ -std=c++17 -O2 -pthread -o bench_weights bench_weights.cpp Dijkstra.cpp
+//       dist.cpp osm.cpp osmparallel.cpp chains.cpp coords.cpp tinyxml2.cpp
+//   (on one line)
+//   ./bench_weights [map.osm] [sources]
+//
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+
+#include "osm.h"
+#include "coords.h"
+#include "chains.h"
+#include "graph.h"
+#include "flatgraph.h"
+#include "routetraits.h"
+#include "Dijkstra.h"
+
+using namespace std;
+
+struct Reference
+{
+  vector<vector<int>>    pred;
+  vector<vector<double>> dist;
+};
+
+static double median(vector<double> v)
+{
+  sort(v.begin(), v.end());
+  return v[v.size() / 2];
+}
+
+template<typename Traits>
+static void report(const char* name, const graph<long long, double>& G,
+                   const vector<int>& sources, Reference& ref)
+{
+  FlatGraph<Traits> F;
+  F.build(G);
+
+  double maxAbs = 0.0, maxRel = 0.0;
+  size_t compared = 0, predDiffers = 0;
+  vector<double> times;
+
+  bool isReference = ref.dist.empty();
+
+  for (size_t s = 0; s < sources.size(); s++)
+  {
+    vector<pair<int, double>> start(1, make_pair(sources[s], 0.0));
+    vector<int> pred;
+    vector<double> dist;
+
+    auto begin = chrono::steady_clock::now();
+    Dijkstra(F, start, pred, dist);
+    times.push_back(chrono::duration<double, micro>(chrono::steady_clock::now() - begin).count());
+
+    if (isReference)
+    {
+      ref.pred.push_back(pred);
+      ref.dist.push_back(dist);
+      continue;
+    }
+
+    for (size_t v = 0; v < dist.size(); v++)
+    {
+      double exact = ref.dist[s][v];
+      if (exact == INF || dist[v] == INF)
+        continue;
+
+      double err = fabs(dist[v] - exact);
+      maxAbs = max(maxAbs, err);
+      if (exact > 0.0)
+        maxRel = max(maxRel, err / exact);
+
+      compared++;
+      if (pred[v] != ref.pred[s][v])
+        predDiffers++;
+    }
+  }
+
+  cout << left << setw(10) << name << right
+       << setw(12) << F.edgeBytes() / 1024
+       << setw(14) << scientific << setprecision(2) << maxAbs
+       << setw(14) << maxRel
+       << setw(12) << fixed << setprecision(3)
+       << (compared == 0 ? 0.0 : 100.0 * predDiffers / compared)
+       << setw(12) << setprecision(1) << median(times) << endl;
+}
+
+int main(int argc, char* argv[])
+{
+  string filename = (argc > 1) ? argv[1] : "map.osm";
+  int numSources = (argc > 2) ? atoi(argv[2]) : 50;
+
+  map<long long, Coordinates> Nodes;
+  vector<FootwayInfo> Footways;
+  vector<BuildingInfo> Buildings;
+  int nodeCount, footwayCount, buildingCount;
+
+  if (!LoadOpenStreetMapParallel(filename, Nodes, Footways, Buildings,
+                                 nodeCount, footwayCount, buildingCount))
+  {
+    cout << "**Error: unable to load open street map." << endl;
+    return 1;
+  }
+
+  PruneMapNodes(Nodes, Footways, Buildings);
+
+  CoordStore Coords;
+  Coords.build(Nodes);
+
+  FootwayChains chains;
+  vector<ChainEdge> edges;
+  chains.build(Footways, Coords, vector<long long>(), edges);
+
+  vector<long long> vertices;
+  vector<tuple<long long, long long, double>> edgeList;
+  for (auto& edge : edges)
+  {
+    vertices.push_back(edge.From);
+    vertices.push_back(edge.To);
+    edgeList.push_back(make_tuple(edge.From, edge.To, edge.Weight));
+  }
+
+  graph<long long, double> G;
+  G.bulkBuildUndirected(vertices, edgeList);
+
+  if (G.NumVertices() == 0 || numSources < 1)
+  {
+    cout << "nothing to route on" << endl;
+    return 1;
+  }
+
+  // evenly spread sources:
+  vector<int> sources;
+  for (int s = 0; s < numSources; s++)
+    sources.push_back((int)((long long)s * G.NumVertices() / numSources));
+
+  cout << filename << ": " << G.NumVertices() << " vertices, " << G.NumEdges()
+       << " edges, " << sources.size() << " sources" << endl;
+  cout << left << setw(10) << "weights" << right
+       << setw(12) << "edge KB" << setw(14) << "max abs mi" << setw(14) << "max rel"
+       << setw(12) << "pred diff %" << setw(12) << "search us" << endl;
+
+  Reference ref;
+  report<DoubleRoute>("double", G, sources, ref);
+  report<FloatRoute>("float", G, sources, ref);
+  report<FixedRoute>("uint32", G, sources, ref);
+  report<Fixed16Route>("uint16", G, sources, ref);
+  report<Fixed32Route>("uint32/32", G, sources, ref);
+
+  return 0;
+}
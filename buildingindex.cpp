@@ -0,0 +1,407 @@
+/*buildingindex.cpp*/
+
+//
+// Building name / abbreviation index
+//
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cctype>
+
+#include "buildingindex.h"
+
+using namespace std;
+
+//
+// The 3 bytes of s starting at pos, packed into an int
+//
+unsigned int BuildingIndex::trigram(const string& s, size_t pos)
+{
+  return ((unsigned int)(unsigned char)s[pos] << 16) |
+         ((unsigned int)(unsigned char)s[pos + 1] << 8) |
+         ((unsigned int)(unsigned char)s[pos + 2]);
+}
+
+//
+// Lower-case copy of s
+//
+static string lowercase(const string& s)
+{
+  string result(s);
+
+  for (auto& c : result)
+    c = (char)tolower((unsigned char)c);
+
+  return result;
+}
+
+//
+// Levenshtein distance between a and b (two-row dynamic programming)
+//
+int BuildingIndex::editDistance(const string& a, const string& b)
+{
+  vector<int> prev(b.size() + 1), cur(b.size() + 1);
+
+  for (size_t j = 0; j <= b.size(); ++j)
+    prev[j] = (int)j;
+
+  for (size_t i = 1; i <= a.size(); ++i)
+  {
+    cur[0] = (int)i;
+
+    for (size_t j = 1; j <= b.size(); ++j)
+    {
+      int subst = prev[j - 1] + (a[i - 1] == b[j - 1] ? 0 : 1);
+      cur[j] = min(subst, min(prev[j], cur[j - 1]) + 1);
+    }
+
+    prev.swap(cur);
+  }
+
+  return prev[b.size()];
+}
+
+//
+// Kinds of fuzzy terms, in order of preference when ranking matches
+//
+static const int TERM_ABBREV = 0;
+static const int TERM_FULLNAME = 1;
+static const int TERM_WORD = 2;
+
+//
+// Inserts term into the BK-tree: walk down the child at the term's
+// distance from each node until there is none, then hang it there.
+//
+void BuildingIndex::addTerm(const string& term, int building, int kind)
+{
+  if (term.empty())
+    return;
+
+  if (bktree.empty())
+  {
+    bktree.push_back(BKNode());
+    bktree[0].term = term;
+  }
+
+  size_t node = 0;
+
+  while (true)
+  {
+    int d = editDistance(term, bktree[node].term);
+
+    if (d == 0)
+    {
+      bktree[node].buildings.push_back(make_pair(building, kind));
+      return;
+    }
+
+    int child = -1;
+    for (auto& c : bktree[node].children)
+    {
+      if (c.first == d)
+      {
+        child = c.second;
+        break;
+      }
+    }
+
+    if (child < 0)
+    {
+      BKNode leaf;
+      leaf.term = term;
+      leaf.buildings.push_back(make_pair(building, kind));
+
+      bktree[node].children.push_back(make_pair(d, (int)bktree.size()));
+      bktree.push_back(leaf);
+      return;
+    }
+
+    node = child;
+  }
+}
+
+void BuildingIndex::build(const vector<BuildingInfo>& Buildings)
+{
+  names.clear();
+  abbrevs.clear();
+  trigrams.clear();
+  sortedNames.clear();
+  bktree.clear();
+
+  for (size_t i = 0; i < Buildings.size(); ++i)
+  {
+    const string& name = Buildings[i].Fullname;
+    int b = (int)i;
+
+    names.push_back(name);
+    sortedNames.push_back(make_pair(name, b));
+
+    // first building with a given abbreviation wins:
+    abbrevs.insert(make_pair(Buildings[i].Abbrev, b));
+
+    //
+    // buildings are visited in order, so each posting list is built in
+    // ascending order; skip repeats of a trigram within the same name:
+    //
+    for (size_t pos = 0; pos + 3 <= name.size(); ++pos)
+    {
+      vector<int>& postings = trigrams[trigram(name, pos)];
+
+      if (postings.empty() || postings.back() != b)
+        postings.push_back(b);
+    }
+
+    //
+    // fuzzy terms: abbreviation, full name, and the words of the name
+    // (so a typo in a partial name still finds the building):
+    //
+    if (Buildings[i].Abbrev != "?")
+      addTerm(lowercase(Buildings[i].Abbrev), b, TERM_ABBREV);
+
+    string lower = lowercase(name);
+    addTerm(lower, b, TERM_FULLNAME);
+
+    size_t start = 0;
+    while (start < lower.size())
+    {
+      size_t end = start;
+      while (end < lower.size() && isalnum((unsigned char)lower[end]))
+        ++end;
+
+      if (end - start >= 3)
+        addTerm(lower.substr(start, end - start), b, TERM_WORD);
+
+      start = end + 1;
+    }
+  }
+
+  sort(sortedNames.begin(), sortedNames.end());
+}
+
+int BuildingIndex::find(const string& name) const
+{
+  // lookup building by abbrev:
+  auto it = abbrevs.find(name);
+  if (it != abbrevs.end())
+    return it->second;
+
+  // lookup building by full name (partial search):
+  return findByName(name);
+}
+
+int BuildingIndex::findByName(const string& name) const
+{
+  //
+  // too short to have a trigram?  Then scan the names:
+  //
+  if (name.size() < 3)
+  {
+    for (size_t i = 0; i < names.size(); ++i)
+    {
+      if (names[i].find(name) != string::npos)
+        return (int)i;
+    }
+
+    return -1;
+  }
+
+  //
+  // Every name containing the search string contains all of its trigrams,
+  // so intersect their posting lists, shortest list first:
+  //
+  vector<const vector<int>*> lists;
+
+  for (size_t pos = 0; pos + 3 <= name.size(); ++pos)
+  {
+    auto it = trigrams.find(trigram(name, pos));
+    if (it == trigrams.end())
+      return -1;  // some trigram appears in no name at all
+
+    lists.push_back(&it->second);
+  }
+
+  sort(lists.begin(), lists.end(),
+    [](const vector<int>* a, const vector<int>* b) {
+      return (a->size() != b->size()) ? a->size() < b->size() : a < b;
+    });
+  lists.erase(unique(lists.begin(), lists.end()), lists.end());
+
+  vector<int> candidates = *lists[0];
+  vector<int> next;
+
+  for (size_t l = 1; l < lists.size() && !candidates.empty(); ++l)
+  {
+    next.clear();
+    set_intersection(candidates.begin(), candidates.end(),
+                     lists[l]->begin(), lists[l]->end(), back_inserter(next));
+    candidates.swap(next);
+  }
+
+  //
+  // The trigrams could appear in a different order / position, so verify
+  // the candidates, in Buildings order:
+  //
+  for (int b : candidates)
+  {
+    if (names[b].find(name) != string::npos)
+      return b;
+  }
+
+  return -1;
+}
+
+vector<int> BuildingIndex::prefix(const string& prefix, size_t max) const
+{
+  vector<int> result;
+
+  auto it = lower_bound(sortedNames.begin(), sortedNames.end(), make_pair(prefix, -1));
+
+  while (it != sortedNames.end() && result.size() < max &&
+         it->first.compare(0, prefix.size(), prefix) == 0)
+  {
+    result.push_back(it->second);
+    ++it;
+  }
+
+  return result;
+}
+
+//
+// How many typos do we tolerate in a search string?  None for very
+// short strings, since anything would match them:
+//
+static int typoBudget(const string& query)
+{
+  if (query.size() < 3)
+    return 0;
+  else if (query.size() <= 5)
+    return 1;
+  else if (query.size() <= 10)
+    return 2;
+  else
+    return 3;
+}
+
+//
+// BK-tree search: appends a ((distance, kind), building) hit for every
+// term within maxDist of query.  By the triangle inequality, only children
+// whose distance to a node is within maxDist of the query's distance to
+// that node can hold matches.
+//
+void BuildingIndex::search(const string& query, int maxDist,
+                           vector<pair<pair<int, int>, int>>& hits) const
+{
+  if (bktree.empty())
+    return;
+
+  vector<int> pending;
+  pending.push_back(0);
+
+  while (!pending.empty())
+  {
+    const BKNode& node = bktree[pending.back()];
+    pending.pop_back();
+
+    int d = editDistance(query, node.term);
+
+    if (d <= maxDist)
+    {
+      for (auto& b : node.buildings)
+        hits.push_back(make_pair(make_pair(d, b.second), b.first));
+    }
+
+    for (auto& c : node.children)
+    {
+      if (c.first >= d - maxDist && c.first <= d + maxDist)
+        pending.push_back(c.second);
+    }
+  }
+}
+
+vector<FuzzyMatch> BuildingIndex::fuzzyFind(const string& name, size_t max) const
+{
+  vector<FuzzyMatch> result;
+  vector<pair<pair<int, int>, int>> hits;   // ((distance, kind), building)
+  string query = lowercase(name);
+
+  //
+  // the search string as a whole vs. abbreviations, names and words:
+  //
+  search(query, typoBudget(query), hits);
+
+  //
+  // and for a multi-word search string, each of its words vs. the words
+  // of the names; a building matches if all the words do, with the total
+  // number of typos as its distance:
+  //
+  vector<string> words;
+  size_t start = 0;
+  while (start < query.size())
+  {
+    size_t end = start;
+    while (end < query.size() && isalnum((unsigned char)query[end]))
+      ++end;
+
+    if (end - start >= 3)
+      words.push_back(query.substr(start, end - start));
+
+    start = end + 1;
+  }
+
+  if (words.size() > 1)
+  {
+    unordered_map<int, pair<size_t, int>> matched;   // building -> (# words, distance)
+
+    for (auto& word : words)
+    {
+      vector<pair<pair<int, int>, int>> wordHits;
+      unordered_map<int, int> best;                  // building -> distance
+
+      search(word, typoBudget(word), wordHits);
+
+      for (auto& h : wordHits)
+      {
+        if (h.first.second != TERM_WORD)
+          continue;
+
+        auto it = best.find(h.second);
+        if (it == best.end() || h.first.first < it->second)
+          best[h.second] = h.first.first;
+      }
+
+      for (auto& b : best)
+      {
+        pair<size_t, int>& m = matched[b.first];
+        m.first++;
+        m.second += b.second;
+      }
+    }
+
+    for (auto& m : matched)
+    {
+      if (m.second.first == words.size())
+        hits.push_back(make_pair(make_pair(m.second.second, TERM_WORD), m.first));
+    }
+  }
+
+  //
+  // rank: fewest edits, then abbreviation / full name / word, then
+  // Buildings order; each building is reported once:
+  //
+  sort(hits.begin(), hits.end());
+
+  vector<bool> seen(names.size(), false);
+  for (auto& h : hits)
+  {
+    if (result.size() >= max)
+      break;
+    if (seen[h.second])
+      continue;
+
+    seen[h.second] = true;
+    result.push_back(FuzzyMatch(h.second, h.first.first));
+  }
+
+  return result;
+}
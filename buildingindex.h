@@ -0,0 +1,132 @@
+/*buildingindex.h*/
+
+//
+// Index over building names and abbreviations, replacing the linear
+// scans of the Buildings vector:
+//
+//   - a hash map for exact abbreviation hits,
+//   - a trigram (3-gram) index for partial-name (substring) search,
+//   - a sorted name array for autocomplete-style prefix lookups,
+//   - a BK-tree over (lower-case) names, abbreviations and name words
+//     for typo-tolerant search.
+//
+// Lookups keep the original precedence: an exact abbreviation match
+// first, then the first building (in Buildings order) whose full name
+// contains the search string.
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "osm.h"
+#include "memusage.h"
+
+using namespace std;
+
+//
+// FuzzyMatch
+//
+// A building matched by fuzzyFind: Dist is the edit distance between the
+// search string and the matched term (full name, abbreviation or a word of
+// the full name).
+//
+struct FuzzyMatch
+{
+  int Building;
+  int Dist;
+
+  FuzzyMatch(int building, int dist)
+  {
+    Building = building;
+    Dist = dist;
+  }
+};
+
+class BuildingIndex
+{
+private:
+  //
+  // BK-tree node: a distinct term, the buildings it came from (with the
+  // kind of term, lower is better), and children keyed by their edit
+  // distance to this term.
+  //
+  struct BKNode
+  {
+    string term;
+    vector<pair<int, int>> buildings;   // (building, kind)
+    vector<pair<int, int>> children;    // (distance, node)
+
+    friend MemoryUsage MemoryOf(const BKNode& node)
+    {
+      return MemoryOf(node.term) + MemoryOf(node.buildings) + MemoryOf(node.children);
+    }
+  };
+
+  vector<string> names;                        // full names, in Buildings order
+  unordered_map<string, int> abbrevs;          // abbreviation -> first building
+  unordered_map<unsigned int, vector<int>> trigrams;  // trigram -> buildings, ascending
+  vector<pair<string, int>> sortedNames;       // (full name, building), by name
+  vector<BKNode> bktree;                       // node 0 is the root
+
+  static unsigned int trigram(const string& s, size_t pos);
+  static int editDistance(const string& a, const string& b);
+  void addTerm(const string& term, int building, int kind);
+  void search(const string& query, int maxDist,
+              vector<pair<pair<int, int>, int>>& hits) const;
+
+public:
+  //
+  // build
+  //
+  // (Re)builds the index for the given buildings; the indices returned by
+  // the lookups below are positions in this vector.
+  //
+  void build(const vector<BuildingInfo>& Buildings);
+
+  //
+  // find
+  //
+  // Returns the index of the building with the given abbreviation, else
+  // of the first building whose full name contains name, else -1.
+  //
+  int find(const string& name) const;
+
+  //
+  // findByName
+  //
+  // Returns the index of the first building whose full name contains
+  // name, or -1.
+  //
+  int findByName(const string& name) const;
+
+  //
+  // prefix
+  //
+  // Returns (up to max) buildings whose full name starts with prefix,
+  // in alphabetical order.
+  //
+  vector<int> prefix(const string& prefix, size_t max) const;
+
+  //
+  // fuzzyFind
+  //
+  // Typo-tolerant, case-insensitive search: returns (up to max) buildings
+  // whose full name, abbreviation or one of whose name words is within a
+  // small edit distance of name (scaled with its length), best first.
+  //
+  vector<FuzzyMatch> fuzzyFind(const string& name, size_t max) const;
+
+  size_t size() const
+  {
+    return names.size();
+  }
+
+  MemoryUsage memoryUsage() const
+  {
+    return MemoryOf(names) + MemoryOf(abbrevs) + MemoryOf(trigrams)
+         + MemoryOf(sortedNames) + MemoryOf(bktree);
+  }
+};
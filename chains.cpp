@@ -0,0 +1,178 @@
+/*chains.cpp*/
+
+//
+// Degree-2 chain compression of the footway network
+//
+
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+
+#include "chains.h"
+#include "dist.h"
+#include "trace.h"
+
+using namespace std;
+
+void FootwayChains::build(vector<FootwayInfo>& Footways, const CoordStore& Coords,
+                          const vector<long long>& keep, vector<ChainEdge>& edges)
+{
+    TraceScope scope("chains", "load");
+
+    ownChains.clear();
+    ownShapes.clear();
+    parallel.clear();
+
+    //
+    // The footway segments, each once.  A segment that appears on several
+    // footways gets the weight computed last, like repeated addEdge calls:
+    //
+    map<pair<long long, long long>, double> segments;
+
+    for (auto& footWay : Footways) {
+        for (size_t i = 0; i + 1 < footWay.Nodes.size(); ++i) {
+            long long a = footWay.Nodes[i];
+            long long b = footWay.Nodes[i + 1];
+
+            if (a == b)
+                continue;
+
+            int n1 = Coords.index(a);
+            int n2 = Coords.index(b);
+
+            double dist = distBetween2Points(Coords.lat(n1), Coords.lon(n1),
+                                             Coords.lat(n2), Coords.lon(n2));
+
+            segments[make_pair(min(a, b), max(a, b))] = dist;
+        }
+    }
+
+    unordered_map<long long, vector<pair<long long, double>>> adjacent;
+
+    for (auto& segment : segments) {
+        adjacent[segment.first.first].push_back(make_pair(segment.first.second, segment.second));
+        adjacent[segment.first.second].push_back(make_pair(segment.first.first, segment.second));
+    }
+
+    //
+    // Vertices of the compressed graph: anything that isn't a shape point
+    //
+    unordered_set<long long> vertices(keep.begin(), keep.end());
+
+    for (auto& node : adjacent) {
+        if (node.second.size() != 2)
+            vertices.insert(node.first);
+    }
+
+    //
+    // Walk from every vertex along each of its segments until we reach
+    // the next vertex, collecting the shape points on the way.  Each chain
+    // is walked from both ends; keep it from its smaller end, and if two
+    // vertices are joined by several chains keep the shortest:
+    //
+    map<pair<long long, long long>, pair<double, vector<long long>>> best;
+    unordered_set<long long> walked;   // shape points reached so far
+
+    auto walk = [&](long long u, long long first, double weight) {
+        vector<long long> points;
+        long long prev = u;
+        long long cur = first;
+
+        while (vertices.count(cur) == 0) {
+            points.push_back(cur);
+            walked.insert(cur);
+
+            auto& next = adjacent[cur];
+            auto& step = (next[0].first == prev) ? next[1] : next[0];
+
+            weight += step.second;
+            prev = cur;
+            cur = step.first;
+        }
+
+        // a loop back to the start is never on a shortest path:
+        if (cur == u || u > cur)
+            return;
+
+        auto key = make_pair(u, cur);
+        auto it = best.find(key);
+
+        if (it != best.end())
+            parallel.push_back(key);
+        if (it == best.end() || weight < it->second.first)
+            best[key] = make_pair(weight, points);
+    };
+
+    for (auto& node : adjacent) {
+        if (vertices.count(node.first) == 0)
+            continue;
+
+        for (auto& neighbor : node.second)
+            walk(node.first, neighbor.first, neighbor.second);
+    }
+
+    //
+    // Any shape points not reached are on a cycle with no vertex at all;
+    // promote one node of each such cycle to a vertex and walk it:
+    //
+    for (auto& node : adjacent) {
+        if (vertices.count(node.first) > 0 || walked.count(node.first) > 0)
+            continue;
+
+        vertices.insert(node.first);
+        for (auto& neighbor : node.second)
+            walk(node.first, neighbor.first, neighbor.second);
+    }
+
+    // (best is ordered by (From, To), so the chains come out sorted:)
+    for (auto& chain : best) {
+        edges.push_back(ChainEdge(chain.first.first, chain.first.second, chain.second.first));
+
+        if (!chain.second.second.empty()) {
+            uint64_t begin = ownShapes.size();
+            ownShapes.insert(ownShapes.end(), chain.second.second.begin(), chain.second.second.end());
+            ownChains.push_back(ChainRange{ chain.first.first, chain.first.second, begin, ownShapes.size() });
+        }
+    }
+
+    sort(parallel.begin(), parallel.end());
+    parallel.erase(unique(parallel.begin(), parallel.end()), parallel.end());
+
+    chains = ownChains;
+    shapes = ownShapes;
+}
+
+vector<long long> FootwayChains::expand(const vector<long long>& path) const
+{
+    vector<long long> full;
+
+    for (size_t i = 0; i < path.size(); ++i) {
+        full.push_back(path[i]);
+
+        if (i + 1 == path.size())
+            break;
+
+        long long u = path[i];
+        long long v = path[i + 1];
+
+        long long from = min(u, v), to = max(u, v);
+        auto it = lower_bound(chains.begin(), chains.end(), make_pair(from, to),
+            [](const ChainRange& c, const pair<long long, long long>& key) {
+                return c.From < key.first || (c.From == key.first && c.To < key.second);
+            });
+        if (it == chains.end() || it->From != from || it->To != to)
+            continue;
+
+        // shape points are stored from the smaller end to the larger:
+        if (u < v)
+            full.insert(full.end(), shapes.begin() + it->Begin, shapes.begin() + it->End);
+        else {
+            for (uint64_t s = it->End; s > it->Begin; --s)
+                full.push_back(shapes[s - 1]);
+        }
+    }
+
+    return full;
+}
@@ -0,0 +1,157 @@
+/*chains.h*/
+
+//
+// Degree-2 chain compression of the footway network.
+//
+// Most footway nodes are just shape points: they have exactly two
+// neighbors, and a path through one always continues to the other.  We
+// collapse every such chain of nodes into a single edge between the nodes
+// at its ends (junctions, dead ends, and nodes that must stay vertices,
+// e.g. building access nodes), whose weight is the sum of the chain's
+// segment weights.  The shape points are kept in a side array, so a path
+// over the compressed graph can be expanded back into the full sequence
+// of footway nodes.  Shortest distances are unchanged.
+//
+
+#pragma once
+
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cstdint>
+
+#include "osm.h"
+#include "coords.h"
+#include "arrayview.h"
+#include "memusage.h"
+
+using namespace std;
+
+//
+// ChainEdge
+//
+// An (undirected) edge of the compressed graph
+//
+struct ChainEdge
+{
+  long long From;
+  long long To;
+  double    Weight;
+
+  ChainEdge(long long from, long long to, double weight)
+  {
+    From = from;
+    To = to;
+    Weight = weight;
+  }
+};
+
+
+//
+// ChainRange
+//
+// The edge (From, To), From < To, and [Begin, End) of its shape points in
+// the shapes array, in order from From to To
+//
+struct ChainRange
+{
+  long long From;
+  long long To;
+  uint64_t  Begin;
+  uint64_t  End;
+};
+
+
+class FootwayChains
+{
+private:
+  //
+  // The chains, sorted by (From, To); edges with no shape points are not
+  // stored.  Read through views, as in FlatGraph: of the own vectors, or
+  // of a frozen map's (see frozen.h).
+  //
+  ArrayView<ChainRange> chains;
+  ArrayView<long long> shapes;
+
+  vector<ChainRange> ownChains;
+  vector<long long> ownShapes;
+
+  // (From, To) of the edges chosen among several chains, sorted:
+  vector<pair<long long, long long>> parallel;
+
+public:
+  FootwayChains()
+  {
+  }
+
+  FootwayChains(const FootwayChains&) = delete;
+  FootwayChains& operator=(const FootwayChains&) = delete;
+  FootwayChains(FootwayChains&&) = default;
+  FootwayChains& operator=(FootwayChains&&) = default;
+
+  //
+  // build
+  //
+  // Compresses the footways, keeping every node in keep as a vertex, and
+  // returns the resulting edges (each once, From < To).
+  //
+  void build(vector<FootwayInfo>& Footways, const CoordStore& Coords,
+             const vector<long long>& keep, vector<ChainEdge>& edges);
+
+  //
+  // expand
+  //
+  // Given a path over the compressed graph, returns the full path over
+  // the original footway nodes.
+  //
+  vector<long long> expand(const vector<long long>& path) const;
+
+  //
+  // attach
+  //
+  // Makes the chains read the given arrays instead of their own; they
+  // must outlive them (or the next build / attach).
+  //
+  void attach(ArrayView<ChainRange> chains, ArrayView<long long> shapes)
+  {
+    vector<ChainRange>().swap(ownChains);
+    vector<long long>().swap(ownShapes);
+    parallel.clear();
+
+    this->chains = chains;
+    this->shapes = shapes;
+  }
+
+  ArrayView<ChainRange> chainArray() const
+  {
+    return chains;
+  }
+
+  ArrayView<long long> shapeArray() const
+  {
+    return shapes;
+  }
+
+  //
+  // isParallel
+  //
+  // Whether the edge (u, v) is the shortest of several chains joining u
+  // and v: moving a node on it may make another one shorter, so its
+  // weight can't be updated on its own.  (Not known for attached chains.)
+  //
+  bool isParallel(long long u, long long v) const
+  {
+    return binary_search(parallel.begin(), parallel.end(), make_pair(min(u, v), max(u, v)));
+  }
+
+  size_t numShapePoints() const
+  {
+    return shapes.size();
+  }
+
+  // (what they own: not the arrays of a frozen map)
+  MemoryUsage memoryUsage() const
+  {
+    return MemoryOf(ownChains) + MemoryOf(ownShapes) + MemoryOf(parallel);
+  }
+};
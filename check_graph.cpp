@@ -0,0 +1,248 @@
+/*check_graph.cpp*/
+
+//
+// Equivalence checks for the bulk graph builders and the parallel sort
+// under them, on random inputs:
+//
+//   - bulkBuild against addVertex + addEdge, and bulkBuildUndirected
+//     against addVertex + addUndirectedEdge, for heap and arena graphs:
+//     the edge lists have duplicates (the last weight must win), self
+//     loops, both directions of undirected edges, and edges to vertices
+//     that aren't in the graph (which must be dropped);
+//   - parallelStableSort (psort.h) against stable_sort, with many equal
+//     keys, so that an unstable merge shows.
+//
+// Each is run over a range of sizes -- below and above the size the sort
+// starts splitting at -- and thread counts.  Prints the first difference
+// found and exits with 1, else prints a line per check and exits with 0.
+//
+//   g++ -std=c++17 -O2 -pthread -o check_graph check_graph.cpp
+//   ./check_graph [rounds] [seed]
+//
+
+#include <iostream>
+#include <vector>
+#include <tuple>
+#include <random>
+#include <algorithm>
+#include <cstdlib>
+
+#include "graph.h"
+#include "psort.h"
+
+using namespace std;
+
+typedef tuple<long long, long long, double> Edge;
+
+static const int THREADS[] = { 1, 2, 3, 4, 7, 8, 16 };
+static const size_t SIZES[] = { 0, 1, 2, 10, 1000, (1 << 14) - 1, 1 << 14, 50000, 200003 };
+
+//
+// Random vertices (out of [0, range), some listed twice) and edges, with
+// endpoints drawn from the same range, so some are missing and some
+// repeat:
+//
+static void randomInput(mt19937_64& rng, size_t numEdges,
+                        vector<long long>& vertices, vector<Edge>& edges)
+{
+  long long range = max((long long)2, (long long)(numEdges / 3));
+  uniform_int_distribution<long long> id(0, range - 1);
+  uniform_int_distribution<int> weight(1, 1000);
+
+  vertices.clear();
+  for (long long v = 0; v < range; ++v)
+  {
+    if (rng() % 10 != 0)
+      vertices.push_back(v);
+    if (rng() % 50 == 0)
+      vertices.push_back(v);
+  }
+  shuffle(vertices.begin(), vertices.end(), rng);
+
+  edges.clear();
+  for (size_t e = 0; e < numEdges; ++e)
+    edges.push_back(Edge(id(rng), id(rng), weight(rng) / 8.0));
+}
+
+//
+// Are the graphs the same, as seen through the graph's interface?  And
+// stored the same (the same payload: an undirected edge's weight kept
+// once)?  If not, says where they differ.
+//
+template<typename MemoryT>
+static bool sameGraph(const graph<long long, double, MemoryT>& expected,
+                      const graph<long long, double, MemoryT>& actual, string& diff)
+{
+  if (expected.NumVertices() != actual.NumVertices() ||
+      expected.NumEdges() != actual.NumEdges())
+  {
+    diff = to_string(expected.NumVertices()) + " vertices, " + to_string(expected.NumEdges())
+         + " edges expected, got " + to_string(actual.NumVertices()) + ", "
+         + to_string(actual.NumEdges());
+    return false;
+  }
+
+  vector<long long> vertices = expected.getVertices();
+  if (vertices != actual.getVertices())
+  {
+    diff = "different vertices";
+    return false;
+  }
+
+  for (long long v : vertices)
+  {
+    set<long long> neighbors = expected.neighbors(v);
+    if (neighbors != actual.neighbors(v))
+    {
+      diff = "different neighbors of " + to_string(v);
+      return false;
+    }
+
+    for (long long n : neighbors)
+    {
+      double w1 = 0.0, w2 = 0.0;
+      expected.getWeight(v, n, w1);
+      actual.getWeight(v, n, w2);
+
+      if (w1 != w2)
+      {
+        diff = "edge (" + to_string(v) + ", " + to_string(n) + "): weight "
+             + to_string(w1) + " expected, got " + to_string(w2);
+        return false;
+      }
+    }
+  }
+
+  if (expected.memoryUsage().Payload != actual.memoryUsage().Payload)
+  {
+    diff = "same edges, stored differently";
+    return false;
+  }
+
+  return true;
+}
+
+template<typename MemoryT>
+static bool checkBulkBuild(const char* name, int rounds, mt19937_64& rng)
+{
+  vector<long long> vertices;
+  vector<Edge> edges;
+  int checked = 0;
+
+  for (int round = 0; round < rounds; ++round)
+  {
+    for (size_t size : SIZES)
+    {
+      randomInput(rng, size, vertices, edges);
+
+      for (bool undirected : { false, true })
+      {
+        graph<long long, double, MemoryT> expected;
+        for (long long v : vertices)
+          expected.addVertex(v);
+        for (auto& e : edges)
+        {
+          if (undirected)
+            expected.addUndirectedEdge(get<0>(e), get<1>(e), get<2>(e));
+          else
+            expected.addEdge(get<0>(e), get<1>(e), get<2>(e));
+        }
+
+        for (int threads : THREADS)
+        {
+          graph<long long, double, MemoryT> actual;
+          if (undirected)
+            actual.bulkBuildUndirected(vertices, edges, threads);
+          else
+            actual.bulkBuild(vertices, edges, threads);
+
+          string diff;
+          if (!sameGraph(expected, actual, diff))
+          {
+            cout << "**FAILED: " << name << (undirected ? " bulkBuildUndirected" : " bulkBuild")
+                 << ", " << edges.size() << " edges, " << threads << " threads: "
+                 << diff << endl;
+            return false;
+          }
+
+          checked++;
+        }
+      }
+    }
+  }
+
+  cout << name << " bulkBuild / bulkBuildUndirected: " << checked << " graphs OK" << endl;
+  return true;
+}
+
+static bool checkSort(int rounds, mt19937_64& rng)
+{
+  int checked = 0;
+
+  for (int round = 0; round < rounds; ++round)
+  {
+    for (size_t size : SIZES)
+    {
+      // few distinct keys, then many; the second is the original position:
+      for (int keys : { 7, 1 << 20 })
+      {
+        vector<pair<int, int>> input;
+        for (size_t i = 0; i < size; ++i)
+          input.push_back(make_pair((int)(rng() % keys), (int)i));
+
+        auto byKey = [](const pair<int, int>& a, const pair<int, int>& b)
+        {
+          return a.first < b.first;
+        };
+
+        vector<pair<int, int>> expected = input;
+        stable_sort(expected.begin(), expected.end(), byKey);
+
+        for (int threads : THREADS)
+        {
+          vector<pair<int, int>> actual = input;
+          parallelStableSort(actual, byKey, threads);
+
+          if (actual != expected)
+          {
+            size_t i = 0;
+            while (actual[i] == expected[i])
+              i++;
+
+            cout << "**FAILED: parallelStableSort, " << size << " elements, "
+                 << threads << " threads: first difference at " << i << endl;
+            return false;
+          }
+
+          checked++;
+        }
+      }
+    }
+  }
+
+  cout << "parallelStableSort: " << checked << " sorts OK" << endl;
+  return true;
+}
+
+int main(int argc, char* argv[])
+{
+  int rounds = (argc > 1) ? atoi(argv[1]) : 1;
+  unsigned long long seed = (argc > 2) ? strtoull(argv[2], nullptr, 10) : 1;
+
+  if (rounds < 1)
+  {
+    cout << "usage: " << argv[0] << " [rounds >= 1] [seed]" << endl;
+    return 1;
+  }
+
+  cout << rounds << " rounds, seed " << seed << endl;
+
+  mt19937_64 rng(seed);
+
+  if (!checkSort(rounds, rng) ||
+      !checkBulkBuild<HeapMemory>("heap", rounds, rng) ||
+      !checkBulkBuild<ArenaMemory>("arena", rounds, rng))
+    return 1;
+
+  return 0;
+}
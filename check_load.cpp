@@ -0,0 +1,166 @@
+/*check_load.cpp*/
+
+//
+// Equivalence check for the parallel XML ingest: for each map file,
+// LoadOpenStreetMapParallel with 1 to 16 threads against LoadOpenStreetMap
+// followed by ReadMapNodes, ReadFootways and ReadUniversityBuildings, as
+// main used to load maps.  The nodes, footways (in order, with their
+// nodes), buildings (in order: names, abbreviations, coordinates and
+// perimeters) and the counts must all be the same; more threads split the
+// file into more chunks, so the boundaries land in different places.
+// Prints the first difference found and exits with 1, else prints a line
+// per file and exits with 0.
+//
+//   g++ -std=c++17 -O2 -pthread -o check_load check_load.cpp osm.cpp osmparallel.cpp tinyxml2.cpp
+//   ./check_load map.osm [more.osm ...]
+//
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+
+#include "tinyxml2.h"
+#include "osm.h"
+
+using namespace std;
+using namespace tinyxml2;
+
+static bool sameCoords(const Coordinates& a, const Coordinates& b)
+{
+  return a.ID == b.ID && a.Lat == b.Lat && a.Lon == b.Lon;
+}
+
+//
+// Compares what the parallel load read to what the sequential one did;
+// if they differ, says where.
+//
+static bool sameMap(const map<long long, Coordinates>& Nodes,
+                    const vector<FootwayInfo>& Footways,
+                    const vector<BuildingInfo>& Buildings,
+                    const map<long long, Coordinates>& parNodes,
+                    const vector<FootwayInfo>& parFootways,
+                    const vector<BuildingInfo>& parBuildings,
+                    string& diff)
+{
+  if (Nodes.size() != parNodes.size())
+  {
+    diff = to_string(Nodes.size()) + " nodes expected, got " + to_string(parNodes.size());
+    return false;
+  }
+
+  for (auto it = Nodes.begin(), par = parNodes.begin(); it != Nodes.end(); ++it, ++par)
+  {
+    if (it->first != par->first || !sameCoords(it->second, par->second))
+    {
+      diff = "node " + to_string(it->first) + " differs";
+      return false;
+    }
+  }
+
+  if (Footways.size() != parFootways.size())
+  {
+    diff = to_string(Footways.size()) + " footways expected, got " + to_string(parFootways.size());
+    return false;
+  }
+
+  for (size_t f = 0; f < Footways.size(); ++f)
+  {
+    if (Footways[f].ID != parFootways[f].ID || Footways[f].Nodes != parFootways[f].Nodes)
+    {
+      diff = "footway " + to_string(f) + " (" + to_string(Footways[f].ID) + ") differs";
+      return false;
+    }
+  }
+
+  if (Buildings.size() != parBuildings.size())
+  {
+    diff = to_string(Buildings.size()) + " buildings expected, got " + to_string(parBuildings.size());
+    return false;
+  }
+
+  for (size_t b = 0; b < Buildings.size(); ++b)
+  {
+    const BuildingInfo& expected = Buildings[b];
+    const BuildingInfo& actual = parBuildings[b];
+
+    if (expected.Fullname != actual.Fullname || expected.Abbrev != actual.Abbrev ||
+        !sameCoords(expected.Coords, actual.Coords) || expected.Perimeter != actual.Perimeter)
+    {
+      diff = "building " + to_string(b) + " (" + expected.Fullname + ") differs";
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static bool checkFile(const string& filename)
+{
+  XMLDocument xmldoc;
+  map<long long, Coordinates> Nodes;
+  vector<FootwayInfo> Footways;
+  vector<BuildingInfo> Buildings;
+
+  if (!LoadOpenStreetMap(filename, xmldoc))
+  {
+    cout << "**FAILED: unable to load '" << filename << "'" << endl;
+    return false;
+  }
+
+  int nodeCount = ReadMapNodes(xmldoc, Nodes);
+  int footwayCount = ReadFootways(xmldoc, Footways);
+  int buildingCount = ReadUniversityBuildings(xmldoc, Nodes, Buildings);
+
+  for (int threads = 1; threads <= 16; ++threads)
+  {
+    map<long long, Coordinates> parNodes;
+    vector<FootwayInfo> parFootways;
+    vector<BuildingInfo> parBuildings;
+    int parNodeCount = 0, parFootwayCount = 0, parBuildingCount = 0;
+
+    if (!LoadOpenStreetMapParallel(filename, parNodes, parFootways, parBuildings,
+                                   parNodeCount, parFootwayCount, parBuildingCount, threads))
+    {
+      cout << "**FAILED: " << filename << ", " << threads << " threads: unable to load" << endl;
+      return false;
+    }
+
+    string diff;
+    if (parNodeCount != nodeCount || parFootwayCount != footwayCount ||
+        parBuildingCount != buildingCount)
+    {
+      diff = "counts " + to_string(parNodeCount) + "/" + to_string(parFootwayCount) + "/"
+           + to_string(parBuildingCount) + ", expected " + to_string(nodeCount) + "/"
+           + to_string(footwayCount) + "/" + to_string(buildingCount);
+    }
+
+    if (!diff.empty() ||
+        !sameMap(Nodes, Footways, Buildings, parNodes, parFootways, parBuildings, diff))
+    {
+      cout << "**FAILED: " << filename << ", " << threads << " threads: " << diff << endl;
+      return false;
+    }
+  }
+
+  cout << filename << ": " << nodeCount << " nodes, " << footwayCount << " footways, "
+       << buildingCount << " buildings, the same with 1-16 threads" << endl;
+  return true;
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc < 2)
+  {
+    cout << "usage: " << argv[0] << " map.osm [more.osm ...]" << endl;
+    return 1;
+  }
+
+  for (int i = 1; i < argc; ++i)
+  {
+    if (!checkFile(argv[i]))
+      return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,89 @@
+/*coords.cpp*/
+
+//
+// Compact fixed-point coordinate store
+//
+
+#include <vector>
+#include <map>
+#include <cmath>
+#include <algorithm>
+
+#include "coords.h"
+
+using namespace std;
+
+int32_t CoordStore::toFixed(double degrees)
+{
+  return (int32_t)llround(degrees * 1e7);
+}
+
+void CoordStore::build(const map<long long, Coordinates>& Nodes)
+{
+  ownIds.clear();
+  ownLats.clear();
+  ownLons.clear();
+
+  ownIds.reserve(Nodes.size());
+  ownLats.reserve(Nodes.size());
+  ownLons.reserve(Nodes.size());
+
+  // the map is ordered by ID, so ids comes out sorted:
+  for (auto& node : Nodes)
+  {
+    ownIds.push_back(node.first);
+    ownLats.push_back(toFixed(node.second.Lat));
+    ownLons.push_back(toFixed(node.second.Lon));
+  }
+
+  ids = ownIds;
+  lats = ownLats;
+  lons = ownLons;
+}
+
+void CoordStore::attach(ArrayView<long long> ids, ArrayView<int32_t> lats, ArrayView<int32_t> lons)
+{
+  vector<long long>().swap(ownIds);
+  vector<int32_t>().swap(ownLats);
+  vector<int32_t>().swap(ownLons);
+
+  this->ids = ids;
+  this->lats = lats;
+  this->lons = lons;
+}
+
+int CoordStore::index(long long id) const
+{
+  auto it = lower_bound(ids.begin(), ids.end(), id);
+
+  if (it == ids.end() || *it != id)
+    return -1;
+
+  return (int)(it - ids.begin());
+}
+
+bool CoordStore::find(long long id, double& lat, double& lon) const
+{
+  int i = index(id);
+
+  if (i < 0)
+    return false;
+
+  lat = this->lat(i);
+  lon = this->lon(i);
+
+  return true;
+}
+
+bool CoordStore::setPosition(long long id, double lat, double lon)
+{
+  int i = index(id);
+
+  if (i < 0 || ownLats.empty() || lats.data() != ownLats.data())
+    return false;
+
+  ownLats[i] = toFixed(lat);
+  ownLons[i] = toFixed(lon);
+
+  return true;
+}
@@ -0,0 +1,141 @@
+/*coords.h*/
+
+//
+// Compact coordinate store.
+//
+// map<long long, Coordinates> costs an 8-byte ID plus two doubles per
+// node, inside a tree node with 3 pointers and a color.  Once loading is
+// done we only need to look positions up, so the store keeps the node IDs
+// in a sorted vector (a node's position in it is its dense index) and the
+// positions as int32 fixed-point latitude / longitude in units of 1e-7
+// degrees -- the precision OSM itself uses -- in two parallel arrays: 8
+// bytes of coordinates per node.
+//
+// Converting back divides the exact integer by 1e7, which gives the very
+// same double as parsing the 7-decimal text in the map file.
+//
+// As in FlatGraph, the arrays are read through views: of the store's own
+// vectors, or of a frozen map's (see frozen.h).
+//
+
+#pragma once
+
+#include <vector>
+#include <map>
+#include <cstdint>
+
+#include "osm.h"
+#include "arrayview.h"
+#include "memusage.h"
+
+using namespace std;
+
+class CoordStore
+{
+private:
+  ArrayView<long long> ids;     // sorted, dense index -> node ID
+  ArrayView<int32_t>   lats;    // 1e-7 degrees
+  ArrayView<int32_t>   lons;
+
+  // the arrays, when the store owns them:
+  vector<long long> ownIds;
+  vector<int32_t>   ownLats;
+  vector<int32_t>   ownLons;
+
+public:
+  CoordStore()
+  {
+  }
+
+  CoordStore(const CoordStore&) = delete;
+  CoordStore& operator=(const CoordStore&) = delete;
+  CoordStore(CoordStore&&) = default;
+  CoordStore& operator=(CoordStore&&) = default;
+
+  static int32_t toFixed(double degrees);
+
+  static double toDegrees(int32_t fixed)
+  {
+    return fixed / 1e7;
+  }
+
+  //
+  // build
+  //
+  // (Re)builds the store from the given nodes.
+  //
+  void build(const map<long long, Coordinates>& Nodes);
+
+  //
+  // attach
+  //
+  // Makes the store read the given arrays instead of its own; they must
+  // outlive it (or the next build / attach).
+  //
+  void attach(ArrayView<long long> ids, ArrayView<int32_t> lats, ArrayView<int32_t> lons);
+
+  ArrayView<long long> idArray() const
+  {
+    return ids;
+  }
+
+  //
+  // index
+  //
+  // Returns the dense index of node id, or -1 if the node isn't stored.
+  //
+  int index(long long id) const;
+
+  //
+  // find
+  //
+  // Looks up the position of node id; returns false if it isn't stored.
+  //
+  bool find(long long id, double& lat, double& lon) const;
+
+  //
+  // setPosition
+  //
+  // Moves node id; returns false if it isn't stored, or the arrays aren't
+  // the store's own.
+  //
+  bool setPosition(long long id, double lat, double lon);
+
+  size_t size() const
+  {
+    return ids.size();
+  }
+
+  // (what it owns: not the arrays of a frozen map)
+  MemoryUsage memoryUsage() const
+  {
+    return MemoryOf(ownIds) + MemoryOf(ownLats) + MemoryOf(ownLons);
+  }
+
+  long long id(int i) const
+  {
+    return ids[i];
+  }
+
+  double lat(int i) const
+  {
+    return toDegrees(lats[i]);
+  }
+
+  double lon(int i) const
+  {
+    return toDegrees(lons[i]);
+  }
+
+  // the raw fixed-point arrays, for kernels working on many nodes at once
+  // (and for freezing):
+  const int32_t* latData() const
+  {
+    return lats.data();
+  }
+
+  const int32_t* lonData() const
+  {
+    return lons.data();
+  }
+};
@@ -0,0 +1,293 @@
+/*flatgraph.h*/
+
+//
+// Flat (CSR) copy of a graph, for routing.
+//
+// Once built, the footway graph doesn't change, and Dijkstra only ever
+// asks for the out edges of a vertex.  FlatGraph keeps the vertices in
+// sorted order (a vertex's position is its dense index, as in SPTCache)
+// and the edges of all vertices back to back in two parallel arrays,
+// targets and weights: the edges of vertex i are [begin(i), end(i)).
+//
+// The types are given by a RouteTraits (see routetraits.h).  Weights
+// can be stored narrower than the graph's doubles:
+//   double, float         miles
+//   uint32_t, uint16_t    fixed point, in units of unit() miles
+// and distances are summed in the traits' accum_type.  The fixed-point
+// unit is picked so that the longest edge fits in a weight, and the sum
+// of all the edges (twice over, leaving room for source offsets) fits in
+// accum_type: no shortest path can overflow it.  Distances too long to
+// encode saturate at infinity(), and Dijkstra caps source offsets at the
+// half of the range left for them.
+//
+// The arrays are read through views (see arrayview.h): of the graph's
+// own vectors once built, or of a frozen map's sections once attached
+// (see frozen.h).  Copying a graph would leave the copy's views on the
+// original's vectors, so it can only be moved.
+//
+
+#pragma once
+
+#include <vector>
+#include <limits>
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
+#include <algorithm>
+
+#include "graph.h"
+#include "routetraits.h"
+#include "arrayview.h"
+#include "memusage.h"
+
+using namespace std;
+
+template<typename Traits>
+class FlatGraph
+{
+public:
+  typedef typename Traits::weight_type WeightT;
+  typedef typename Traits::accum_type  accum_type;
+  typedef typename Traits::index_type  index_type;
+
+private:
+  ArrayView<long long>  ids;       // sorted, dense index -> vertex ID
+  ArrayView<uint32_t>   offsets;   // ids.size() + 1
+  ArrayView<index_type> targets;   // dense index of each edge's target
+  ArrayView<WeightT>    weights;
+  double               unitMiles;
+
+  // the arrays, when the graph owns them:
+  vector<long long>  ownIds;
+  vector<uint32_t>   ownOffsets;
+  vector<index_type> ownTargets;
+  vector<WeightT>    ownWeights;
+
+public:
+  FlatGraph()
+  {
+    unitMiles = 1.0;
+  }
+
+  FlatGraph(const FlatGraph&) = delete;
+  FlatGraph& operator=(const FlatGraph&) = delete;
+  FlatGraph(FlatGraph&&) = default;
+  FlatGraph& operator=(FlatGraph&&) = default;
+
+  //
+  // build
+  //
+  // (Re)builds the flat copy of G.  The edges of each vertex come out
+  // in order of target, the same order G.neighbors() gives.
+  //
+  template<typename MemoryT>
+  void build(const graph<long long, double, MemoryT>& G)
+  {
+    ownIds = G.getVertices();
+    ownOffsets.assign(1, 0);
+    ownTargets.clear();
+    ownWeights.clear();
+    ids = ownIds;
+
+    vector<double> miles;
+
+    for (auto& v : ownIds) {
+      for (auto& n : G.neighbors(v)) {
+        double w = 0.0;
+        G.getWeight(v, n, w);
+
+        ownTargets.push_back((index_type)index(n));
+        miles.push_back(w);
+      }
+
+      ownOffsets.push_back((uint32_t)ownTargets.size());
+    }
+
+    unitMiles = 1.0;
+    if (is_integral<WeightT>::value) {
+      double longest = 0.0, total = 0.0;
+      for (auto w : miles) {
+        longest = max(longest, w);
+        total += w;
+      }
+
+      // (each weight may round up by half a unit: room for that too)
+      unitMiles = max(longest / numeric_limits<WeightT>::max(),
+                      2.0 * total / ((double)Traits::infinity() - (double)miles.size()));
+      if (unitMiles == 0.0)
+        unitMiles = 1.0;
+    }
+
+    // (the longest edge may round up past the largest weight:)
+    ownWeights.reserve(miles.size());
+    for (auto w : miles)
+      ownWeights.push_back((WeightT)min(encode(w), (accum_type)numeric_limits<WeightT>::max()));
+
+    offsets = ownOffsets;
+    targets = ownTargets;
+    weights = ownWeights;
+  }
+
+  //
+  // attach
+  //
+  // Makes the graph read the given arrays -- e.g. a frozen map's, as
+  // written from offsetArray() etc. -- instead of its own; they must
+  // outlive it (or the next build / attach).
+  //
+  void attach(ArrayView<long long> ids, ArrayView<uint32_t> offsets,
+              ArrayView<index_type> targets, ArrayView<WeightT> weights, double unitMiles)
+  {
+    vector<long long>().swap(ownIds);
+    vector<uint32_t>().swap(ownOffsets);
+    vector<index_type>().swap(ownTargets);
+    vector<WeightT>().swap(ownWeights);
+
+    this->ids = ids;
+    this->offsets = offsets;
+    this->targets = targets;
+    this->weights = weights;
+    this->unitMiles = unitMiles;
+  }
+
+  ArrayView<uint32_t> offsetArray() const
+  {
+    return offsets;
+  }
+
+  ArrayView<index_type> targetArray() const
+  {
+    return targets;
+  }
+
+  ArrayView<WeightT> weightArray() const
+  {
+    return weights;
+  }
+
+  //
+  // index
+  //
+  // Returns the dense index of vertex id, or -1 if it isn't a vertex.
+  //
+  int index(long long id) const
+  {
+    auto it = lower_bound(ids.begin(), ids.end(), id);
+
+    if (it == ids.end() || *it != id)
+      return -1;
+
+    return (int)(it - ids.begin());
+  }
+
+  long long id(int v) const
+  {
+    return ids[v];
+  }
+
+  ArrayView<long long> vertices() const
+  {
+    return ids;
+  }
+
+  size_t numVertices() const
+  {
+    return ids.size();
+  }
+
+  size_t numEdges() const
+  {
+    return targets.size();
+  }
+
+  uint32_t begin(int v) const
+  {
+    return offsets[v];
+  }
+
+  uint32_t end(int v) const
+  {
+    return offsets[v + 1];
+  }
+
+  index_type target(uint32_t e) const
+  {
+    return targets[e];
+  }
+
+  WeightT weight(uint32_t e) const
+  {
+    return weights[e];
+  }
+
+  //
+  // setWeight
+  //
+  // Sets the weight of the edge u -> v (dense indices) to miles, in the
+  // unit the graph was built with, for updates that move nodes but keep
+  // the edges.  Returns false, changing nothing, if there's no such edge,
+  // miles doesn't fit in a weight, or the arrays aren't the graph's own
+  // (a frozen map's are read-only); the graph should then be rebuilt.
+  //
+  bool setWeight(int u, int v, double miles)
+  {
+    if (ownWeights.empty() || weights.data() != ownWeights.data())
+      return false;
+
+    accum_type w = encode(miles);
+    if (w > (accum_type)numeric_limits<WeightT>::max())
+      return false;
+
+    for (uint32_t e = offsets[u]; e < offsets[u + 1]; ++e) {
+      if (targets[e] == (index_type)v) {
+        ownWeights[e] = (WeightT)w;
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  // miles per weight unit (1 for floating-point weights):
+  double unit() const
+  {
+    return unitMiles;
+  }
+
+  //
+  // encode / decode
+  //
+  // Distance in miles <-> in the units distances are summed in.  Fixed
+  // point saturates at infinity() rather than wrapping around.
+  //
+  accum_type encode(double miles) const
+  {
+    if (is_integral<WeightT>::value) {
+      double units = round(miles / unitMiles);
+      if (!(units < (double)Traits::infinity()))
+        return Traits::infinity();
+
+      return (accum_type)units;
+    }
+
+    return (accum_type)miles;
+  }
+
+  double decode(accum_type d) const
+  {
+    return (double)d * unitMiles;
+  }
+
+  // (what it owns: not the arrays of a frozen map)
+  MemoryUsage memoryUsage() const
+  {
+    return MemoryOf(ownIds) + MemoryOf(ownOffsets) + MemoryOf(ownTargets) + MemoryOf(ownWeights);
+  }
+
+  // bytes taken by the offset, target and weight arrays:
+  size_t edgeBytes() const
+  {
+    return offsets.size() * sizeof(uint32_t) + targets.size() * sizeof(index_type)
+         + weights.size() * sizeof(WeightT);
+  }
+};
@@ -0,0 +1,119 @@
+/*frozen.cpp*/
+
+//
+// Frozen maps: writing the file, and mapping it
+//
+
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "frozen.h"
+
+using namespace std;
+
+static const uint64_t SECTION_ALIGNMENT = 64;
+
+static uint64_t aligned(uint64_t offset)
+{
+  return (offset + SECTION_ALIGNMENT - 1) & ~(SECTION_ALIGNMENT - 1);
+}
+
+bool WriteFrozenSections(const string& filename, FrozenHeader& header,
+                         const vector<pair<const void*, size_t>>& sections)
+{
+  uint64_t offset = aligned(sizeof(FrozenHeader));
+
+  for (int s = 0; s < NUM_FROZEN_SECTIONS; ++s) {
+    header.Offset[s] = offset;
+    offset = aligned(offset + sections[s].second);
+  }
+  header.TotalBytes = offset;
+
+  // written aside, and renamed into place whole:
+  string temporary = filename + ".tmp." + to_string(getpid());
+  ofstream output(temporary, ios::binary | ios::trunc);
+  if (!output.good())
+    return false;
+
+  const char zeros[SECTION_ALIGNMENT] = { 0 };
+  uint64_t written = sizeof(FrozenHeader);
+  output.write((const char*)&header, sizeof(FrozenHeader));
+
+  for (int s = 0; s < NUM_FROZEN_SECTIONS; ++s) {
+    output.write(zeros, header.Offset[s] - written);
+    output.write((const char*)sections[s].first, sections[s].second);
+    written = header.Offset[s] + sections[s].second;
+  }
+  output.write(zeros, header.TotalBytes - written);
+
+  output.close();
+  if (!output.good() || rename(temporary.c_str(), filename.c_str()) != 0) {
+    remove(temporary.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+
+//
+// FrozenMap
+//
+FrozenMap::FrozenMap()
+  : base(nullptr), bytes(0)
+{
+}
+
+FrozenMap::~FrozenMap()
+{
+  if (base != nullptr)
+    munmap((void*)base, bytes);
+}
+
+bool FrozenMap::open(const string& filename)
+{
+  int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+
+  struct stat status;
+  if (fstat(fd, &status) != 0 || (size_t)status.st_size < sizeof(FrozenHeader)) {
+    close(fd);
+    return false;
+  }
+
+  // (the mapping outlives the descriptor)
+  size_t size = (size_t)status.st_size;
+  void* mapped = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if (mapped == MAP_FAILED)
+    return false;
+
+  const FrozenHeader& h = *(const FrozenHeader*)mapped;
+  bool valid = memcmp(h.Magic, FROZEN_MAGIC, sizeof(FROZEN_MAGIC)) == 0 &&
+               h.Version == FROZEN_VERSION && h.TotalBytes == size;
+
+  for (int s = 0; valid && s < NUM_FROZEN_SECTIONS; ++s) {
+    valid = h.Offset[s] % SECTION_ALIGNMENT == 0 && h.ElementBytes[s] > 0 &&
+            h.Count[s] <= size / h.ElementBytes[s] &&
+            h.Offset[s] <= size - h.Count[s] * h.ElementBytes[s];
+  }
+
+  if (!valid) {
+    munmap(mapped, size);
+    return false;
+  }
+
+  if (base != nullptr)
+    munmap((void*)base, bytes);
+
+  base = (const char*)mapped;
+  bytes = size;
+  return true;
+}
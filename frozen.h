@@ -0,0 +1,311 @@
+/*frozen.h*/
+
+//
+// Frozen maps: the routing structures of a loaded map -- the routing
+// graph, the coordinates, the footway chains, the buildings and their
+// access nodes -- written once into a single file, which any number of
+// routing processes then map read-only and route on directly.  The
+// mapping is shared: however many processes map the file, the host holds
+// one physical copy, in the page cache.  On Linux, a file in /dev/shm is
+// a POSIX shared memory segment, and never touches a disk.
+//
+// The file is position independent: a FrozenHeader at offset 0, then one
+// section per array, each at an offset (from the start of the file)
+// recorded in the header and aligned to 64 bytes.  Nothing in it is a
+// pointer, so it works wherever it is mapped.  The graph, coordinates and
+// chains read their sections in place (see arrayview.h); the buildings
+// and access nodes -- a few per building -- are copied out, and the
+// building index is rebuilt from them.
+//
+// Producer:
+//   WriteFrozenMap("/dev/shm/campus.nav", routingGraph, Coords, chains, Buildings, snapTable);
+//
+// Workers:
+//   FrozenMap frozen;
+//   if (frozen.open("/dev/shm/campus.nav") &&
+//       AttachFrozenMap(frozen, routingGraph, Coords, chains, Buildings, snapTable))
+//     ...   // route; frozen must outlive the structures attached to it
+//
+// The file is written under a temporary name and renamed into place, so
+// processes still mapping the previous version keep it, unchanged.
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <type_traits>
+#include <cstdint>
+
+#include "osm.h"
+#include "coords.h"
+#include "chains.h"
+#include "snap.h"
+#include "flatgraph.h"
+#include "arrayview.h"
+
+using namespace std;
+
+enum FrozenSection
+{
+  FROZEN_VERTICES,          // long long, sorted
+  FROZEN_OFFSETS,           // uint32_t, # of vertices + 1
+  FROZEN_TARGETS,           // the graph's index_type
+  FROZEN_WEIGHTS,           // the graph's weight_type
+  FROZEN_COORD_IDS,         // long long, sorted
+  FROZEN_COORD_LATS,        // int32_t, 1e-7 degrees
+  FROZEN_COORD_LONS,
+  FROZEN_CHAINS,            // ChainRange
+  FROZEN_SHAPES,            // long long
+  FROZEN_BUILDINGS,         // FrozenBuilding
+  FROZEN_BUILDING_TEXT,     // char: the names and abbreviations
+  FROZEN_ACCESS_OFFSETS,    // uint32_t, # of buildings + 1
+  FROZEN_ACCESS,            // AccessNode
+  NUM_FROZEN_SECTIONS
+};
+
+struct FrozenHeader
+{
+  char     Magic[8];                // "NAVFROZ"
+  uint32_t Version;
+  uint32_t WeightBytes;             // the graph's traits
+  uint32_t IndexBytes;
+  uint32_t IntegralWeights;
+  double   UnitMiles;
+  int32_t  SnapK;
+  uint32_t Reserved;
+  uint64_t TotalBytes;
+  uint64_t Offset[NUM_FROZEN_SECTIONS];
+  uint64_t Count[NUM_FROZEN_SECTIONS];
+  uint64_t ElementBytes[NUM_FROZEN_SECTIONS];
+};
+
+//
+// A building: its name and abbreviation are NameLength and AbbrevLength
+// chars of the text section, back to back from TextOffset
+//
+struct FrozenBuilding
+{
+  uint64_t  TextOffset;
+  uint32_t  NameLength;
+  uint32_t  AbbrevLength;
+  long long ID;
+  double    Lat;
+  double    Lon;
+};
+
+const char FROZEN_MAGIC[8] = "NAVFROZ";
+const uint32_t FROZEN_VERSION = 1;
+
+//
+// FrozenMap
+//
+// A frozen map file, mapped read-only and shared.
+//
+class FrozenMap
+{
+private:
+  const char* base;
+  size_t bytes;
+
+public:
+  FrozenMap();
+  ~FrozenMap();
+
+  FrozenMap(const FrozenMap&) = delete;
+  FrozenMap& operator=(const FrozenMap&) = delete;
+
+  //
+  // Maps the file and checks its header; returns false (and maps
+  // nothing) if it can't be read or isn't a frozen map of this version.
+  //
+  bool open(const string& filename);
+
+  const FrozenHeader& header() const
+  {
+    return *(const FrozenHeader*)base;
+  }
+
+  size_t size() const
+  {
+    return bytes;
+  }
+
+  //
+  // A section as an array of T; empty if its elements aren't T-sized.
+  //
+  template<typename T>
+  ArrayView<T> section(FrozenSection s) const
+  {
+    if (base == nullptr || header().ElementBytes[s] != sizeof(T))
+      return ArrayView<T>();
+
+    return ArrayView<T>((const T*)(base + header().Offset[s]), header().Count[s]);
+  }
+};
+
+//
+// Writes the header and sections (pointer and size in bytes, in
+// FrozenSection order) to filename, filling in the header's offsets and
+// total size; returns false if the file can't be written.
+//
+bool WriteFrozenSections(const string& filename, FrozenHeader& header,
+                         const vector<pair<const void*, size_t>>& sections);
+
+//
+// WriteFrozenMap
+//
+// Freezes the structures of a loaded map into filename; returns false if
+// the file can't be written.
+//
+template<typename Traits>
+bool WriteFrozenMap(const string& filename, const FlatGraph<Traits>& G, const CoordStore& Coords,
+                    const FootwayChains& chains, const vector<BuildingInfo>& Buildings,
+                    const SnapTable& snapTable)
+{
+  typedef typename Traits::weight_type WeightT;
+  typedef typename Traits::index_type  IndexT;
+
+  FrozenHeader header = FrozenHeader();
+  copy(FROZEN_MAGIC, FROZEN_MAGIC + sizeof(FROZEN_MAGIC), header.Magic);
+  header.Version = FROZEN_VERSION;
+  header.WeightBytes = sizeof(WeightT);
+  header.IndexBytes = sizeof(IndexT);
+  header.IntegralWeights = is_integral<WeightT>::value ? 1 : 0;
+  header.UnitMiles = G.unit();
+  header.SnapK = snapTable.K;
+
+  // the buildings and access nodes, flattened:
+  vector<FrozenBuilding> buildings;
+  string text;
+  vector<uint32_t> accessOffsets(1, 0);
+  vector<AccessNode> access;
+
+  for (size_t b = 0; b < Buildings.size(); ++b) {
+    const BuildingInfo& building = Buildings[b];
+
+    buildings.push_back(FrozenBuilding{ text.size(), (uint32_t)building.Fullname.size(),
+                                        (uint32_t)building.Abbrev.size(), building.Coords.ID,
+                                        building.Coords.Lat, building.Coords.Lon });
+    text += building.Fullname + building.Abbrev;
+
+    if (b < snapTable.Access.size())
+      access.insert(access.end(), snapTable.Access[b].begin(), snapTable.Access[b].end());
+    accessOffsets.push_back((uint32_t)access.size());
+  }
+
+  auto counted = [&](FrozenSection s, size_t count, size_t elementBytes) {
+    header.Count[s] = count;
+    header.ElementBytes[s] = elementBytes;
+  };
+
+  ArrayView<long long> vertices = G.vertices();
+  ArrayView<uint32_t> offsets = G.offsetArray();
+  ArrayView<IndexT> targets = G.targetArray();
+  ArrayView<WeightT> weights = G.weightArray();
+  ArrayView<long long> coordIds = Coords.idArray();
+  ArrayView<ChainRange> chainRanges = chains.chainArray();
+  ArrayView<long long> shapes = chains.shapeArray();
+
+  counted(FROZEN_VERTICES, vertices.size(), sizeof(long long));
+  counted(FROZEN_OFFSETS, offsets.size(), sizeof(uint32_t));
+  counted(FROZEN_TARGETS, targets.size(), sizeof(IndexT));
+  counted(FROZEN_WEIGHTS, weights.size(), sizeof(WeightT));
+  counted(FROZEN_COORD_IDS, coordIds.size(), sizeof(long long));
+  counted(FROZEN_COORD_LATS, Coords.size(), sizeof(int32_t));
+  counted(FROZEN_COORD_LONS, Coords.size(), sizeof(int32_t));
+  counted(FROZEN_CHAINS, chainRanges.size(), sizeof(ChainRange));
+  counted(FROZEN_SHAPES, shapes.size(), sizeof(long long));
+  counted(FROZEN_BUILDINGS, buildings.size(), sizeof(FrozenBuilding));
+  counted(FROZEN_BUILDING_TEXT, text.size(), sizeof(char));
+  counted(FROZEN_ACCESS_OFFSETS, accessOffsets.size(), sizeof(uint32_t));
+  counted(FROZEN_ACCESS, access.size(), sizeof(AccessNode));
+
+  vector<pair<const void*, size_t>> sections = {
+    { vertices.data(), vertices.size() * sizeof(long long) },
+    { offsets.data(), offsets.size() * sizeof(uint32_t) },
+    { targets.data(), targets.size() * sizeof(IndexT) },
+    { weights.data(), weights.size() * sizeof(WeightT) },
+    { coordIds.data(), coordIds.size() * sizeof(long long) },
+    { Coords.latData(), Coords.size() * sizeof(int32_t) },
+    { Coords.lonData(), Coords.size() * sizeof(int32_t) },
+    { chainRanges.data(), chainRanges.size() * sizeof(ChainRange) },
+    { shapes.data(), shapes.size() * sizeof(long long) },
+    { buildings.data(), buildings.size() * sizeof(FrozenBuilding) },
+    { text.data(), text.size() },
+    { accessOffsets.data(), accessOffsets.size() * sizeof(uint32_t) },
+    { access.data(), access.size() * sizeof(AccessNode) },
+  };
+
+  return WriteFrozenSections(filename, header, sections);
+}
+
+//
+// AttachFrozenMap
+//
+// Attaches the graph, coordinates and chains to the sections of a mapped
+// frozen map, and copies out its buildings and access nodes.  Returns
+// false, changing nothing, if the map's graph isn't of these Traits or
+// its sections don't fit together.
+//
+template<typename Traits>
+bool AttachFrozenMap(const FrozenMap& frozen, FlatGraph<Traits>& G, CoordStore& Coords,
+                     FootwayChains& chains, vector<BuildingInfo>& Buildings,
+                     SnapTable& snapTable)
+{
+  typedef typename Traits::weight_type WeightT;
+  typedef typename Traits::index_type  IndexT;
+
+  const FrozenHeader& header = frozen.header();
+  if (header.WeightBytes != sizeof(WeightT) || header.IndexBytes != sizeof(IndexT) ||
+      header.IntegralWeights != (is_integral<WeightT>::value ? 1u : 0u))
+    return false;
+
+  ArrayView<long long> vertices = frozen.section<long long>(FROZEN_VERTICES);
+  ArrayView<uint32_t> offsets = frozen.section<uint32_t>(FROZEN_OFFSETS);
+  ArrayView<IndexT> targets = frozen.section<IndexT>(FROZEN_TARGETS);
+  ArrayView<WeightT> weights = frozen.section<WeightT>(FROZEN_WEIGHTS);
+  ArrayView<long long> coordIds = frozen.section<long long>(FROZEN_COORD_IDS);
+  ArrayView<int32_t> lats = frozen.section<int32_t>(FROZEN_COORD_LATS);
+  ArrayView<int32_t> lons = frozen.section<int32_t>(FROZEN_COORD_LONS);
+  ArrayView<ChainRange> chainRanges = frozen.section<ChainRange>(FROZEN_CHAINS);
+  ArrayView<long long> shapes = frozen.section<long long>(FROZEN_SHAPES);
+  ArrayView<FrozenBuilding> buildings = frozen.section<FrozenBuilding>(FROZEN_BUILDINGS);
+  ArrayView<char> text = frozen.section<char>(FROZEN_BUILDING_TEXT);
+  ArrayView<uint32_t> accessOffsets = frozen.section<uint32_t>(FROZEN_ACCESS_OFFSETS);
+  ArrayView<AccessNode> access = frozen.section<AccessNode>(FROZEN_ACCESS);
+
+  // (a section of the wrong element size comes back empty)
+  if (offsets.size() != vertices.size() + 1 || offsets.back() != targets.size() ||
+      weights.size() != targets.size() || lats.size() != coordIds.size() ||
+      lons.size() != coordIds.size() || accessOffsets.size() != buildings.size() + 1 ||
+      accessOffsets.back() != access.size())
+    return false;
+
+  for (auto& b : buildings) {
+    if (b.TextOffset + b.NameLength + b.AbbrevLength > text.size())
+      return false;
+  }
+
+  G.attach(vertices, offsets, targets, weights, header.UnitMiles);
+  Coords.attach(coordIds, lats, lons);
+  chains.attach(chainRanges, shapes);
+
+  Buildings.clear();
+  snapTable = SnapTable();
+  snapTable.K = header.SnapK;
+
+  for (size_t b = 0; b < buildings.size(); ++b) {
+    const FrozenBuilding& building = buildings[b];
+    const char* name = text.data() + building.TextOffset;
+
+    Buildings.push_back(BuildingInfo(string(name, building.NameLength),
+                                     string(name + building.NameLength, building.AbbrevLength),
+                                     building.ID, building.Lat, building.Lon));
+
+    snapTable.Access.push_back(vector<AccessNode>(access.begin() + accessOffsets[b],
+                                                  access.begin() + accessOffsets[b + 1]));
+  }
+
+  return true;
+}
@@ -7,6 +7,17 @@
 // Graph class using adjacency list representation. 
 // Implemented using nested maps 
 //
+// The MemoryT parameter selects where the maps get their nodes from:
+// HeapMemory (the default) uses the regular heap, one allocation per
+// vertex and per edge; ArenaMemory carves them out of a monotonic arena
+// owned by the graph, and frees them all at once with the graph.
+//
+// Undirected edges (addUndirectedEdge, bulkBuildUndirected) store their
+// weight once, in the neighbor map of the smaller endpoint; the larger
+// endpoint just lists the smaller one in its mirrored vector, so the
+// edge is visible from both ends through getWeight / neighbors.  Directed
+// edges (addEdge) can be mixed in freely, e.g. for one-way segments.
+//
 // Project 7 Part 1
 // U. of Illinois, Chicago
 // CS 251: Spring 2020
@@ -19,16 +30,106 @@
 #include <vector>
 #include <set>
 #include <map>
+#include <memory>
+#include <memory_resource>
+#include <tuple>
+#include <algorithm>
+
+#include "psort.h"
+#include "trace.h"
+#include "memusage.h"
 
 using namespace std;
 
-template<typename VertexT, typename WeightT>
+//
+// Memory policies for graph
+//
+struct HeapMemory
+{
+  template<typename K, typename V>
+  using map_type = map<K, V>;
+
+  template<typename T>
+  using vector_type = vector<T>;
+
+  typedef allocator<char> allocator_type;
+
+  struct resource_type { };
+
+  template<typename M>
+  static M make(resource_type&)
+  {
+    return M();
+  }
+};
+
+struct ArenaMemory
+{
+  template<typename K, typename V>
+  using map_type = pmr::map<K, V>;
+
+  template<typename T>
+  using vector_type = pmr::vector<T>;
+
+  typedef pmr::polymorphic_allocator<char> allocator_type;
+
+  struct resource_type
+  {
+    pmr::monotonic_buffer_resource arena;
+  };
+
+  // the nested neighbor maps (and mirrored vectors) inherit the arena
+  // from the outer map:
+  template<typename M>
+  static M make(resource_type& resource)
+  {
+    return M(&resource.arena);
+  }
+};
+
+template<typename VertexT, typename WeightT, typename MemoryT = HeapMemory>
 class graph
 {
 private:
 
-  typedef map<VertexT, WeightT> neighbor;
-  map<VertexT, neighbor> adjList;
+  typedef typename MemoryT::template map_type<VertexT, WeightT> neighbor;
+  typedef typename MemoryT::template vector_type<VertexT> mirror;
+
+  //
+  // The edges of a vertex v:
+  //   out:      v -> u for the directed edges, and for the undirected
+  //             edges (v, u) with v < u; the weight is stored here.
+  //   mirrored: the u < v of the undirected edges (u, v), in sorted
+  //             order; the weight of v -> u is the one stored in u's out.
+  // The allocator-extended constructors let the arena reach the nested
+  // containers.
+  //
+  struct vertexEdges
+  {
+    typedef typename MemoryT::allocator_type allocator_type;
+
+    neighbor out;
+    mirror   mirrored;
+
+    vertexEdges() { }
+    explicit vertexEdges(const allocator_type& a) : out(a), mirrored(a) { }
+    vertexEdges(const vertexEdges& e, const allocator_type& a) : out(e.out, a), mirrored(e.mirrored, a) { }
+    vertexEdges(vertexEdges&& e, const allocator_type& a) : out(move(e.out), a), mirrored(move(e.mirrored), a) { }
+    vertexEdges(const vertexEdges&) = default;
+    vertexEdges(vertexEdges&&) = default;
+
+    friend MemoryUsage MemoryOf(const vertexEdges& e)
+    {
+      return MemoryOf(e.out) + MemoryOf(e.mirrored);
+    }
+  };
+
+  typedef typename MemoryT::template map_type<VertexT, vertexEdges> adjacency;
+
+  // declared first, so it is destroyed after the maps that use it:
+  shared_ptr<typename MemoryT::resource_type> resource;
+
+  adjacency adjList;
   int numVertices;
   int numEdges;
 
@@ -37,12 +138,37 @@ public:
   // constructor:
   //
   graph()
+    : resource(make_shared<typename MemoryT::resource_type>()),
+      adjList(MemoryT::template make<adjacency>(*resource))
   {
-      // Default constuctor for std::map invoked
       numVertices = 0;
       numEdges = 0;
   }
 
+  //
+  // copy constructor: the copy gets an arena of its own, and its maps
+  // are copied into it (assigning to a pmr map keeps the map's own
+  // allocator).  A move takes the arena along with the maps in it.
+  //
+  graph(const graph& other)
+    : resource(make_shared<typename MemoryT::resource_type>()),
+      adjList(MemoryT::template make<adjacency>(*resource))
+  {
+      adjList = other.adjList;
+      numVertices = other.numVertices;
+      numEdges = other.numEdges;
+  }
+
+  graph(graph&&) = default;
+
+  //
+  // No assignment: the maps can't change arenas, so an arena graph would
+  // have to keep its old arena alive alongside the new one -- or, as the
+  // implicit one did, free it while its maps still use it.
+  //
+  graph& operator=(const graph&) = delete;
+  graph& operator=(graph&&) = delete;
+
   //
   // NumVertices
   //
@@ -63,6 +189,21 @@ public:
     return numEdges;
   }
 
+  //
+  // memoryUsage
+  //
+  // Bytes held by the graph (see memusage.h): vertex IDs and weights are
+  // payload, as are the IDs in the mirrored vectors; the map nodes and
+  // the vectors' spare capacity are overhead.  In an arena, the bytes
+  // the arena has reserved but not handed out yet are not counted.
+  //
+  MemoryUsage memoryUsage() const
+  {
+    MemoryUsage usage = MemoryOf(adjList);
+    usage.Overhead += sizeof(*this);
+    return usage;
+  }
+
   //
   // addVertex
   //
@@ -83,8 +224,7 @@ public:
     //
     // if we get here, vertex does not exist so insert.  
     //
-    neighbor M;                       // Empty map for the neighbors
-    adjList.insert(make_pair(v, M));
+    adjList.emplace(v, vertexEdges()); // No edges yet
     ++numVertices;                    // Increase the number of vertices
      
     return true;
@@ -98,26 +238,121 @@ public:
   // graph is full, false is returned.
   //
   // NOTE: if the edge already exists, the existing edge weight
-  // is overwritten with the new edge weight.
+  // is overwritten with the new edge weight.  If it was half of an
+  // undirected edge, only this direction changes: the other keeps
+  // the old weight.
   //
   bool addEdge(VertexT from, VertexT to, WeightT weight)
   {
     // Check if both vertices exist in the graph:
-    if (adjList.count(from) == 0 || adjList.count(to) == 0)
+    auto fromItr = adjList.find(from);
+    auto toItr = adjList.find(to);
+    if (fromItr == adjList.end() || toItr == adjList.end())
         return false;
 
-    auto itr = adjList.find(from);
-    neighbor& M = itr->second;
+    vertexEdges& F = fromItr->second;
+    vertexEdges& T = toItr->second;
+
+    auto it = F.out.find(to);
+    if (it != F.out.end()) {
+        // to -> from shares this weight?  Give it its own copy first:
+        if (isMirrored(T, from)) {
+            T.out.emplace(from, it->second);
+            removeMirror(T, from);
+        }
+
+        it->second = weight;
+        return true;
+    }
 
     // Increase the number of edges if we added a new edge:
-    if (M.count(to) == 0)
+    if (isMirrored(F, to))
+        removeMirror(F, to);
+    else
         ++numEdges;
 
-    M[to] = weight;
+    F.out.emplace(to, weight);
+
+    return true;
+  }
+
+  //
+  // addUndirectedEdge
+  //
+  // Adds the edges (a, b, weight) and (b, a, weight), storing the
+  // weight once.  Returns false if the vertices do not exist.  As
+  // with addEdge, existing edges between a and b are overwritten.
+  //
+  bool addUndirectedEdge(VertexT a, VertexT b, WeightT weight)
+  {
+    if (a == b)
+      return addEdge(a, b, weight);
+
+    const VertexT& u = (a < b) ? a : b;
+    const VertexT& v = (a < b) ? b : a;
+
+    auto uItr = adjList.find(u);
+    auto vItr = adjList.find(v);
+    if (uItr == adjList.end() || vItr == adjList.end())
+        return false;
+
+    vertexEdges& U = uItr->second;
+    vertexEdges& V = vItr->second;
+
+    if (U.out.count(v) == 0)
+        ++numEdges;
+
+    if (!isMirrored(V, u)) {
+        // v -> u is new, or was a directed edge with its own weight:
+        if (V.out.erase(u) == 0)
+            ++numEdges;
+
+        insertMirror(V, u);
+    }
+
+    U.out[v] = weight;
 
     return true;
   }
 
+  //
+  // bulkBuild
+  //
+  // Replaces the contents of the graph with the given vertices and
+  // (from, to, weight) edges, all at once.  Gives the same graph as
+  // addVertex for each vertex followed by addEdge for each edge, in
+  // order: edges whose vertices don't exist are dropped, and if an edge
+  // is listed more than once the last weight wins.
+  //
+  // Rather than looking every edge up in the maps, the edge list is
+  // sorted (in parallel, numThreads; 0 => one per core) by (from, to),
+  // and the maps are then filled in order, so every insert is at the end.
+  //
+  void bulkBuild(vector<VertexT> vertices,
+                 vector<tuple<VertexT, VertexT, WeightT>> edges,
+                 int numThreads = 0)
+  {
+    build(vertices, edges, false, numThreads);
+  }
+
+  //
+  // bulkBuildUndirected
+  //
+  // Same as bulkBuild, but each edge (a, b, weight) is undirected, as
+  // if added with addUndirectedEdge; (a, b) and (b, a) are the same edge.
+  //
+  void bulkBuildUndirected(vector<VertexT> vertices,
+                           vector<tuple<VertexT, VertexT, WeightT>> edges,
+                           int numThreads = 0)
+  {
+    for (auto& e : edges) {
+        if (get<1>(e) < get<0>(e))
+            swap(get<0>(e), get<1>(e));
+    }
+
+    build(vertices, edges, true, numThreads);
+  }
+
   //
   // getWeight
   //
@@ -131,16 +366,25 @@ public:
   {
     // Check if both vertices exist:
     auto itr = adjList.find(from);
-    if (itr == adjList.end() || adjList.count(to) == 0)
+    if (itr == adjList.end())
+        return false;
+
+    auto toItr = adjList.find(to);
+    if (toItr == adjList.end())
         return false;
 
     //
-    // the vertices exist, but does the edge exist?
+    // the vertices exist, but does the edge exist?  Either stored
+    // with from, or (undirected) with to:
     //
-    neighbor M = itr->second;
+    const neighbor& M = itr->second.out;
     auto it2 = M.find(to);
-    if (it2 == M.end())  // no:
-      return false;
+    if (it2 == M.end()) {
+        if (!isMirrored(itr->second, to))
+            return false;
+
+        it2 = toItr->second.out.find(from);
+    }
 
     //
     // Okay, the edge exists, return the weight via the 
@@ -175,10 +419,13 @@ public:
     // We found the vertex exists, so loop through its neighbors 
     // and add each neighbor to the set:
     //   
-    neighbor M = itr->second;
-    for (auto vertex : M) {
+    const vertexEdges& E = itr->second;
+    for (auto& vertex : E.out) {
         S.insert(vertex.first);
     }
+    for (auto& vertex : E.mirrored) {
+        S.insert(vertex);
+    }
 
     return S;
   }
@@ -193,7 +440,7 @@ public:
   {
       vector<VertexT> vertices;
 
-      for (auto vertex : adjList) {
+      for (auto& vertex : adjList) {
           vertices.push_back(vertex.first);
       }
 
@@ -221,7 +468,7 @@ public:
     output << endl;
     output << "**Vertices:" << endl;
     int numVertex = 0;
-    for (auto vertex: adjList)
+    for (auto& vertex: adjList)
     {
         output << " " << numVertex << ". " << vertex.first;
         cout << endl;
@@ -230,17 +477,17 @@ public:
 
     output << endl;
     output << "**Edges:" << endl;
-    neighbor M;
     VertexT currentVertex;
     for (auto itr = adjList.begin(); itr != adjList.end(); ++itr)
     {
         currentVertex = itr->first;
         output << currentVertex << ":";
-        M = itr->second;
+        for (auto& to : neighbors(currentVertex)) {
+            WeightT weight;
+            getWeight(currentVertex, to, weight);
 
-        for (auto vertex : M) {
             output << " (" << currentVertex << ","
-                   << vertex.first << "," << vertex.second << ")";
+                   << to << "," << weight << ")";
         }
 
         cout << endl;
@@ -249,4 +496,111 @@ public:
     output << "**************************************************" << endl;
   }
 
-};
\ No newline at end of file
+private:
+  //
+  // Does v -> u read its weight from u's out (see vertexEdges)?
+  //
+  static bool isMirrored(const vertexEdges& v, const VertexT& u)
+  {
+    return binary_search(v.mirrored.begin(), v.mirrored.end(), u);
+  }
+
+  static void insertMirror(vertexEdges& v, const VertexT& u)
+  {
+    v.mirrored.insert(lower_bound(v.mirrored.begin(), v.mirrored.end(), u), u);
+  }
+
+  static void removeMirror(vertexEdges& v, const VertexT& u)
+  {
+    v.mirrored.erase(lower_bound(v.mirrored.begin(), v.mirrored.end(), u));
+  }
+
+  //
+  // build
+  //
+  // bulkBuild and bulkBuildUndirected; for the latter the edges have
+  // from <= to.
+  //
+  void build(vector<VertexT>& vertices,
+             vector<tuple<VertexT, VertexT, WeightT>>& edges,
+             bool undirected, int numThreads)
+  {
+    adjList.clear();
+    numVertices = 0;
+    numEdges = 0;
+
+    {
+        TraceScope scope("insert_vertices", "graph");
+
+        parallelStableSort(vertices, less<VertexT>(), numThreads);
+        vertices.erase(unique(vertices.begin(), vertices.end()), vertices.end());
+
+        for (auto& v : vertices) {
+            adjList.emplace_hint(adjList.end(), v, vertexEdges());
+        }
+        numVertices = (int)vertices.size();
+    }
+
+    TraceScope scope("insert_edges", "graph");
+
+    //
+    // stable, so repeats of an edge stay in their original order and the
+    // last one of each run is the one to keep:
+    //
+    parallelStableSort(edges,
+        [](const tuple<VertexT, VertexT, WeightT>& e1,
+           const tuple<VertexT, VertexT, WeightT>& e2) {
+            if (get<0>(e1) != get<0>(e2))
+                return get<0>(e1) < get<0>(e2);
+            return get<1>(e1) < get<1>(e2);
+        }, numThreads);
+
+    // (to, from) of the undirected edges, for the mirrored vectors:
+    vector<pair<VertexT, VertexT>> mirrors;
+
+    auto itr = adjList.begin();
+
+    for (size_t i = 0; i < edges.size(); ++i) {
+        const VertexT& from = get<0>(edges[i]);
+        const VertexT& to = get<1>(edges[i]);
+
+        // skip to the last repeat of this edge:
+        if (i + 1 < edges.size() && get<0>(edges[i + 1]) == from && get<1>(edges[i + 1]) == to)
+            continue;
+
+        // edges are in order of from, and so are the vertices:
+        while (itr != adjList.end() && itr->first < from)
+            ++itr;
+
+        if (itr == adjList.end() || itr->first != from)
+            continue;
+
+        if (!binary_search(vertices.begin(), vertices.end(), to))
+            continue;
+
+        neighbor& M = itr->second.out;
+        M.emplace_hint(M.end(), to, get<2>(edges[i]));
+        ++numEdges;
+
+        if (undirected && from != to) {
+            mirrors.push_back(make_pair(to, from));
+            ++numEdges;
+        }
+    }
+
+    //
+    // sorted by (to, from), so each mirrored vector is filled in order:
+    //
+    parallelStableSort(mirrors, less<pair<VertexT, VertexT>>(), numThreads);
+
+    itr = adjList.begin();
+
+    for (auto& m : mirrors) {
+        while (itr->first < m.first)
+            ++itr;
+
+        itr->second.mirrored.push_back(m.second);
+    }
+  }
+
+};
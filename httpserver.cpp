@@ -0,0 +1,608 @@
+/*httpserver.cpp*/
+
+//
+// HTTP/1.1 server: epoll event loop, worker pool
+//
+
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "httpserver.h"
+#include "trace.h"
+
+using namespace std;
+
+// epoll data of the sockets that aren't connections:
+static const uint64_t LISTEN_ID = 0;
+static const uint64_t WAKE_ID = 1;
+
+static string lowercase(const string& s)
+{
+  string lower = s;
+  for (auto& c : lower)
+    c = (char)tolower((unsigned char)c);
+  return lower;
+}
+
+static string trim(const string& s)
+{
+  size_t begin = s.find_first_not_of(" \t");
+  if (begin == string::npos)
+    return "";
+
+  size_t end = s.find_last_not_of(" \t");
+  return s.substr(begin, end - begin + 1);
+}
+
+//
+// %XX escapes, and '+' for space
+//
+static string urlDecode(const string& s)
+{
+  string decoded;
+
+  for (size_t i = 0; i < s.size(); ++i)
+  {
+    if (s[i] == '+')
+      decoded += ' ';
+    else if (s[i] == '%' && i + 2 < s.size() && isxdigit((unsigned char)s[i + 1]) && isxdigit((unsigned char)s[i + 2]))
+    {
+      decoded += (char)stoi(s.substr(i + 1, 2), nullptr, 16);
+      i += 2;
+    }
+    else
+      decoded += s[i];
+  }
+
+  return decoded;
+}
+
+static const char* reason(int status)
+{
+  switch (status)
+  {
+    case 200: return "OK";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 413: return "Payload Too Large";
+    case 431: return "Request Header Fields Too Large";
+    case 500: return "Internal Server Error";
+    case 501: return "Not Implemented";
+    case 503: return "Service Unavailable";
+    default:  return "Unknown";
+  }
+}
+
+//
+// Parses the request at the front of input: returns 1 and how much of the
+// input it took if there is a whole one, 0 if more input is needed, or
+// the status to refuse it with.
+//
+static int parseRequest(const string& input, size_t& consumed, HttpRequest& request)
+{
+  size_t headerEnd = input.find("\r\n\r\n");
+  if (headerEnd == string::npos)
+    return (input.size() > HttpServer::MAX_HEADER) ? 431 : 0;
+  if (headerEnd > HttpServer::MAX_HEADER)
+    return 431;
+
+  istringstream header(input.substr(0, headerEnd));
+  string line, version;
+
+  getline(header, line);
+  if (!line.empty() && line.back() == '\r')
+    line.pop_back();
+
+  istringstream requestLine(line);
+  if (!(requestLine >> request.Method >> request.Target >> version) || version.compare(0, 5, "HTTP/") != 0)
+    return 400;
+
+  request.KeepAlive = (version != "HTTP/1.0");
+
+  while (getline(header, line))
+  {
+    if (!line.empty() && line.back() == '\r')
+      line.pop_back();
+
+    size_t colon = line.find(':');
+    if (colon == string::npos)
+      return 400;
+
+    request.Headers[lowercase(trim(line.substr(0, colon)))] = trim(line.substr(colon + 1));
+  }
+
+  auto connection = request.Headers.find("connection");
+  if (connection != request.Headers.end())
+  {
+    string value = lowercase(connection->second);
+    if (value == "close")
+      request.KeepAlive = false;
+    else if (value == "keep-alive")
+      request.KeepAlive = true;
+  }
+
+  if (request.Headers.count("transfer-encoding"))
+    return 501;
+
+  size_t bodyLength = 0;
+  auto length = request.Headers.find("content-length");
+  if (length != request.Headers.end())
+  {
+    char* end = nullptr;
+    unsigned long long value = strtoull(length->second.c_str(), &end, 10);
+    if (length->second.empty() || *end != '\0')
+      return 400;
+    if (value > HttpServer::MAX_BODY)
+      return 413;
+    bodyLength = (size_t)value;
+  }
+
+  size_t bodyStart = headerEnd + 4;
+  if (input.size() < bodyStart + bodyLength)
+    return 0;
+
+  request.Body = input.substr(bodyStart, bodyLength);
+  consumed = bodyStart + bodyLength;
+
+  // the path, and the query parameters:
+  size_t question = request.Target.find('?');
+  request.Path = urlDecode(request.Target.substr(0, question));
+
+  if (question != string::npos)
+  {
+    istringstream params(request.Target.substr(question + 1));
+    string param;
+
+    while (getline(params, param, '&'))
+    {
+      if (param.empty())
+        continue;
+
+      size_t equals = param.find('=');
+      if (equals == string::npos)
+        request.Query[urlDecode(param)] = "";
+      else
+        request.Query[urlDecode(param.substr(0, equals))] = urlDecode(param.substr(equals + 1));
+    }
+  }
+
+  return 1;
+}
+
+string HttpRequest::param(const string& name, const string& def) const
+{
+  auto it = Query.find(name);
+  return (it == Query.end()) ? def : it->second;
+}
+
+
+//
+// HttpServer
+//
+HttpServer::HttpServer(HttpHandler handler, int numWorkers)
+  : handler(handler), numWorkers(max(1, numWorkers)),
+    listenFd(-1), epollFd(-1), wakeFd(-1), boundPort(0), stopping(false),
+    nextConnection(2), workersStopping(false)
+{
+  epollFd = epoll_create1(EPOLL_CLOEXEC);
+  wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+  epoll_event event;
+  event.events = EPOLLIN;
+  event.data.u64 = WAKE_ID;
+  epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event);
+}
+
+HttpServer::~HttpServer()
+{
+  for (auto& c : connections)
+  {
+    if (c.second->fd >= 0)
+      ::close(c.second->fd);
+  }
+
+  if (listenFd >= 0)
+    ::close(listenFd);
+  ::close(wakeFd);
+  ::close(epollFd);
+}
+
+string HttpServer::format(const HttpResponse& response, bool keepAlive)
+{
+  string formatted = "HTTP/1.1 " + to_string(response.Status) + " " + reason(response.Status) + "\r\n";
+
+  formatted += "Content-Type: " + response.ContentType + "\r\n";
+  formatted += "Content-Length: " + to_string(response.Body.size()) + "\r\n";
+  formatted += keepAlive ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+  formatted += "\r\n";
+  formatted += response.Body;
+
+  return formatted;
+}
+
+bool HttpServer::listen(const string& host, int port)
+{
+  sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons((uint16_t)port);
+
+  if (inet_pton(AF_INET, host.c_str(), &address.sin_addr) != 1)
+    return false;
+
+  listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (listenFd < 0)
+    return false;
+
+  int on = 1;
+  setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+  if (::bind(listenFd, (sockaddr*)&address, sizeof(address)) != 0 || ::listen(listenFd, SOMAXCONN) != 0)
+  {
+    ::close(listenFd);
+    listenFd = -1;
+    return false;
+  }
+
+  socklen_t length = sizeof(address);
+  getsockname(listenFd, (sockaddr*)&address, &length);
+  boundPort = ntohs(address.sin_port);
+
+  epoll_event event;
+  event.events = EPOLLIN;
+  event.data.u64 = LISTEN_ID;
+  epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &event);
+
+  return true;
+}
+
+void HttpServer::stop()
+{
+  stopping.store(true);
+
+  uint64_t one = 1;
+  ssize_t written = write(wakeFd, &one, sizeof(one));
+  (void)written;
+}
+
+void HttpServer::run()
+{
+  workersStopping = false;
+  for (int w = 0; w < numWorkers; ++w)
+    workers.push_back(thread(&HttpServer::work, this, w));
+
+  const int MAX_EVENTS = 64;
+  epoll_event events[MAX_EVENTS];
+
+  while (!stopping.load())
+  {
+    int n = epoll_wait(epollFd, events, MAX_EVENTS, -1);
+    if (n < 0 && errno != EINTR)
+      break;
+
+    for (int e = 0; e < n; ++e)
+    {
+      uint64_t id = events[e].data.u64;
+
+      if (id == LISTEN_ID)
+        accept();
+      else if (id == WAKE_ID)
+        collect();
+      else
+      {
+        auto it = connections.find(id);
+        if (it == connections.end())
+          continue;
+
+        Connection& conn = *it->second;
+
+        // (a hang-up is both ways: the answers could not be delivered)
+        if (events[e].events & (EPOLLERR | EPOLLHUP))
+          close(id, conn);
+        if (events[e].events & (EPOLLIN | EPOLLRDHUP))
+          receive(id, conn);
+        if (events[e].events & EPOLLOUT)
+          send(id, conn);
+      }
+    }
+
+    // (connections are closed as soon as they are done, but only erased
+    // here, so no function is left holding a dangling one)
+    for (auto id : closed)
+      connections.erase(id);
+    closed.clear();
+  }
+
+  // stop the workers, dropping what they haven't started:
+  {
+    lock_guard<mutex> guard(jobsLock);
+    workersStopping = true;
+    jobs.clear();
+  }
+  jobsReady.notify_all();
+
+  for (auto& worker : workers)
+    worker.join();
+  workers.clear();
+
+  for (auto& c : connections)
+    close(c.first, *c.second);
+  connections.clear();
+  closed.clear();
+
+  done.clear();
+}
+
+void HttpServer::accept()
+{
+  for (;;)
+  {
+    int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0)
+      return;
+
+    // responses are written whole, so don't wait to coalesce them:
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+    uint64_t id = nextConnection++;
+    Connection* conn = new Connection(fd);
+    connections[id] = unique_ptr<Connection>(conn);
+
+    conn->events = EPOLLIN | EPOLLRDHUP;
+
+    epoll_event event;
+    event.events = conn->events;
+    event.data.u64 = id;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+  }
+}
+
+void HttpServer::receive(uint64_t id, Connection& conn)
+{
+  char buffer[64 * 1024];
+
+  while (conn.fd >= 0 && !conn.peerClosed)
+  {
+    ssize_t n = recv(conn.fd, buffer, sizeof(buffer), 0);
+
+    if (n > 0)
+      conn.input.append(buffer, n);
+    else if (n == 0)
+      conn.peerClosed = true;    // answer what it sent, then close
+    else if (errno == EINTR)
+      continue;
+    else if (errno == EAGAIN || errno == EWOULDBLOCK)
+      break;
+    else
+      close(id, conn);
+  }
+
+  parse(id, conn);
+  send(id, conn);
+}
+
+//
+// Hands the whole requests received to the workers, as long as fewer
+// than MAX_PIPELINED are in flight (the rest wait in input, and are
+// parsed as responses go out).  A request that can't be parsed gets an
+// error response, and closes the connection.
+//
+void HttpServer::parse(uint64_t id, Connection& conn)
+{
+  while (conn.fd >= 0 && !conn.closing && conn.nextRequest - conn.nextResponse < MAX_PIPELINED)
+  {
+    HttpRequest request;
+    size_t consumed = 0;
+    int result = parseRequest(conn.input, consumed, request);
+
+    if (result == 0)
+      break;
+
+    uint64_t sequence = conn.nextRequest++;
+
+    if (result != 1)
+    {
+      HttpResponse response;
+      response.Status = result;
+      response.Body = string("{\"error\": \"") + reason(result) + "\"}";
+
+      conn.closing = true;
+      conn.input.clear();
+      respond(id, conn, sequence, format(response, false));
+      return;
+    }
+
+    conn.input.erase(0, consumed);
+    if (!request.KeepAlive)
+      conn.closing = true;
+
+    {
+      lock_guard<mutex> guard(jobsLock);
+      jobs.push_back(Job{ id, sequence, move(request) });
+    }
+    jobsReady.notify_one();
+  }
+}
+
+//
+// A response is ready: it goes out after those before it, and may make
+// room for requests held back
+//
+void HttpServer::respond(uint64_t id, Connection& conn, uint64_t sequence, const string& response)
+{
+  conn.ready[sequence] = response;
+
+  while (!conn.ready.empty() && conn.ready.begin()->first == conn.nextResponse)
+  {
+    conn.output += conn.ready.begin()->second;
+    conn.ready.erase(conn.ready.begin());
+    conn.nextResponse++;
+  }
+
+  parse(id, conn);
+  send(id, conn);
+}
+
+//
+// Writes what it can of the output; closes the connection once it has
+// nothing more to answer
+//
+void HttpServer::send(uint64_t id, Connection& conn)
+{
+  while (conn.fd >= 0 && conn.sent < conn.output.size())
+  {
+    ssize_t n = ::send(conn.fd, conn.output.data() + conn.sent, conn.output.size() - conn.sent, MSG_NOSIGNAL);
+
+    if (n > 0)
+      conn.sent += n;
+    else if (n < 0 && errno == EINTR)
+      continue;
+    else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      break;
+    else
+      close(id, conn);
+  }
+
+  if (conn.fd < 0)
+    return;
+
+  if (conn.sent == conn.output.size())
+  {
+    conn.output.clear();
+    conn.sent = 0;
+
+    // (when the client is done sending, and nothing is in flight, what
+    // is left in input is not a whole request)
+    if ((conn.closing || conn.peerClosed) && conn.nextResponse == conn.nextRequest)
+    {
+      close(id, conn);
+      return;
+    }
+  }
+
+  watch(id, conn);
+}
+
+//
+// Waits for input while more requests can come -- and there is room for
+// them: a client pipelining faster than it is answered is left to wait
+// -- and for room to write while there is output
+//
+void HttpServer::watch(uint64_t id, Connection& conn)
+{
+  uint32_t events = 0;
+
+  if (!conn.closing && !conn.peerClosed && conn.input.size() <= MAX_HEADER + MAX_BODY)
+    events |= EPOLLIN | EPOLLRDHUP;
+  if (!conn.output.empty())
+    events |= EPOLLOUT;
+
+  if (events == conn.events)
+    return;
+
+  conn.events = events;
+
+  epoll_event event;
+  event.events = events;
+  event.data.u64 = id;
+  epoll_ctl(epollFd, EPOLL_CTL_MOD, conn.fd, &event);
+}
+
+void HttpServer::close(uint64_t id, Connection& conn)
+{
+  if (conn.fd < 0)
+    return;
+
+  epoll_ctl(epollFd, EPOLL_CTL_DEL, conn.fd, nullptr);
+  ::close(conn.fd);
+  conn.fd = -1;
+
+  closed.push_back(id);
+}
+
+//
+// Takes the workers' responses, for the connections still open
+//
+void HttpServer::collect()
+{
+  uint64_t count;
+  ssize_t n = read(wakeFd, &count, sizeof(count));
+  (void)n;
+
+  vector<Done> finished;
+  {
+    lock_guard<mutex> guard(doneLock);
+    finished.swap(done);
+  }
+
+  for (auto& d : finished)
+  {
+    auto it = connections.find(d.connection);
+    if (it == connections.end() || it->second->fd < 0)
+      continue;
+
+    respond(d.connection, *it->second, d.sequence, d.response);
+  }
+}
+
+void HttpServer::work(int worker)
+{
+  for (;;)
+  {
+    Job job;
+    {
+      unique_lock<mutex> guard(jobsLock);
+      jobsReady.wait(guard, [this]() { return workersStopping || !jobs.empty(); });
+
+      if (workersStopping)
+        return;
+
+      job = move(jobs.front());
+      jobs.pop_front();
+    }
+
+    HttpResponse response;
+    {
+      TraceScope scope("http_request", "server");
+
+      try
+      {
+        handler(worker, job.request, response);
+      }
+      catch (exception& e)
+      {
+        response = HttpResponse();
+        response.Status = 500;
+        response.Body = "{\"error\": \"Internal Server Error\"}";
+      }
+    }
+
+    bool wake;
+    {
+      lock_guard<mutex> guard(doneLock);
+      wake = done.empty();
+      done.push_back(Done{ job.connection, job.sequence, format(response, job.request.KeepAlive) });
+    }
+
+    // the loop takes everything done since it last woke:
+    if (wake)
+    {
+      uint64_t one = 1;
+      ssize_t written = write(wakeFd, &one, sizeof(one));
+      (void)written;
+    }
+  }
+}
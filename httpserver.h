@@ -0,0 +1,196 @@
+/*httpserver.h*/
+
+//
+// A small HTTP/1.1 server, for JSON APIs on a local port.
+//
+// One thread runs an epoll event loop over the listening socket and all
+// the connections: it accepts, reads and parses requests, and writes
+// responses, without ever blocking.  Requests are handled on a pool of
+// worker threads, so a slow one (a search, say) holds up neither the loop
+// nor the other connections.
+//
+// Connections are kept alive (the HTTP/1.1 default; "Connection:
+// keep-alive" in 1.0), and requests can be pipelined: a client may send
+// several before reading any answer.  Up to MAX_PIPELINED requests of a
+// connection are handled at once, possibly on different workers, and the
+// responses are written back in the order of the requests.
+//
+// Only what a JSON API needs is supported: bodies come with a
+// Content-Length (chunked ones are refused), and there is no TLS.
+//
+// Usage:
+//
+//   HttpServer server([](int worker, const HttpRequest& request, HttpResponse& response) {
+//     response.Body = "{\"hello\": \"world\"}";
+//   }, 4);
+//
+//   if (server.listen("127.0.0.1", 8080))
+//     server.run();    // until server.stop(), e.g. from a signal handler
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+
+using namespace std;
+
+//
+// HttpRequest
+//
+// Path is the target up to the '?', Query the parameters after it (URL
+// decoded; a parameter given twice keeps its last value).  Header names
+// are lowercase.
+//
+struct HttpRequest
+{
+  string Method;
+  string Target;
+  string Path;
+  map<string, string> Query;
+  map<string, string> Headers;
+  string Body;
+  bool KeepAlive;
+
+  HttpRequest()
+  {
+    KeepAlive = true;
+  }
+
+  // a query parameter, or def if not given
+  string param(const string& name, const string& def = "") const;
+};
+
+struct HttpResponse
+{
+  int Status;
+  string ContentType;
+  string Body;
+
+  HttpResponse()
+  {
+    Status = 200;
+    ContentType = "application/json";
+  }
+};
+
+//
+// Called on a worker thread, numbered 0 .. numWorkers - 1, for each
+// request; the handler fills in the response.
+//
+typedef function<void(int worker, const HttpRequest& request, HttpResponse& response)> HttpHandler;
+
+class HttpServer
+{
+public:
+  static const size_t MAX_HEADER = 16 * 1024;     // bytes, request line and headers
+  static const size_t MAX_BODY = 1024 * 1024;
+  static const uint64_t MAX_PIPELINED = 32;       // requests in flight per connection
+
+private:
+  struct Connection
+  {
+    int fd;
+    string input;                 // received, not parsed yet
+    string output;                // responses, not all sent yet
+    size_t sent;                  // bytes of output sent
+    uint64_t nextRequest;         // # of requests parsed
+    uint64_t nextResponse;        // # of responses moved to output
+    map<uint64_t, string> ready;  // handled, waiting for earlier ones
+    bool closing;                 // no more requests: close once answered
+    bool peerClosed;              // the client is done sending
+    uint32_t events;              // what epoll waits for
+
+    Connection(int fd)
+      : fd(fd), sent(0), nextRequest(0), nextResponse(0),
+        closing(false), peerClosed(false), events(0)
+    {
+    }
+  };
+
+  struct Job
+  {
+    uint64_t connection;
+    uint64_t sequence;
+    HttpRequest request;
+  };
+
+  struct Done
+  {
+    uint64_t connection;
+    uint64_t sequence;
+    string response;
+  };
+
+  HttpHandler handler;
+  int numWorkers;
+
+  int listenFd;
+  int epollFd;
+  int wakeFd;                     // eventfd: a worker is done, or stop()
+  int boundPort;
+  atomic<bool> stopping;
+
+  uint64_t nextConnection;
+  unordered_map<uint64_t, unique_ptr<Connection>> connections;
+  vector<uint64_t> closed;        // closed, to be erased after the events
+
+  // the workers' queue, and what they have done:
+  vector<thread> workers;
+  mutex jobsLock;
+  condition_variable jobsReady;
+  deque<Job> jobs;
+  bool workersStopping;
+  mutex doneLock;
+  vector<Done> done;
+
+  void accept();
+  void receive(uint64_t id, Connection& conn);
+  void parse(uint64_t id, Connection& conn);
+  void respond(uint64_t id, Connection& conn, uint64_t sequence, const string& response);
+  void send(uint64_t id, Connection& conn);
+  void watch(uint64_t id, Connection& conn);
+  void close(uint64_t id, Connection& conn);
+  void collect();
+  void work(int worker);
+
+public:
+  HttpServer(HttpHandler handler, int numWorkers);
+  ~HttpServer();
+
+  HttpServer(const HttpServer&) = delete;
+  HttpServer& operator=(const HttpServer&) = delete;
+
+  //
+  // Binds to host (an IPv4 address) and port -- 0 for any free port, see
+  // port() -- and listens.  Returns false if it can't.
+  //
+  bool listen(const string& host, int port);
+
+  int port() const
+  {
+    return boundPort;
+  }
+
+  //
+  // Serves until stop(); then closes the connections (requests in
+  // flight are dropped) and stops the workers.
+  //
+  void run();
+
+  // From any thread, or a signal handler:
+  void stop();
+
+  // The full response, status line to body:
+  static string format(const HttpResponse& response, bool keepAlive);
+};
@@ -0,0 +1,302 @@
+/*latency.cpp*/
+
+//
+// HDR-style latency histograms and the per-thread recorder
+//
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+
+#include "latency.h"
+
+using namespace std;
+
+
+//
+// LatencyHistogram
+//
+LatencyHistogram::LatencyHistogram()
+  : counts(NUM_BUCKETS, 0), total(0)
+{
+}
+
+//
+// Values of fewer than PRECISION_BITS bits are their own bucket; a
+// larger value is shifted right until it has PRECISION_BITS bits, and
+// each shift gets the next half-range of buckets.
+//
+int LatencyHistogram::bucketOf(uint64_t value)
+{
+  const uint64_t largest = ((uint64_t)1 << MAX_BITS) - 1;
+  if (value > largest)
+    value = largest;
+
+  if (value < ((uint64_t)1 << PRECISION_BITS))
+    return (int)value;
+
+  int msb = 63 - __builtin_clzll(value);
+  int shift = msb - PRECISION_BITS + 1;
+
+  return (shift << (PRECISION_BITS - 1)) + (int)(value >> shift);
+}
+
+uint64_t LatencyHistogram::bucketLow(int bucket)
+{
+  if (bucket < (1 << PRECISION_BITS))
+    return (uint64_t)bucket;
+
+  int shift = (bucket >> (PRECISION_BITS - 1)) - 1;
+  uint64_t mantissa = (uint64_t)(bucket - (shift << (PRECISION_BITS - 1)));
+
+  return mantissa << shift;
+}
+
+uint64_t LatencyHistogram::bucketHigh(int bucket)
+{
+  if (bucket < (1 << PRECISION_BITS))
+    return (uint64_t)bucket;
+
+  int shift = (bucket >> (PRECISION_BITS - 1)) - 1;
+  return bucketLow(bucket) + ((uint64_t)1 << shift) - 1;
+}
+
+void LatencyHistogram::add(uint64_t value, uint64_t count)
+{
+  addBucket(bucketOf(value), count);
+}
+
+void LatencyHistogram::addBucket(int bucket, uint64_t count)
+{
+  counts[bucket] += count;
+  total += count;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other)
+{
+  for (int b = 0; b < NUM_BUCKETS; b++)
+    counts[b] += other.counts[b];
+
+  total += other.total;
+}
+
+uint64_t LatencyHistogram::min() const
+{
+  for (int b = 0; b < NUM_BUCKETS; b++)
+  {
+    if (counts[b] != 0)
+      return bucketLow(b);
+  }
+  return 0;
+}
+
+uint64_t LatencyHistogram::max() const
+{
+  for (int b = NUM_BUCKETS - 1; b >= 0; b--)
+  {
+    if (counts[b] != 0)
+      return bucketHigh(b);
+  }
+  return 0;
+}
+
+double LatencyHistogram::mean() const
+{
+  if (total == 0)
+    return 0.0;
+
+  double sum = 0.0;
+  for (int b = 0; b < NUM_BUCKETS; b++)
+  {
+    if (counts[b] != 0)
+      sum += counts[b] * ((bucketLow(b) + bucketHigh(b)) / 2.0);
+  }
+
+  return sum / total;
+}
+
+uint64_t LatencyHistogram::percentile(double p) const
+{
+  if (total == 0)
+    return 0;
+
+  // the rank-th smallest value, 1-based:
+  uint64_t rank = (uint64_t)ceil(p / 100.0 * total);
+  rank = std::max<uint64_t>(1, std::min(rank, total));
+
+  uint64_t seen = 0;
+  for (int b = 0; b < NUM_BUCKETS; b++)
+  {
+    seen += counts[b];
+    if (seen >= rank)
+      return (bucketLow(b) + bucketHigh(b)) / 2;
+  }
+
+  return max();
+}
+
+
+//
+// LatencyRecorder
+//
+static atomic<uint64_t> nextRecorderId(1);
+
+// the last recorder this thread recorded to, and its histograms there:
+static thread_local uint64_t cachedRecorder = 0;
+static thread_local void* cachedHistograms = nullptr;
+
+LatencyRecorder::LatencyRecorder(const vector<string>& stages)
+  : id(nextRecorderId++), stages(stages), stopping(false), dumpOutput(nullptr)
+{
+}
+
+LatencyRecorder::~LatencyRecorder()
+{
+  stopDumping();
+}
+
+//
+// The calling thread's histograms, created on its first record; looked
+// up under the lock only when the thread switches recorders.
+//
+LatencyRecorder::ThreadHistograms& LatencyRecorder::threadHistograms()
+{
+  if (cachedRecorder == id)
+    return *(ThreadHistograms*)cachedHistograms;
+
+  lock_guard<mutex> guard(lock);
+
+  ThreadHistograms* found = nullptr;
+  for (auto& t : threads)
+  {
+    if (t->owner == this_thread::get_id())
+      found = t.get();
+  }
+
+  if (found == nullptr)
+  {
+    threads.push_back(unique_ptr<ThreadHistograms>(new ThreadHistograms()));
+    found = threads.back().get();
+    found->owner = this_thread::get_id();
+
+    for (size_t s = 0; s < stages.size(); s++)
+    {
+      found->counts.push_back(unique_ptr<atomic<uint64_t>[]>(
+        new atomic<uint64_t>[LatencyHistogram::NUM_BUCKETS]));
+
+      for (int b = 0; b < LatencyHistogram::NUM_BUCKETS; b++)
+        found->counts[s][b].store(0, memory_order_relaxed);
+    }
+  }
+
+  cachedRecorder = id;
+  cachedHistograms = found;
+
+  return *found;
+}
+
+void LatencyRecorder::record(int stage, uint64_t nanos)
+{
+  atomic<uint64_t>& count = threadHistograms().counts[stage][LatencyHistogram::bucketOf(nanos)];
+
+  // only this thread writes it:
+  count.store(count.load(memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+LatencyHistogram LatencyRecorder::snapshot(int stage) const
+{
+  LatencyHistogram merged;
+  lock_guard<mutex> guard(lock);
+
+  for (auto& t : threads)
+  {
+    for (int b = 0; b < LatencyHistogram::NUM_BUCKETS; b++)
+    {
+      uint64_t count = t->counts[stage][b].load(memory_order_relaxed);
+      if (count != 0)
+        merged.addBucket(b, count);
+    }
+  }
+
+  return merged;
+}
+
+void LatencyRecorder::dump(ostream& output) const
+{
+  double now = chrono::duration<double>(chrono::system_clock::now().time_since_epoch()).count();
+
+  // formatted apart, so output's flags are left alone and each line is
+  // written whole:
+  ostringstream lines;
+  lines << fixed << setprecision(3);
+
+  for (int s = 0; s < (int)stages.size(); s++)
+  {
+    LatencyHistogram h = snapshot(s);
+
+    lines << "{\"time\": " << now
+          << ", \"stage\": \"" << stages[s] << "\""
+          << ", \"count\": " << h.numValues()
+          << ", \"mean_us\": " << h.mean() / 1000.0
+          << ", \"min_us\": " << h.min() / 1000.0
+          << ", \"p50_us\": " << h.percentile(50) / 1000.0
+          << ", \"p90_us\": " << h.percentile(90) / 1000.0
+          << ", \"p99_us\": " << h.percentile(99) / 1000.0
+          << ", \"p999_us\": " << h.percentile(99.9) / 1000.0
+          << ", \"max_us\": " << h.max() / 1000.0
+          << "}" << '\n';
+  }
+
+  output << lines.str();
+  output.flush();
+}
+
+bool LatencyRecorder::startDumping(const string& filename, double intervalSecs)
+{
+  stopDumping();
+
+  if (filename == "-")
+    dumpOutput = &cout;
+  else
+  {
+    dumpFile.open(filename, ios::app);
+    if (!dumpFile.good())
+      return false;
+    dumpOutput = &dumpFile;
+  }
+
+  stopping = false;
+
+  dumper = thread([this, intervalSecs]()
+  {
+    auto interval = chrono::duration<double>(max(intervalSecs, 0.001));
+    unique_lock<mutex> guard(dumpLock);
+
+    while (!dumpWake.wait_for(guard, interval, [this]() { return stopping; }))
+      dump(*dumpOutput);
+  });
+
+  return true;
+}
+
+void LatencyRecorder::stopDumping()
+{
+  if (!dumper.joinable())
+    return;
+
+  {
+    lock_guard<mutex> guard(dumpLock);
+    stopping = true;
+  }
+  dumpWake.notify_all();
+  dumper.join();
+
+  // the final numbers:
+  dump(*dumpOutput);
+
+  if (dumpFile.is_open())
+    dumpFile.close();
+  dumpOutput = nullptr;
+}
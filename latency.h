@@ -0,0 +1,164 @@
+/*latency.h*/
+
+//
+// Query latency histograms, HDR style, for percentiles per stage.
+//
+// A LatencyHistogram counts values (nanoseconds) in buckets whose width
+// grows with the value: values below 256 get a bucket each, and above
+// that every power of 2 is split in 128 buckets, so any value is known to
+// within 1/128 (< 0.8%) from 1 ns up to the 2^40 ns (18 minutes) the
+// histogram holds -- in 4352 counters, whatever the number of values.
+// Percentiles (p50, p99, p999, ...) come out to the same precision.
+//
+// A LatencyRecorder keeps one histogram per stage (e.g. lookup, snap,
+// search, path) per recording thread: recording is a bucket computation
+// and one single-writer counter increment, with no lock and no atomic
+// read-modify-write.  Reading (snapshot, dump) merges the threads'
+// histograms; it can run while they record.  The recorder can also dump
+// itself periodically, from a background thread, as JSON lines:
+//
+//   {"time": 1760900000.123, "stage": "search", "count": 60, "mean_us": 812.5,
+//    "min_us": 2.1, "p50_us": 3.4, "p90_us": 2390, "p99_us": 2490,
+//    "p999_us": 2490, "max_us": 2490}
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+#include <ostream>
+#include <fstream>
+#include <cstdint>
+
+using namespace std;
+
+class LatencyHistogram
+{
+public:
+  static const int PRECISION_BITS = 8;
+  static const int MAX_BITS = 40;
+  static const int NUM_BUCKETS = (MAX_BITS - PRECISION_BITS + 2) << (PRECISION_BITS - 1);
+
+private:
+  vector<uint64_t> counts;
+  uint64_t total;
+
+public:
+  LatencyHistogram();
+
+  static int bucketOf(uint64_t value);
+  static uint64_t bucketLow(int bucket);
+  static uint64_t bucketHigh(int bucket);
+
+  void add(uint64_t value, uint64_t count = 1);
+  void addBucket(int bucket, uint64_t count);
+  void merge(const LatencyHistogram& other);
+
+  uint64_t numValues() const { return total; }
+  uint64_t min() const;
+  uint64_t max() const;
+  double mean() const;
+
+  // the value at percentile p (0-100): the middle of its bucket, so
+  // within half a bucket width of the exact one
+  uint64_t percentile(double p) const;
+};
+
+class LatencyRecorder
+{
+private:
+  //
+  // One thread's histograms: counters only that thread writes, read by
+  // anyone (relaxed; a snapshot taken while recording is a few values
+  // behind at most).
+  //
+  struct ThreadHistograms
+  {
+    thread::id owner;
+    vector<unique_ptr<atomic<uint64_t>[]>> counts;   // [stage][bucket]
+  };
+
+  uint64_t id;                  // unique, for the thread-local cache
+  vector<string> stages;
+  mutable mutex lock;
+  vector<unique_ptr<ThreadHistograms>> threads;
+
+  // periodic dumping:
+  thread dumper;
+  mutex dumpLock;
+  condition_variable dumpWake;
+  bool stopping;
+  ofstream dumpFile;
+  ostream* dumpOutput;
+
+  ThreadHistograms& threadHistograms();
+
+public:
+  LatencyRecorder(const vector<string>& stages);
+  ~LatencyRecorder();
+
+  LatencyRecorder(const LatencyRecorder&) = delete;
+  LatencyRecorder& operator=(const LatencyRecorder&) = delete;
+
+  size_t numStages() const { return stages.size(); }
+  const string& stageName(int stage) const { return stages[stage]; }
+
+  // from any thread:
+  void record(int stage, uint64_t nanos);
+
+  // the histogram of a stage, merged over all threads
+  LatencyHistogram snapshot(int stage) const;
+
+  // one JSON line per stage with count, mean, min, p50, p90, p99, p999
+  // and max, in microseconds
+  void dump(ostream& output) const;
+
+  //
+  // Dumps every intervalSecs seconds, and once more when stopped (or
+  // destroyed), to filename -- appended to -- or to stdout if "-".
+  // Returns false if the file can't be opened.
+  //
+  bool startDumping(const string& filename, double intervalSecs);
+  void stopDumping();
+};
+
+//
+// LatencyTimer
+//
+// Records the time from its construction to the end of its scope (or to
+// stop(), if earlier) as one value of a stage.
+//
+class LatencyTimer
+{
+private:
+  LatencyRecorder* recorder;
+  int stage;
+  chrono::steady_clock::time_point start;
+
+public:
+  LatencyTimer(LatencyRecorder& recorder, int stage)
+    : recorder(&recorder), stage(stage), start(chrono::steady_clock::now())
+  {
+  }
+
+  ~LatencyTimer()
+  {
+    stop();
+  }
+
+  void stop()
+  {
+    if (recorder == nullptr)
+      return;
+
+    recorder->record(stage, chrono::duration_cast<chrono::nanoseconds>(
+      chrono::steady_clock::now() - start).count());
+    recorder = nullptr;
+  }
+};
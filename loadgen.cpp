@@ -0,0 +1,406 @@
+/*loadgen.cpp*/
+
+//
+// Load generator for the routing server (nav --serve): keeps a number of
+// keep-alive connections busy, each with up to --pipeline requests in
+// flight, for --duration seconds (or until --requests have been sent),
+// and reports the throughput and the latency percentiles.
+//
+// The requests come from a file: a line starting with '/' is sent as is
+// (e.g. /nearest?lat=41.87&lon=-87.65), any other line is a start and a
+// destination separated by a tab, as for nav --batch, and is sent to
+// /route (or --endpoint).  Connections go through the lines in turn,
+// each from its own starting point.
+//
+// A request's latency is from when it is written to when its whole
+// response is read, so with pipelining it includes waiting behind the
+// requests before it.  Connections are split over --threads threads,
+// each running an epoll loop.
+//
+//   g++ -std=c++17 -O2 -pthread -o loadgen loadgen.cpp latency.cpp
+//   ./loadgen --port 8080 [--host 127.0.0.1] [--connections C] [--pipeline D]
+//             [--threads T] [--duration SECS] [--requests N]
+//             [--endpoint route|distance] queries.tsv
+//
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "latency.h"
+
+using namespace std;
+
+static string urlEncode(const string& s)
+{
+  const char* hex = "0123456789ABCDEF";
+  string encoded;
+
+  for (unsigned char c : s) {
+    if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~')
+      encoded += (char)c;
+    else {
+      encoded += '%';
+      encoded += hex[c >> 4];
+      encoded += hex[c & 15];
+    }
+  }
+
+  return encoded;
+}
+
+//
+// The whole requests to send, from the lines of the queries file:
+//
+static bool readRequests(const string& filename, const string& endpoint, vector<string>& requests)
+{
+  ifstream input(filename);
+  if (!input.good())
+    return false;
+
+  string line;
+  while (getline(input, line)) {
+    if (!line.empty() && line.back() == '\r')
+      line.pop_back();
+    if (line.empty())
+      continue;
+
+    string target;
+    size_t tab = line.find('\t');
+
+    if (line[0] == '/')
+      target = line;
+    else if (tab != string::npos)
+      target = "/" + endpoint + "?from=" + urlEncode(line.substr(0, tab)) +
+               "&to=" + urlEncode(line.substr(tab + 1));
+    else
+      continue;
+
+    requests.push_back("GET " + target + " HTTP/1.1\r\nHost: localhost\r\n\r\n");
+  }
+
+  return true;
+}
+
+struct Options
+{
+  sockaddr_in address;
+  int connections = 16;
+  int pipeline = 1;
+  int threads = 1;
+  double duration = 10.0;
+  long long maxRequests = 0;   // 0 => no limit
+};
+
+//
+// What a thread saw: its latencies (ns), and counts
+//
+struct Results
+{
+  LatencyHistogram latency;
+  long long completed = 0;
+  long long errors = 0;        // responses with a status other than 2xx
+  long long failures = 0;      // connections that failed or were closed on us
+};
+
+struct Connection
+{
+  int fd = -1;
+  size_t next = 0;                                     // the next request to send
+  string input;
+  deque<chrono::steady_clock::time_point> inFlight;    // when each was written
+};
+
+static int connectTo(const sockaddr_in& address)
+{
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0)
+    return -1;
+
+  if (connect(fd, (const sockaddr*)&address, sizeof(address)) != 0) {
+    close(fd);
+    return -1;
+  }
+
+  int on = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+  // non-blocking from now on; requests are small enough to be written whole
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  return fd;
+}
+
+//
+// Parses the response at the front of input: its status, and how much of
+// the input it takes; false if it isn't all there yet.
+//
+static bool parseResponse(const string& input, int& status, size_t& length)
+{
+  size_t headerEnd = input.find("\r\n\r\n");
+  if (headerEnd == string::npos || input.size() < 12)
+    return false;
+
+  status = atoi(input.c_str() + 9);    // "HTTP/1.1 200 OK"
+
+  size_t bodyLength = 0;
+  string header = input.substr(0, headerEnd);
+  for (auto& c : header)
+    c = (char)tolower((unsigned char)c);
+
+  size_t pos = header.find("\r\ncontent-length:");
+  if (pos != string::npos)
+    bodyLength = strtoull(header.c_str() + pos + 17, nullptr, 10);
+
+  if (input.size() < headerEnd + 4 + bodyLength)
+    return false;
+
+  length = headerEnd + 4 + bodyLength;
+  return true;
+}
+
+static void runThread(const Options& options, int numConnections, int first,
+                      const vector<string>& requests, atomic<long long>& sent,
+                      chrono::steady_clock::time_point deadline, Results& results)
+{
+  int epollFd = epoll_create1(0);
+  vector<Connection> connections(numConnections);
+
+  // sends requests until the connection has --pipeline in flight, or
+  // there are no more to send:
+  auto fill = [&](Connection& conn) {
+    while ((int)conn.inFlight.size() < options.pipeline && chrono::steady_clock::now() < deadline) {
+      if (options.maxRequests > 0 && sent.fetch_add(1) >= options.maxRequests)
+        return;
+
+      const string& request = requests[conn.next];
+      conn.next = (conn.next + 1) % requests.size();
+
+      if (::send(conn.fd, request.data(), request.size(), MSG_NOSIGNAL) != (ssize_t)request.size()) {
+        results.failures++;
+        return;
+      }
+      conn.inFlight.push_back(chrono::steady_clock::now());
+    }
+  };
+
+  auto open = [&](int c) {
+    Connection& conn = connections[c];
+    conn.fd = connectTo(options.address);
+    conn.input.clear();
+    conn.inFlight.clear();
+
+    if (conn.fd < 0) {
+      results.failures++;
+      return;
+    }
+
+    epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u32 = c;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, conn.fd, &event);
+
+    fill(conn);
+  };
+
+  for (int c = 0; c < numConnections; ++c) {
+    connections[c].next = ((size_t)(first + c) * 7919) % requests.size();
+    open(c);
+  }
+
+  const int MAX_EVENTS = 64;
+  epoll_event events[MAX_EVENTS];
+  char buffer[64 * 1024];
+
+  for (;;) {
+    // done once the time (or the requests) are up and all has come back:
+    bool busy = false;
+    for (auto& conn : connections)
+      busy = busy || !conn.inFlight.empty();
+
+    auto now = chrono::steady_clock::now();
+    if (!busy && (now >= deadline || (options.maxRequests > 0 && sent.load() >= options.maxRequests)))
+      break;
+    if (!busy && all_of(connections.begin(), connections.end(), [](Connection& c) { return c.fd < 0; }))
+      break;
+
+    // (after the deadline, the responses still in flight get 5 seconds)
+    auto wait = (now < deadline) ? deadline - now : deadline + chrono::seconds(5) - now;
+    int timeout = (int)max<long long>(1, chrono::duration_cast<chrono::milliseconds>(wait).count());
+    if (now > deadline + chrono::seconds(5))
+      break;
+
+    int n = epoll_wait(epollFd, events, MAX_EVENTS, timeout);
+
+    for (int e = 0; e < n; ++e) {
+      int c = (int)events[e].data.u32;
+      Connection& conn = connections[c];
+      bool closed = false;
+
+      for (;;) {
+        ssize_t got = recv(conn.fd, buffer, sizeof(buffer), 0);
+        if (got > 0)
+          conn.input.append(buffer, got);
+        else if (got < 0 && errno == EINTR)
+          continue;
+        else {
+          closed = (got == 0 || (errno != EAGAIN && errno != EWOULDBLOCK));
+          break;
+        }
+      }
+
+      int status;
+      size_t length;
+      while (!conn.inFlight.empty() && parseResponse(conn.input, status, length)) {
+        auto done = chrono::steady_clock::now();
+        results.latency.add((uint64_t)chrono::duration_cast<chrono::nanoseconds>(done - conn.inFlight.front()).count());
+        results.completed++;
+        if (status < 200 || status > 299)
+          results.errors++;
+
+        conn.input.erase(0, length);
+        conn.inFlight.pop_front();
+      }
+
+      if (closed) {
+        results.failures++;
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, conn.fd, nullptr);
+        close(conn.fd);
+        conn.fd = -1;
+
+        if (chrono::steady_clock::now() < deadline)
+          open(c);
+        else
+          conn.inFlight.clear();
+      }
+      else
+        fill(conn);
+    }
+  }
+
+  for (auto& conn : connections) {
+    if (conn.fd >= 0)
+      close(conn.fd);
+  }
+  close(epollFd);
+}
+
+int main(int argc, char* argv[])
+{
+  Options options;
+  string host = "127.0.0.1", endpoint = "route", queriesFile;
+  int port = -1;
+
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+
+    if (arg == "--host" && i + 1 < argc)
+      host = argv[++i];
+    else if (arg == "--port" && i + 1 < argc)
+      port = atoi(argv[++i]);
+    else if (arg == "--connections" && i + 1 < argc)
+      options.connections = atoi(argv[++i]);
+    else if (arg == "--pipeline" && i + 1 < argc)
+      options.pipeline = atoi(argv[++i]);
+    else if (arg == "--threads" && i + 1 < argc)
+      options.threads = atoi(argv[++i]);
+    else if (arg == "--duration" && i + 1 < argc)
+      options.duration = atof(argv[++i]);
+    else if (arg == "--requests" && i + 1 < argc)
+      options.maxRequests = atoll(argv[++i]);
+    else if (arg == "--endpoint" && i + 1 < argc)
+      endpoint = argv[++i];
+    else if (arg.size() > 0 && arg[0] != '-' && queriesFile.empty())
+      queriesFile = arg;
+    else {
+      cerr << "usage: " << argv[0] << " --port P [--host 127.0.0.1] [--connections C] [--pipeline D]"
+           << " [--threads T] [--duration SECS] [--requests N] [--endpoint route|distance] queries.tsv" << endl;
+      return 1;
+    }
+  }
+
+  if (port <= 0 || queriesFile.empty() || options.connections < 1 || options.pipeline < 1 || options.threads < 1) {
+    cerr << "**Error: need --port, a queries file, and connections, pipeline and threads >= 1" << endl;
+    return 1;
+  }
+
+  memset(&options.address, 0, sizeof(options.address));
+  options.address.sin_family = AF_INET;
+  options.address.sin_port = htons((uint16_t)port);
+  if (inet_pton(AF_INET, host.c_str(), &options.address.sin_addr) != 1) {
+    cerr << "**Error: '" << host << "' is not an IPv4 address" << endl;
+    return 1;
+  }
+
+  vector<string> requests;
+  if (!readRequests(queriesFile, endpoint, requests)) {
+    cerr << "**Error: unable to open '" << queriesFile << "'" << endl;
+    return 1;
+  }
+  if (requests.empty()) {
+    cerr << "**Error: no requests in '" << queriesFile << "'" << endl;
+    return 1;
+  }
+
+  options.threads = min(options.threads, options.connections);
+
+  vector<Results> results(options.threads);
+  vector<thread> threads;
+  atomic<long long> sent(0);
+
+  auto start = chrono::steady_clock::now();
+  auto deadline = start + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(options.duration));
+
+  for (int t = 0; t < options.threads; ++t) {
+    int first = options.connections * t / options.threads;
+    int count = options.connections * (t + 1) / options.threads - first;
+
+    threads.push_back(thread(runThread, cref(options), count, first, cref(requests),
+                             ref(sent), deadline, ref(results[t])));
+  }
+
+  for (auto& t : threads)
+    t.join();
+
+  double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+  Results total;
+  for (auto& r : results) {
+    total.latency.merge(r.latency);
+    total.completed += r.completed;
+    total.errors += r.errors;
+    total.failures += r.failures;
+  }
+
+  cout << fixed << setprecision(1);
+  cout << "connections: " << options.connections << ", pipeline: " << options.pipeline
+       << ", threads: " << options.threads << endl;
+  cout << "requests: " << total.completed << " in " << setprecision(2) << elapsed << " s"
+       << " (non-2xx: " << total.errors << ", connection failures: " << total.failures << ")" << endl;
+  cout << setprecision(1);
+  cout << "throughput: " << total.completed / elapsed << " requests/s" << endl;
+  cout << "latency (us): mean " << total.latency.mean() / 1000.0
+       << ", p50 " << total.latency.percentile(50) / 1000.0
+       << ", p90 " << total.latency.percentile(90) / 1000.0
+       << ", p99 " << total.latency.percentile(99) / 1000.0
+       << ", p99.9 " << total.latency.percentile(99.9) / 1000.0
+       << ", max " << total.latency.max() / 1000.0 << endl;
+
+  return (total.completed > 0) ? 0 : 1;
+}
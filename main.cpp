@@ -24,205 +24,1519 @@
 //
 
 #include <iostream>
+#include <fstream>
+#include <sstream>
 #include <iomanip>  /*setprecision*/
 #include <string>
 #include <vector>
 #include <map>
+#include <set>
+#include <unordered_set>
 #include <stack>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
 #include <cstdlib>
 #include <cstring>
 #include <cassert>
+#include <csignal>
+#include <chrono>
+#include <cmath>
 
 #include "tinyxml2.h"
 #include "dist.h"
 #include "osm.h"
 #include "graph.h"
+#include "flatgraph.h"
 #include "Dijkstra.h"
+#include "searchstats.h"
+#include "trace.h"
+#include "latency.h"
+#include "memusage.h"
+#include "sptcache.h"
+#include "snap.h"
+#include "buildingindex.h"
+#include "chains.h"
+#include "coords.h"
+#include "httpserver.h"
+#include "frozen.h"
+#include "versions.h"
+#include "osmchange.h"
 
 using namespace std;
 using namespace tinyxml2;
 
 //
-// Function to add edges to the graph:
+// Function to add vertices and edges to the graph:
 //
-void addEdge(graph<long long, double>&G, 
-             map<long long, Coordinates> &Nodes, 
-             vector<FootwayInfo> &Footways)
+void addEdges(graph<long long, double, ArenaMemory>&G, 
+              vector<long long> vertices,
+              vector<ChainEdge> &edges)
 {
     //
-    // Loop through footways and add edges between all nodes:
+    // Loop through the (compressed) footway edges and collect both ends
+    // as vertices, and the edge once: footways are walkable both ways, so
+    // it is added as an undirected edge (N1 - N2 and N2 - N1 share one
+    // weight).  The weight is the walking distance between the 2 nodes:
     //
-    double lat1, long1, lat2, long2, dist;
-    map<long long, Coordinates>::iterator it;
-    for (auto& footWay : Footways) {
-        for (size_t i = 0; i < footWay.Nodes.size() - 1; ++i) {
+    vector<tuple<long long, long long, double>> edgeList;
 
-            // Get coordinates for N1:
-            it = Nodes.find(footWay.Nodes[i]);
-            lat1 = it->second.Lat;
-            long1 = it->second.Lon;
+    for (auto& edge : edges) {
+        vertices.push_back(edge.From);
+        vertices.push_back(edge.To);
 
-            // Get coordinates for N2:
-            it = Nodes.find(footWay.Nodes[i + 1]);
-            lat2 = it->second.Lat;
-            long2 = it->second.Lon;
+        edgeList.push_back(make_tuple(edge.From, edge.To, edge.Weight));
+    }
+
+    // Build the graph in one go:
+    G.bulkBuildUndirected(vertices, edgeList);
+}
+
+//
+// Function to find a building given the user input
+// Returns the index of the building in Buildings, or -1 if not found
+//
+int findBuilding(string buildingName, BuildingIndex& index)
+{
+    // abbreviation first, then partial name:
+    int building = index.find(buildingName);
+    if (building >= 0)
+        return building;
+
+    // Not found, maybe a typo?  Take the closest fuzzy match, if any:
+    vector<FuzzyMatch> matches = index.fuzzyFind(buildingName, 1);
+    if (matches.empty())
+        return -1;
+
+    return matches[0].Building;
+}
+
+//
+// Function to pick the destination access node giving the shortest
+// total distance: footway distance from the start plus the distance
+// from the access node to the destination building.
+// Returns -1 if none of the access nodes are reachable.
+//
+long long bestAccessNode(SPTCache& cache, const ShortestPathTree& tree,
+                         vector<AccessNode>& access)
+{
+    long long bestId = -1;
+    double best = INF;
+
+    for (auto& a : access) {
+        int v = cache.indexOf(a.ID);
+        if (v < 0 || tree.Dist[v] == INF)
+            continue;
+
+        if (tree.Dist[v] + a.Dist < best) {
+            best = tree.Dist[v] + a.Dist;
+            bestId = a.ID;
+        }
+    }
+
+    return bestId;
+}
+
+//
+// Function to print a node ID and its position:
+//
+void displayNode(ostream& output, long long id, CoordStore& Coords)
+{
+    double lat = 0.0, lon = 0.0;
+    Coords.find(id, lat, lon);
+
+    output << " " << id << '\n';
+    output << " (" << lat << "," << " " << lon << ")" << '\n';
+}
+
+//
+// Function to tell whether a map file is in the binary PBF format (*.pbf)
+//
+bool isPBF(string filename)
+{
+    const string ext = ".pbf";
+
+    return filename.size() >= ext.size() &&
+           filename.compare(filename.size() - ext.size(), ext.size(), ext) == 0;
+}
+
+//
+// The structures a map is routed on, once loaded (see loadMap), or mapped
+// from a frozen map (see attachMap):
+//
+struct RoutingMap
+{
+    vector<BuildingInfo>  Buildings; // info about each building, in no particular order
+    BuildingIndex         Index;     // building name / abbreviation lookup
+    SnapTable             Snaps;     // nearest footway nodes of each building, used as start/destination points
+    CoordStore            Coords;    // compact positions of the footway nodes
+    FootwayChains         Chains;    // shape points of the footway chains collapsed into single edges
+
+    //
+    // Flat graph that Dijkstra runs on.  Edge weights are stored as
+    // 32-bit fixed point (see bench_weights.cpp for the accuracy vs.
+    // double: about 1e-9 relative, with the same shortest paths), and
+    // distances summed as 64-bit integers:
+    //
+    FlatGraph<FixedRoute> Graph;
+
+    // The frozen map the structures above read in place, if mapped:
+    unique_ptr<FrozenMap> Frozen;
+
+    //
+    // The map's nodes (all of them, as loaded) and footways, kept to apply
+    // changes to (see updateMap) if loaded with keepSource:
+    //
+    map<long long, Coordinates>  Nodes;
+    vector<FootwayInfo>          Footways;
+};
+
+//
+// Function to build the routing graph -- the footway chains, the graph
+// and its flat copy -- and the building index, once the coordinates and
+// snap table are:
+//
+void buildRoutingGraph(RoutingMap& routing, vector<FootwayInfo>& Footways,
+                       graph<long long, double, ArenaMemory>& G,
+                       bool showMemory, MemoryReport& memory)
+{
+    vector<BuildingInfo>&  Buildings = routing.Buildings;
+    CoordStore&            Coords = routing.Coords;
+    SnapTable&             snapTable = routing.Snaps;
+    FootwayChains&         chains = routing.Chains;
+    BuildingIndex&         buildingIndex = routing.Index;
+    FlatGraph<FixedRoute>& routingGraph = routing.Graph;
+
+    //
+    // Collapse chains of footway shape points into single edges; the
+    // access nodes of buildings are where paths start and end, so they
+    // must stay vertices:
+    //
+    vector<long long> accessNodes;
+    for (auto& access : snapTable.Access) {
+        for (auto& a : access) {
+            accessNodes.push_back(a.ID);
+        }
+    }
+
+    vector<ChainEdge> edges;
+    chains.build(Footways, Coords, accessNodes, edges);
+
+    if (showMemory) {
+        memory.checkpoint("chains");
+        memory.add("FootwayChains", chains.memoryUsage());
+        memory.add("chain edges", MemoryOf(edges));
+    }
+
+    //
+    // Add vertices and edges:
+    //
+    addEdges(G, accessNodes, edges);
+
+    {
+        TraceScope scope("building_index", "load");
+        buildingIndex.build(Buildings);
+    }
+
+    {
+        TraceScope scope("flat_build", "graph");
+        routingGraph.build(G);
+    }
+}
+
+//
+// Function to load a map file into the structures queries run on,
+// printing its stats (and, if showMemory, the memory of each structure
+// into memory).  With keepSource, the nodes and footways are kept too,
+// for updates.  Returns false if the map can't be loaded.
+//
+bool loadMap(const string& filename, RoutingMap& routing, bool keepSource,
+             bool showMemory, MemoryReport& memory)
+{
+    map<long long, Coordinates>  Nodes;     // maps a Node ID to it's coordinates (lat, lon)
+    vector<FootwayInfo>          Footways;  // info about each footway, in no particular order
+    graph<long long, double, ArenaMemory> G;  // Vertices are nodes, weights are distances
+    MemoryUsage domMemory;
+
+    vector<BuildingInfo>&  Buildings = routing.Buildings;
+    CoordStore&            Coords = routing.Coords;
+    SnapTable&             snapTable = routing.Snaps;
+    BuildingIndex&         buildingIndex = routing.Index;
+    FlatGraph<FixedRoute>& routingGraph = routing.Graph;
+
+    const int SNAP_K = 3;
+
+    //
+    // Load the map file, and read the nodes (the various known positions
+    // on the map), the footways (the walking paths) and the university
+    // buildings.  XML files are parsed in chunks, in parallel; binary
+    // .pbf files are decoded block by block, in parallel:
+    //
+    int nodeCount, footwayCount, buildingCount;
+    bool loaded;
+
+    {
+        TraceScope scope("load_map", "load");
+
+        if (isPBF(filename))
+            loaded = LoadOpenStreetMapPBF(filename, Nodes, Footways, Buildings,
+                                          nodeCount, footwayCount, buildingCount);
+        else
+            loaded = LoadOpenStreetMapParallel(filename, Nodes, Footways, Buildings,
+                                               nodeCount, footwayCount, buildingCount,
+                                               0, showMemory ? &domMemory : nullptr);
+    }
+
+    if (!loaded)
+    {
+        cout << "**Error: unable to load open street map." << endl;
+        cout << endl;
+        return false;
+    }
+
+    //
+    // Stats
+    //
+    assert(nodeCount == Nodes.size());
+    assert(footwayCount == Footways.size());
+    assert(buildingCount == Buildings.size());
+
+    cout << endl;
+    cout << "# of nodes: " << Nodes.size() << endl;
+    cout << "# of footways: " << Footways.size() << endl;
+    cout << "# of buildings: " << Buildings.size() << endl;
+
+    if (showMemory) {
+        memory.checkpoint("load");
+        memory.add("XML DOM (at peak)", domMemory);
+        memory.add("Nodes (as loaded)", MemoryOf(Nodes));
+    }
+
+    // the nodes as loaded, for updates (pruning would lose the nodes new
+    // footways may be drawn on):
+    if (keepSource)
+        routing.Nodes = Nodes;
+
+    //
+    // Drop the nodes we will never use, i.e. those not on a footway or
+    // building perimeter.  Every node was read first, so this shrinks
+    // what is held from here on, not the peak of the load:
+    //
+    {
+        TraceScope scope("prune_nodes", "load");
+        PruneMapNodes(Nodes, Footways, Buildings);
+    }
+
+    if (showMemory) {
+        memory.checkpoint("prune");
+        memory.add("Nodes (pruned)", MemoryOf(Nodes));
+        memory.add("Footways", MemoryOf(Footways));
+        memory.add("Buildings", MemoryOf(Buildings));
+    }
+
+    //
+    // From here on we only look positions up, so move them into the
+    // compact fixed-point store and free the map:
+    //
+    {
+        TraceScope scope("coord_store", "load");
+        Coords.build(Nodes);
+        map<long long, Coordinates>().swap(Nodes);
+    }
+
+    if (showMemory) {
+        memory.checkpoint("coord store");
+        memory.add("CoordStore", Coords.memoryUsage());
+    }
+
+    //
+    // Snap each building to its nearest footway nodes; the table is saved
+    // next to the map file, so only the first run has to compute it:
+    //
+    string snapFilename = filename + ".snap";
+    if (!LoadSnapTable(snapFilename, filename, Buildings, Footways, Coords, SNAP_K, snapTable)) {
+        BuildSnapTable(Buildings, Footways, Coords, SNAP_K, snapTable);
+        SaveSnapTable(snapFilename, filename, Buildings, snapTable);
+    }
+
+    if (showMemory) {
+        memory.checkpoint("snap");
+        memory.add("SnapTable", snapTable.memoryUsage());
+    }
+
+    buildRoutingGraph(routing, Footways, G, showMemory, memory);
+
+    cout << "# of vertices: " << G.NumVertices() << endl;
+    cout << "# of edges: " << G.NumEdges() << endl;
+
+    if (showMemory) {
+        memory.checkpoint("graph");
+        memory.add("graph", G.memoryUsage());
+        memory.add("routing graph", routingGraph.memoryUsage());
+        memory.add("BuildingIndex", buildingIndex.memoryUsage());
+        memory.print(cout);
+    }
+
+    if (keepSource)
+        routing.Footways = move(Footways);
+
+    return true;
+}
+
+//
+// Function to bring the positions, snap table and edge weights up to
+// date in place, after a change that only moved nodes (and maybe renamed
+// or reshaped buildings): only the nodes moved, the buildings near them
+// and the edges on them are touched.  Returns false if that's not enough
+// -- a building's access nodes changed, an edge is one of several chains
+// between its ends, a moved footway node is on no edge kept, or a weight
+// no longer fits -- and the routing graph must be rebuilt.
+//
+// The weights are summed along each chain from its smaller end, as when
+// built, but in the unit the graph was built with: they agree with a
+// rebuild's to the weights' precision.
+//
+bool reweightMap(RoutingMap& routing, const OsmChangeEffect& effect, size_t& reweighted)
+{
+    CoordStore& Coords = routing.Coords;
+    FlatGraph<FixedRoute>& G = routing.Graph;
+
+    // The footway nodes moved (the others aren't in the store):
+    unordered_set<long long> moved;
+
+    for (long long id : effect.MovedNodes) {
+        auto node = routing.Nodes.find(id);
+        if (Coords.index(id) < 0)
+            continue;
+
+        if (!Coords.setPosition(id, node->second.Lat, node->second.Lon))
+            return false;
+        moved.insert(id);
+    }
+
+    //
+    // Snap again the buildings that moved, and those a moved node is, or
+    // may now be, among the access nodes of:
+    //
+    vector<int> resnap = effect.Recentered;
+
+    for (size_t b = 0; b < routing.Buildings.size(); ++b) {
+        BuildingInfo& building = routing.Buildings[b];
+        vector<AccessNode>& access = routing.Snaps.Access[b];
+
+        for (long long id : moved) {
+            double lat = 0.0, lon = 0.0;
+            Coords.find(id, lat, lon);
+
+            double dist = distBetween2Points(building.Coords.Lat, building.Coords.Lon, lat, lon);
+            bool near = (int)access.size() < routing.Snaps.K || !(dist > access.back().Dist) ||
+                        any_of(access.begin(), access.end(), [&](const AccessNode& a) { return a.ID == id; });
+
+            if (near) {
+                resnap.push_back((int)b);
+                break;
+            }
+        }
+    }
+
+    sort(resnap.begin(), resnap.end());
+    resnap.erase(unique(resnap.begin(), resnap.end()), resnap.end());
+
+    vector<vector<AccessNode>> before;
+    for (int b : resnap)
+        before.push_back(routing.Snaps.Access[b]);
+
+    ResnapBuildings(routing.Buildings, routing.Footways, Coords, resnap, routing.Snaps);
+
+    // (the access nodes are vertices, so new ones change the graph)
+    for (size_t i = 0; i < resnap.size(); ++i) {
+        const vector<AccessNode>& after = routing.Snaps.Access[resnap[i]];
+
+        if (after.size() != before[i].size() ||
+            !equal(after.begin(), after.end(), before[i].begin(),
+                   [](const AccessNode& a, const AccessNode& b) { return a.ID == b.ID; }))
+            return false;
+    }
+
+    //
+    // The edges on the moved nodes: those of a moved vertex, and the
+    // chain a moved shape point is on:
+    //
+    set<pair<long long, long long>> edges;
+    ArrayView<long long> vertices = G.vertices();
+
+    for (long long id : moved) {
+        int v = G.index(id);
+        if (v < 0)
+            continue;
+
+        for (uint32_t e = G.begin(v); e < G.end(v); ++e) {
+            long long w = vertices[G.target(e)];
+            edges.insert(make_pair(min(id, w), max(id, w)));
+        }
+    }
+
+    ArrayView<ChainRange> chainRanges = routing.Chains.chainArray();
+    ArrayView<long long> shapes = routing.Chains.shapeArray();
+    unordered_set<long long> found;     // moved nodes on the graph
+
+    for (long long id : moved) {
+        if (G.index(id) >= 0)
+            found.insert(id);
+    }
+
+    for (auto& chain : chainRanges) {
+        for (uint64_t p = chain.Begin; p < chain.End; ++p) {
+            if (moved.count(shapes[p]) > 0) {
+                edges.insert(make_pair(chain.From, chain.To));
+                found.insert(shapes[p]);
+            }
+        }
+    }
+
+    //
+    // A moved footway node that is on neither -- a shape point of a chain
+    // dropped for a shorter parallel one, say -- may make that chain the
+    // shorter one now; only a rebuild finds out:
+    //
+    if (found.size() < moved.size()) {
+        for (auto& footway : routing.Footways) {
+            for (long long id : footway.Nodes) {
+                if (moved.count(id) > 0 && found.count(id) == 0)
+                    return false;
+            }
+        }
+    }
+
+    for (auto& edge : edges) {
+        if (routing.Chains.isParallel(edge.first, edge.second))
+            return false;
+
+        vector<long long> nodes = routing.Chains.expand({ edge.first, edge.second });
+        double miles = 0.0;
+
+        for (size_t i = 0; i + 1 < nodes.size(); ++i) {
+            int n1 = Coords.index(nodes[i]);
+            int n2 = Coords.index(nodes[i + 1]);
+
+            miles += distBetween2Points(Coords.lat(n1), Coords.lon(n1),
+                                        Coords.lat(n2), Coords.lon(n2));
+        }
+
+        int u = G.index(edge.first), v = G.index(edge.second);
+        if (!G.setWeight(u, v, miles) || !G.setWeight(v, u, miles))
+            return false;
+    }
+
+    reweighted = edges.size();
+    return true;
+}
+
+//
+// Function to rebuild the routing structures of a map loaded with
+// keepSource from the nodes and footways kept, as loadMap does from the
+// file (the map's snap table file no longer applies):
+//
+void rebuildMap(RoutingMap& routing)
+{
+    {
+        TraceScope scope("coord_store", "update");
+
+        map<long long, Coordinates> pruned(routing.Nodes);
+        PruneMapNodes(pruned, routing.Footways, routing.Buildings);
+        routing.Coords.build(pruned);
+    }
+
+    BuildSnapTable(routing.Buildings, routing.Footways, routing.Coords, routing.Snaps.K, routing.Snaps);
+
+    graph<long long, double, ArenaMemory> G;
+    MemoryReport memory;
+    buildRoutingGraph(routing, routing.Footways, G, false, memory);
+}
+
+//
+// How updateMap brought a map up to date:
+//
+enum MapUpdate { UPDATE_FAILED, UPDATE_WEIGHTS, UPDATE_REBUILT };
+
+//
+// Function to apply an OsmChange (see osmchange.h) to a map loaded with
+// keepSource, and bring its routing structures up to date: in place if
+// only nodes moved (see reweightMap), else by rebuilding them from the
+// map kept -- without reading the map file again.  If the change doesn't
+// fit the map, nothing changes and the reason is in error.
+//
+MapUpdate updateMap(RoutingMap& routing, const OsmChange& change, size_t& reweighted, string& error)
+{
+    OsmChangeEffect effect;
+
+    if (!ApplyOsmChange(change, routing.Nodes, routing.Footways, routing.Buildings, effect)) {
+        error = effect.Error;
+        return UPDATE_FAILED;
+    }
+
+    reweighted = 0;
+    if (!effect.FootwaysChanged && !effect.BuildingsChanged && reweightMap(routing, effect, reweighted)) {
+        if (effect.BuildingsRenamed) {
+            TraceScope scope("building_index", "update");
+            routing.Index.build(routing.Buildings);
+        }
+
+        return UPDATE_WEIGHTS;
+    }
+
+    rebuildMap(routing);
+    return UPDATE_REBUILT;
+}
+
+//
+// Function to check a map updated in place (see reweightMap) against the
+// same map rebuilt from the nodes, footways and buildings kept: the same
+// vertices, edges and access nodes, the same paths along each edge, and
+// weights equal but for rounding.  Returns false, with the first
+// difference in error, if they differ.
+//
+bool checkUpdate(RoutingMap& routing, string& error)
+{
+    RoutingMap rebuilt;
+    rebuilt.Nodes = routing.Nodes;
+    rebuilt.Footways = routing.Footways;
+    rebuilt.Buildings = routing.Buildings;
+    rebuilt.Snaps.K = routing.Snaps.K;
+    rebuildMap(rebuilt);
+
+    FlatGraph<FixedRoute>& G = routing.Graph;
+    FlatGraph<FixedRoute>& R = rebuilt.Graph;
+
+    if (G.numVertices() != R.numVertices() || G.numEdges() != R.numEdges()) {
+        error = to_string(G.numVertices()) + " vertices and " + to_string(G.numEdges()) +
+                " edges, rebuilt " + to_string(R.numVertices()) + " and " + to_string(R.numEdges());
+        return false;
+    }
+
+    // (a weight is off by at most half a unit from the distance it encodes)
+    double tolerance = G.unit() + R.unit();
+
+    for (int u = 0; u < (int)G.numVertices(); ++u) {
+        long long from = G.id(u);
+        int r = R.index(from);
+
+        if (r < 0 || G.end(u) - G.begin(u) != R.end(r) - R.begin(r)) {
+            error = "the edges of node " + to_string(from) + " differ";
+            return false;
+        }
+
+        for (uint32_t e = G.begin(u); e < G.end(u); ++e) {
+            long long to = G.id(G.target(e));
+            uint32_t f = R.begin(r);
+
+            while (f < R.end(r) && R.id(R.target(f)) != to)
+                ++f;
+
+            if (f == R.end(r) ||
+                fabs(G.decode(G.weight(e)) - R.decode(R.weight(f))) > tolerance ||
+                routing.Chains.expand({ from, to }) != rebuilt.Chains.expand({ from, to })) {
+                error = "the edge " + to_string(from) + " -> " + to_string(to) + " differs";
+                return false;
+            }
+        }
+    }
+
+    for (size_t b = 0; b < routing.Buildings.size(); ++b) {
+        const vector<AccessNode>& access = routing.Snaps.Access[b];
+        const vector<AccessNode>& expected = rebuilt.Snaps.Access[b];
+
+        if (access.size() != expected.size() ||
+            !equal(access.begin(), access.end(), expected.begin(),
+                   [](const AccessNode& a, const AccessNode& b) { return a.ID == b.ID; })) {
+            error = "the access nodes of " + routing.Buildings[b].Fullname + " differ";
+            return false;
+        }
+    }
+
+    return true;
+}
+
+//
+// Function to map a frozen map (see frozen.h) and route on it in place,
+// instead of loading a map file.  Returns false if it can't be mapped.
+//
+bool attachMap(const string& filename, RoutingMap& routing, bool showMemory, MemoryReport& memory)
+{
+    bool attached;
+
+    {
+        TraceScope scope("attach_frozen", "load");
+
+        routing.Frozen.reset(new FrozenMap());
+        attached = routing.Frozen->open(filename) &&
+                   AttachFrozenMap(*routing.Frozen, routing.Graph, routing.Coords, routing.Chains,
+                                   routing.Buildings, routing.Snaps);
+    }
+
+    if (!attached)
+    {
+        cout << "**Error: unable to map frozen map '" << filename << "'." << endl;
+        cout << endl;
+        return false;
+    }
+
+    {
+        TraceScope scope("building_index", "load");
+        routing.Index.build(routing.Buildings);
+    }
+
+    cout << endl;
+    cout << "# of buildings: " << routing.Buildings.size() << endl;
+    cout << "# of vertices: " << routing.Graph.numVertices() << endl;
+    cout << "# of edges: " << routing.Graph.numEdges() << endl;
+
+    if (showMemory) {
+        memory.checkpoint("attach");
+        memory.add("frozen map (shared)", MemoryUsage(routing.Frozen->size(), 0));
+        memory.add("Buildings", MemoryOf(routing.Buildings));
+        memory.add("SnapTable", routing.Snaps.memoryUsage());
+        memory.add("BuildingIndex", routing.Index.memoryUsage());
+        memory.print(cout);
+    }
+
+    return true;
+}
+
+//
+// Function to open a map for routing: load the map file, or map the
+// frozen map if one is given, then apply the change files in order,
+// printing what each did -- and, with checkChanges, checking those applied
+// in place against a rebuild (see checkUpdate).  Returns false if any of
+// it fails.
+//
+bool openMap(const string& filename, const string& frozenFilename,
+             const vector<string>& changeFilenames, bool checkChanges, RoutingMap& routing,
+             bool showMemory, MemoryReport& memory)
+{
+    if (!frozenFilename.empty() && !changeFilenames.empty()) {
+        cout << "**Error: changes can't be applied to a frozen map." << endl;
+        cout << endl;
+        return false;
+    }
+
+    if (!frozenFilename.empty())
+        return attachMap(frozenFilename, routing, showMemory, memory);
+
+    if (!loadMap(filename, routing, !changeFilenames.empty(), showMemory, memory))
+        return false;
+
+    for (auto& changeFilename : changeFilenames) {
+        auto started = chrono::steady_clock::now();
+
+        OsmChange change;
+        string error;
+        size_t reweighted = 0;
+        MapUpdate update = UPDATE_FAILED;
+
+        if (LoadOsmChange(changeFilename, change, error))
+            update = updateMap(routing, change, reweighted, error);
+
+        if (update == UPDATE_FAILED) {
+            cout << "**Error: unable to apply '" << changeFilename << "': " << error << "." << endl;
+            cout << endl;
+            return false;
+        }
+
+        if (update == UPDATE_WEIGHTS && checkChanges && !checkUpdate(routing, error)) {
+            cout << "**Error: '" << changeFilename << "' applied in place differs from a rebuild: "
+                 << error << "." << endl;
+            cout << endl;
+            return false;
+        }
+
+        ostringstream took;
+        took << fixed << setprecision(1)
+             << chrono::duration<double, milli>(chrono::steady_clock::now() - started).count();
+
+        cout << "Applied '" << changeFilename << "' (" << change.Nodes.size() << " nodes, "
+             << change.Ways.size() << " ways): ";
+        if (update == UPDATE_WEIGHTS)
+            cout << reweighted << " edge weights updated";
+        else
+            cout << "routing graph rebuilt, " << routing.Graph.numVertices() << " vertices, "
+                 << routing.Graph.numEdges() << " edges";
+        cout << ", in " << took.str() << " ms" << endl;
+    }
+
+    return true;
+}
+
+//
+// The stages of a query, as timed by the latency recorder:
+//
+enum QueryStage { STAGE_LOOKUP, STAGE_SNAP, STAGE_SEARCH, STAGE_PATH };
+
+//
+// Everything a query needs once the map is loaded -- the buildings, their
+// lookup and access nodes, the routing graph, and the coordinates and
+// chains its paths expand to -- and what queries are measured with.
+// Queries only read it, except for the measurements, so they can run on
+// several threads at once (each with an SPTCache of its own).
+//
+struct Navigator
+{
+    vector<BuildingInfo>&  Buildings;
+    BuildingIndex&         Index;
+    SnapTable&             Snaps;
+    FlatGraph<FixedRoute>& Graph;
+    CoordStore&            Coords;
+    FootwayChains&         Chains;
 
-            dist = distBetween2Points(lat1, long1, lat2, long2);
+    LatencyRecorder&       Latency;
+    SearchHistograms*      Stats;       // nullptr => searches not counted
+    mutex&                 StatsLock;   // guards Stats (for every Navigator counting into it)
 
-            // Add edge in both directions (from N1 - N2 and from N2 - N1)
-            // The weight is the distance between 2 nodes
-            G.addEdge(footWay.Nodes[i], footWay.Nodes[i + 1], dist);
-            G.addEdge(footWay.Nodes[i + 1], footWay.Nodes[i], dist);
-        }
+    Navigator(vector<BuildingInfo>& buildings, BuildingIndex& index, SnapTable& snaps,
+              FlatGraph<FixedRoute>& graph, CoordStore& coords, FootwayChains& chains,
+              LatencyRecorder& latency, SearchHistograms* stats, mutex& statsLock)
+        : Buildings(buildings), Index(index), Snaps(snaps), Graph(graph), Coords(coords),
+          Chains(chains), Latency(latency), Stats(stats), StatsLock(statsLock)
+    {
     }
-}
+};
 
 //
-// Function to find a building given the user input
+// The answer to a query, as found by findRoute:
+//
+//   Start, Dest            the buildings' indices (-1: not found; if the
+//                          start isn't, the destination isn't looked up)
+//   StartNode, DestNode    the access nodes the route starts and ends at
+//                          (-1 if a building has none)
+//   Reachable              whether there is a route: Distance is its length
+//                          (miles) from building to building, walking to
+//                          and from the access nodes included, and
+//                          FootwayDistance the part of it on footways;
+//                          Path its footway nodes
+//
+struct Route
+{
+    int Start;
+    int Dest;
+    long long StartNode;
+    long long DestNode;
+    bool Reachable;
+    double Distance;
+    double FootwayDistance;
+    vector<long long> Path;
+
+    Route()
+    {
+        Start = Dest = -1;
+        StartNode = DestNode = -1;
+        Reachable = false;
+        Distance = FootwayDistance = 0.0;
+    }
+};
+
 //
-bool findBuilding(string buildingName, vector<BuildingInfo>& Buildings, BuildingInfo &node)
+// Function to route one query -- start and destination buildings, as the
+// user typed them.  The cache holds the trees of earlier searches from
+// the same building.  Without withPath, the path is left empty (and the
+// compressed edges aren't expanded).
+//
+void findRoute(const string& startBuilding, const string& destBuilding,
+               Navigator& nav, SPTCache& sptCache, Route& route, bool withPath = true)
 {
-    // lookup building by abbrev:
-    for (auto& building : Buildings) {
-        if (building.Abbrev == buildingName) {
-            node = building;
-            return true;
+    route = Route();
+
+    // Look for the buildings:
+    {
+        TraceScope scope("lookup", "query");
+        LatencyTimer timer(nav.Latency, STAGE_LOOKUP);
+        route.Start = findBuilding(startBuilding, nav.Index);
+        route.Dest = (route.Start < 0) ? -1 : findBuilding(destBuilding, nav.Index);
+    }
+
+    if (route.Start < 0 || route.Dest < 0)
+        return;
+
+    BuildingInfo& buildingStart = nav.Buildings[route.Start];
+    BuildingInfo& buildingDest = nav.Buildings[route.Dest];
+    vector<AccessNode>& startAccess = nav.Snaps.Access[route.Start];
+    vector<AccessNode>& destAccess = nav.Snaps.Access[route.Dest];
+
+    if (startAccess.empty() || destAccess.empty())
+        return;
+
+    //
+    // There is no direct path between buildings, so we search
+    // from all of the start building's access nodes (on a footpath)
+    // at once, each starting at its distance from the building.
+    // Reuse the shortest-path tree if we have already searched 
+    // from this building:
+    //
+    LatencyTimer searchTimer(nav.Latency, STAGE_SEARCH);
+
+    long long startKey = buildingStart.Coords.ID;
+    const ShortestPathTree* tree = sptCache.lookup(startKey);
+    if (tree == nullptr) {
+        TraceScope scope("search", "query");
+
+        // (an access node that isn't a vertex can't start anything)
+        vector<pair<int, double>> sources;
+        for (auto& a : startAccess) {
+            int v = nav.Graph.index(a.ID);
+            if (v >= 0)
+                sources.push_back(make_pair(v, a.Dist));
+        }
+
+        vector<int> pred;
+        vector<double> dist;
+        if (nav.Stats == nullptr)
+            Dijkstra(nav.Graph, sources, pred, dist);
+        else {
+            SearchStats stats;
+            Dijkstra(nav.Graph, sources, pred, dist, stats);
+
+            lock_guard<mutex> guard(nav.StatsLock);
+            nav.Stats->add(buildingStart.Abbrev + " -> " + buildingDest.Abbrev, stats);
         }
+        tree = &sptCache.insert(startKey, pred, dist);
     }
 
-    // lookup building by full name (partial search):
-    for (auto& building : Buildings) {
-        if (building.Fullname.find(buildingName) != string::npos) {
-            node = building;
-            return true;
+    searchTimer.stop();
+
+    // The destination access node with the shortest total distance,
+    // and the start access node its path begins at:
+    {
+        LatencyTimer snapTimer(nav.Latency, STAGE_SNAP);
+
+        auto accessDist = [](const vector<AccessNode>& access, long long id) {
+            for (auto& a : access) {
+                if (a.ID == id)
+                    return a.Dist;
+            }
+            return 0.0;
+        };
+
+        route.DestNode = bestAccessNode(sptCache, *tree, destAccess);
+        route.StartNode = startAccess[0].ID;
+        if (route.DestNode == -1)
+            route.DestNode = destAccess[0].ID;
+        else if (sptCache.getPath(*tree, route.DestNode, route.Path, route.FootwayDistance)) {
+            route.StartNode = route.Path[0];
+            route.Distance = accessDist(startAccess, route.StartNode) + route.FootwayDistance +
+                             accessDist(destAccess, route.DestNode);
+            route.Reachable = true;
         }
     }
 
-    // If get here, building not found:
-    return false;
+    // Put back the shape points of the collapsed footway chains:
+    TraceScope scope("path", "query");
+    LatencyTimer pathTimer(nav.Latency, STAGE_PATH);
+    if (withPath && route.Reachable)
+        route.Path = nav.Chains.expand(route.Path);
+    else
+        route.Path.clear();
 }
 
 //
-// Function to find the closest nodes (on a footway)
-// to the start and destination buildings:
+// Function to display the shortest path found between the start and
+// destination node, with the footway chains along it expanded
 //
-void findNearestNodes(long long &startId, long long &destId,
-                      double &startLat, double &startLong,
-                      double &destLat, double &destLong,
-                      vector<FootwayInfo> &Footways, map<long long, Coordinates> &Nodes)
+void displayShortestPath(ostream& output, Route& route)
 {
-    double minStart = 99999999999.99;
-    double minDest = 99999999999.99;
-    double latitude, longitude, dist;
-    Coordinates C;
-    map<long long, Coordinates>::iterator it;
+    if (!route.Reachable) {
+        output << "Sorry, destination unreachable" << '\n';
+        return;
+    }
 
-    //
-    // Loop through all footways and find the nodes with minimum distance 
-    // from the start and destination building
-    //
-    for (auto& footWay : Footways)
-    {
-        for (size_t i = 0; i < footWay.Nodes.size(); ++i) {
-            it = Nodes.find(footWay.Nodes[i]);
-            latitude = it->second.Lat;
-            longitude = it->second.Lon;
+    output << "Distance to dest: " << route.Distance << " miles ("
+           << route.FootwayDistance << " on footways)" << '\n';
+    output << "Path: ";
 
-            dist = distBetween2Points(startLat, startLong, latitude, longitude);
+    // Display the entire path:
+    vector<long long>& path = route.Path;
+    output << path[0];
+    for (size_t i = 1; i < path.size(); ++i)
+        output << "->" << path[i];
+    output << '\n';
+  
+}
 
-            if (dist < minStart) {
-                minStart = dist;
-                startId = it->first;
-            }
+//
+// Function to answer one query, writing the answer to output:
+//
+void navigate(ostream& output, const string& startBuilding, const string& destBuilding,
+              Navigator& nav, SPTCache& sptCache)
+{
+    Route route;
+    findRoute(startBuilding, destBuilding, nav, sptCache, route);
 
-            dist = distBetween2Points(destLat, destLong, latitude, longitude);
+    if (route.Start < 0) {
+        output << "Start building not found" << '\n';
+        return;
+    }
 
-            if (dist < minDest) {
-                minDest = dist;
-                destId = it->first;
-            }
-        }
-        
+    if (route.Dest < 0) {
+        output << "Destination building not found" << '\n';
+        return;
+    }
+
+    BuildingInfo& buildingStart = nav.Buildings[route.Start];
+    BuildingInfo& buildingDest = nav.Buildings[route.Dest];
+
+    output << "Starting point:" << '\n';
+    output << " " << buildingStart.Fullname << '\n';
+    output << " (" << buildingStart.Coords.Lat << ", " << buildingStart.Coords.Lon << ")" << '\n';
+
+    output << "Destination point:" << '\n';
+    output << " " << buildingDest.Fullname << '\n';
+    output << " (" << buildingDest.Coords.Lat << ", " << buildingDest.Coords.Lon << ")" << '\n';
+
+    if (route.StartNode == -1) {
+        output << "Sorry, destination unreachable" << '\n';
+        return;
     }
 
-    // Return the start and destination latitude and longitude by reference:
-    it = Nodes.find(startId);
-    startLat = it->second.Lat;
-    startLong = it->second.Lon;
+    output << "Start access node:" << '\n';
+    displayNode(output, route.StartNode, nav.Coords);
+
+    output << "Destination access node:" << '\n';
+    displayNode(output, route.DestNode, nav.Coords);
 
-    it = Nodes.find(destId);
-    destLat = it->second.Lat;
-    destLong = it->second.Lon;
+    // Use Dijkstra's algorithm to find the shortest path:
+    output << "Navigating with Dijkstra..." << '\n';
 
+    displayShortestPath(output, route);
 }
 
 //
-// Function to display the shortest path between the start and destination node
+// Function to answer a batch of queries, one per line of input: start
+// and destination separated by a tab (empty lines are skipped).  Each
+// answer goes to output headed by "Query <line #>: START -> DEST", and
+// followed by an empty line, in the order of the input.
 //
-void displayShortestPath(map<long long, double>& distances,
-                         unordered_map<long long, long long> &predecessors,
-                         long long startId, long long destId)
+// Queries are read in blocks, and the queries of a block are answered on
+// numThreads threads (0 => one per core), each with its own cache of
+// cacheSize trees; each takes a run of consecutive queries at a time, so
+// queries from the same start listed together are answered from one
+// search.  The answers are formatted in memory and written block by
+// block.  Returns the # of queries answered.
+//
+size_t navigateBatch(istream& input, ostream& output, Navigator& nav,
+                     int numThreads, size_t cacheSize)
+{
+    const size_t BLOCK_QUERIES = 4096;   // read ahead and answered in parallel
+    const size_t RUN_QUERIES = 16;       // taken by a thread at a time
+
+    if (numThreads <= 0)
+        numThreads = max(1, (int)thread::hardware_concurrency());
+
+    vector<unique_ptr<SPTCache>> caches;
+    for (int t = 0; t < numThreads; ++t)
+        caches.push_back(unique_ptr<SPTCache>(new SPTCache(nav.Graph.vertices(), cacheSize)));
+
+    vector<string> queries;
+    vector<size_t> lineNumbers;
+    vector<string> answers;
+    size_t lineNumber = 0;
+    size_t numQueries = 0;
+    string line;
+    bool more = true;
+
+    while (more) {
+        queries.clear();
+        lineNumbers.clear();
+
+        while (queries.size() < BLOCK_QUERIES && (more = (bool)getline(input, line))) {
+            ++lineNumber;
+
+            if (!line.empty() && line.back() == '\r')
+                line.pop_back();
+            if (line.empty())
+                continue;
+
+            queries.push_back(line);
+            lineNumbers.push_back(lineNumber);
+        }
+
+        answers.assign(queries.size(), string());
+        atomic<size_t> next(0);
+
+        auto answerQueries = [&](int t) {
+            ostringstream answer;
+            answer << setprecision(8);
+
+            for (;;) {
+                size_t first = next.fetch_add(RUN_QUERIES);
+                if (first >= queries.size())
+                    break;
+
+                size_t last = min(first + RUN_QUERIES, queries.size());
+                for (size_t q = first; q < last; ++q) {
+                    size_t tab = queries[q].find('\t');
+                    string startBuilding = queries[q].substr(0, tab);
+                    string destBuilding = (tab == string::npos) ? "" : queries[q].substr(tab + 1);
+
+                    answer.str("");
+                    answer << "Query " << lineNumbers[q] << ": " << startBuilding << " -> " << destBuilding << '\n';
+
+                    if (tab == string::npos)
+                        answer << "**Error: no tab between start and destination" << '\n';
+                    else
+                        navigate(answer, startBuilding, destBuilding, nav, *caches[t]);
+
+                    answer << '\n';
+                    answers[q] = answer.str();
+                }
+            }
+        };
+
+        vector<thread> workers;
+        for (int t = 1; t < numThreads && (size_t)t * RUN_QUERIES < queries.size(); ++t)
+            workers.push_back(thread(answerQueries, t));
+
+        answerQueries(0);
+
+        for (auto& worker : workers)
+            worker.join();
+
+        for (auto& answer : answers)
+            output.write(answer.data(), answer.size());
+
+        numQueries += queries.size();
+    }
+
+    output.flush();
+    return numQueries;
+}
+
+static string jsonString(const string& s)
 {
-    double totalDist = 0.0;
-    stack<long long> path;
+    string quoted = "\"";
+
+    for (char c : s) {
+        if (c == '"' || c == '\\')
+            quoted += '\\';
+
+        if ((unsigned char)c < 0x20)
+            quoted += ' ';
+        else
+            quoted += c;
+    }
+
+    return quoted + "\"";
+}
 
-    long long currentV = destId;
-    totalDist = distances[destId];
+static void jsonError(HttpResponse& response, int status, const string& message)
+{
+    response.Status = status;
+    response.Body = "{\"error\": " + jsonString(message) + "}";
+}
 
-    if (totalDist == INF) {
-        cout << "Sorry, destination unreachable" << endl;
+//
+// Function to answer a request to the routing server (see main's
+// --serve).  The API, all GET, all answering JSON:
+//
+//   /route?from=START&to=DEST      the route between 2 buildings, named
+//                                  as at the prompt: the buildings, the
+//                                  access nodes it starts and ends at, its
+//                                  length in miles and its footway nodes
+//   /distance?from=START&to=DEST   the same, without the path
+//   /nearest?lat=LAT&lon=LON       the routing graph vertex nearest to a
+//                                  position, and its distance in miles
+//   /complete?q=PREFIX[&max=N]     autocomplete: (up to N, default 10)
+//                                  buildings whose full name starts with
+//                                  PREFIX, in alphabetical order
+//
+// Buildings not found are 404s, missing or bad parameters 400s.  Each
+// worker has its own cache of trees.
+//
+void serveRequest(const HttpRequest& request, HttpResponse& response,
+                  Navigator& nav, SPTCache& sptCache, const NodeGrid& grid)
+{
+    if (request.Method != "GET") {
+        jsonError(response, 405, "only GET is supported");
         return;
     }
 
-    cout << "Distance to dest: " << totalDist << " miles" << endl;
-    cout << "Path: ";
+    ostringstream json;
+    json << setprecision(10);
 
-    // Build stack of nodes along the path, working in reverse from destination
-    // Use predecessors to find path to start
-    while (currentV != -1)
-    {
-        path.push(currentV);
-        currentV = predecessors[currentV];
+    if (request.Path == "/route" || request.Path == "/distance") {
+        bool withPath = (request.Path == "/route");
+
+        if (!request.Query.count("from") || !request.Query.count("to")) {
+            jsonError(response, 400, "'from' and 'to' are required");
+            return;
+        }
+
+        Route route;
+        findRoute(request.param("from"), request.param("to"), nav, sptCache, route, withPath);
+
+        if (route.Start < 0) {
+            jsonError(response, 404, "start building not found");
+            return;
+        }
+        if (route.Dest < 0) {
+            jsonError(response, 404, "destination building not found");
+            return;
+        }
+
+        BuildingInfo& buildingStart = nav.Buildings[route.Start];
+        BuildingInfo& buildingDest = nav.Buildings[route.Dest];
+
+        json << "{\"start\": {\"name\": " << jsonString(buildingStart.Fullname)
+             << ", \"lat\": " << buildingStart.Coords.Lat << ", \"lon\": " << buildingStart.Coords.Lon << "}"
+             << ", \"destination\": {\"name\": " << jsonString(buildingDest.Fullname)
+             << ", \"lat\": " << buildingDest.Coords.Lat << ", \"lon\": " << buildingDest.Coords.Lon << "}"
+             << ", \"reachable\": " << (route.Reachable ? "true" : "false");
+
+        if (route.Reachable)
+            json << ", \"distance_miles\": " << route.Distance
+                 << ", \"footway_miles\": " << route.FootwayDistance;
+
+        if (withPath && route.StartNode != -1) {
+            json << ", \"start_node\": " << route.StartNode
+                 << ", \"destination_node\": " << route.DestNode
+                 << ", \"path\": [";
+
+            for (size_t i = 0; i < route.Path.size(); ++i)
+                json << (i == 0 ? "" : ", ") << route.Path[i];
+            json << "]";
+        }
+
+        json << "}";
     }
+    else if (request.Path == "/nearest") {
+        char* latEnd = nullptr;
+        char* lonEnd = nullptr;
+        string latParam = request.param("lat"), lonParam = request.param("lon");
+        double lat = strtod(latParam.c_str(), &latEnd);
+        double lon = strtod(lonParam.c_str(), &lonEnd);
 
-    // Display the entire path:
-    cout << path.top();
-    path.pop();
-    while (!path.empty())
-    {
-        cout << "->" << path.top();
-        path.pop();
+        if (latParam.empty() || lonParam.empty() || *latEnd != '\0' || *lonEnd != '\0' ||
+            !(lat >= -90 && lat <= 90) || !(lon >= -180 && lon <= 180)) {
+            jsonError(response, 400, "'lat' and 'lon' must be given, in degrees");
+            return;
+        }
+
+        AccessNode nearest;
+        if (!grid.nearest(lat, lon, nearest)) {
+            jsonError(response, 404, "the map has no vertices");
+            return;
+        }
+
+        double nodeLat = 0.0, nodeLon = 0.0;
+        nav.Coords.find(nearest.ID, nodeLat, nodeLon);
+
+        json << "{\"node\": " << nearest.ID << ", \"lat\": " << nodeLat << ", \"lon\": " << nodeLon
+             << ", \"distance_miles\": " << nearest.Dist << "}";
+    }
+    else if (request.Path == "/complete") {
+        const size_t MAX_COMPLETIONS = 100;
+        size_t max = 10;
+
+        if (request.Query.count("max")) {
+            char* maxEnd = nullptr;
+            string maxParam = request.param("max");
+            long n = strtol(maxParam.c_str(), &maxEnd, 10);
+
+            if (maxParam.empty() || *maxEnd != '\0' || n < 1 || n > (long)MAX_COMPLETIONS) {
+                jsonError(response, 400, "'max' must be between 1 and " + to_string(MAX_COMPLETIONS));
+                return;
+            }
+            max = (size_t)n;
+        }
+
+        if (!request.Query.count("q")) {
+            jsonError(response, 400, "'q' is required");
+            return;
+        }
+
+        vector<int> matches = nav.Index.prefix(request.param("q"), max);
+
+        json << "{\"buildings\": [";
+        for (size_t i = 0; i < matches.size(); ++i) {
+            BuildingInfo& building = nav.Buildings[matches[i]];
+
+            json << (i == 0 ? "" : ", ")
+                 << "{\"name\": " << jsonString(building.Fullname)
+                 << ", \"abbrev\": " << jsonString(building.Abbrev)
+                 << ", \"lat\": " << building.Coords.Lat << ", \"lon\": " << building.Coords.Lon << "}";
+        }
+        json << "]}";
+    }
+    else {
+        jsonError(response, 404, "unknown path '" + request.Path + "'");
+        return;
+    }
+
+    response.Body = json.str();
+}
+
+// the server running, for the signal handler to stop:
+static HttpServer* runningServer = nullptr;
+
+static void stopServer(int)
+{
+    if (runningServer != nullptr)
+        runningServer->stop();
+}
+
+// set on SIGHUP, for the server to reload the map:
+static atomic<bool> reloadRequested(false);
+
+static void requestReload(int)
+{
+    reloadRequested = true;
+}
+
+//
+// A version of the map the server routes on: the map, and what requests
+// are answered with -- a Navigator, the nearest-vertex grid, and an
+// SPTCache per worker (of this version's graph).  Versions are swapped
+// under the workers by a VersionManager (see versions.h) when the map is
+// reloaded.
+//
+struct MapVersion
+{
+    RoutingMap                   Map;
+    unique_ptr<Navigator>        Nav;
+    NodeGrid                     Grid;
+    vector<unique_ptr<SPTCache>> Caches;    // one per worker
+};
+
+//
+// Function to make the Navigator, grid and caches of a version, once its
+// map is loaded:
+//
+void prepareVersion(MapVersion& version, int numWorkers, size_t cacheSize,
+                    LatencyRecorder& latency, SearchHistograms* stats, mutex& statsLock)
+{
+    RoutingMap& map = version.Map;
+
+    version.Nav.reset(new Navigator(map.Buildings, map.Index, map.Snaps, map.Graph, map.Coords,
+                                    map.Chains, latency, stats, statsLock));
+    version.Grid.build(map.Graph.vertices(), map.Coords);
+
+    version.Caches.clear();
+    for (int w = 0; w < numWorkers; ++w)
+        version.Caches.push_back(unique_ptr<SPTCache>(new SPTCache(map.Graph.vertices(), cacheSize)));
+}
+
+//
+// Function run by the server's loader thread, while serving: on SIGHUP,
+// loads the map again -- from mapFilename with the changes applied, or
+// mapped from frozenFilename if given -- into a new version, and
+// publishes it.  The workers route
+// on the current version all along, and pick up the new one with their
+// next request; the old one is freed once the last request on it is done.
+// If the map can't be loaded, the current version stays.
+//
+void reloadMaps(VersionManager<MapVersion>& versions, atomic<bool>& serving,
+                const string& mapFilename, const string& frozenFilename,
+                const vector<string>& changeFilenames, int numWorkers, size_t cacheSize,
+                LatencyRecorder& latency, SearchHistograms* stats, mutex& statsLock)
+{
+    while (serving) {
+        this_thread::sleep_for(chrono::milliseconds(100));
+        versions.reclaim();
+
+        if (!reloadRequested.exchange(false))
+            continue;
+
+        auto started = chrono::steady_clock::now();
+
+        unique_ptr<MapVersion> version(new MapVersion());
+        MemoryReport memory;
+        bool loaded;
+
+        {
+            TraceScope scope("reload_map", "load");
+
+            // (the changes were checked, if asked to, when first loaded)
+            loaded = openMap(mapFilename, frozenFilename, changeFilenames, false, version->Map, false, memory);
+            if (loaded)
+                prepareVersion(*version, numWorkers, cacheSize, latency, stats, statsLock);
+        }
+
+        if (!loaded) {
+            cout << "**Error: unable to reload the map; serving the previous version." << endl;
+            continue;
+        }
+
+        uint64_t number = versions.publish(move(version));
+
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - started).count();
+        cout << "Serving map version " << number << " (loaded in " << (long long)ms << " ms)" << endl;
     }
-    cout << endl;
-  
 }
 
 //////////////////////////////////////////////////////////////////
 //
 // main
 //
-int main()
+// Options:
+//   --search-stats FILE   count the work of each search (see searchstats.h),
+//                         and write histograms of it, with the slowest
+//                         queries, to FILE as JSON when done
+//   --trace FILE          trace the load and query phases (see trace.h),
+//                         and write them to FILE as a Chrome trace when done
+//   --latency FILE        append latency percentiles of each query stage
+//                         (see latency.h) to FILE, or stdout if "-", every
+//                         --latency-interval seconds (default 10) and when
+//                         done
+//   --memory              print the memory held by each structure, and the
+//                         RSS after each load stage, after the graph stats
+//   --map FILE            the map file, instead of asking for it
+//   --batch FILE          answer the queries in FILE (or stdin, if "-"),
+//                         a start and destination per line separated by a
+//                         tab, instead of asking for them (see navigateBatch)
+//   --output FILE         write the answers of --batch to FILE, instead of
+//                         stdout
+//   --threads N           answer --batch queries, or --serve requests, on N
+//                         threads (default: one per core)
+//   --serve PORT          serve routes as JSON over HTTP on 127.0.0.1:PORT
+//                         (see serveRequest) instead of asking for queries,
+//                         until interrupted; SIGHUP reloads the map (or the
+//                         frozen map) and swaps it in (see reloadMaps)
+//   --freeze FILE         write the loaded map to FILE as a frozen map (see
+//                         frozen.h), e.g. /dev/shm/map.nav to share it in
+//                         memory
+//   --frozen FILE         route on the frozen map FILE, mapped in place and
+//                         shared with every other process mapping it,
+//                         instead of loading a map file
+//   --changes FILE        apply the OsmChange FILE (see osmchange.h) to the
+//                         map once loaded, updating the routing graph in
+//                         place where it can (see updateMap); may be given
+//                         several times, applied in order
+//   --check-changes       check each --changes file applied in place
+//                         against the routing graph rebuilt from scratch,
+//                         and stop if they differ (see checkUpdate)
+//
+int main(int argc, char* argv[])
 {
-    map<long long, Coordinates>  Nodes;     // maps a Node ID to it's coordinates (lat, lon)
-    vector<FootwayInfo>          Footways;  // info about each footway, in no particular order
-    vector<BuildingInfo>         Buildings; // info about each building, in no particular order
-    XMLDocument                  xmldoc;
-    graph<long long, double>     G;         // Vertices are nodes, weights are distances
-    map<long long, double> distances;       // Map to store distances of all vertices from the start
+    // The map, loaded or frozen:
+    RoutingMap routing;
+
+    // # of shortest-path trees kept around for repeated queries from the same start
+    const size_t SPT_CACHE_SIZE = 16;
+
+    // Counters of the searches, and trace of the phases, if asked for
+    string searchStatsFilename;
+    SearchHistograms searchHistograms;
+    string traceFilename;
+
+    // Latency of each stage of a query:
+    LatencyRecorder latency({ "lookup", "snap", "search", "path" });
+    string latencyFilename;
+    double latencyInterval = 10.0;
+
+    // Memory of each structure, and RSS along the load:
+    bool showMemory = false;
+    MemoryReport memory;
+
+    // Batch mode: queries from a file instead of the prompts
+    string mapFilename;
+    string batchFilename;
+    string outputFilename;
+    int numThreads = 0;
+
+    // Server mode: queries over HTTP
+    int servePort = -1;
+
+    // Frozen maps: one to write once loaded, or one to map instead of loading
+    string freezeFilename;
+    string frozenFilename;
+
+    // OsmChange files to apply to the map once loaded
+    vector<string> changeFilenames;
+    bool checkChanges = false;
+
+    for (int i = 1; i < argc; ++i) {
+        string option = argv[i];
+
+        if (option == "--search-stats" && i + 1 < argc)
+            searchStatsFilename = argv[++i];
+        else if (option == "--trace" && i + 1 < argc)
+            traceFilename = argv[++i];
+        else if (option == "--latency" && i + 1 < argc)
+            latencyFilename = argv[++i];
+        else if (option == "--latency-interval" && i + 1 < argc)
+            latencyInterval = atof(argv[++i]);
+        else if (option == "--memory")
+            showMemory = true;
+        else if (option == "--map" && i + 1 < argc)
+            mapFilename = argv[++i];
+        else if (option == "--batch" && i + 1 < argc)
+            batchFilename = argv[++i];
+        else if (option == "--output" && i + 1 < argc)
+            outputFilename = argv[++i];
+        else if (option == "--threads" && i + 1 < argc)
+            numThreads = atoi(argv[++i]);
+        else if (option == "--serve" && i + 1 < argc)
+            servePort = atoi(argv[++i]);
+        else if (option == "--freeze" && i + 1 < argc)
+            freezeFilename = argv[++i];
+        else if (option == "--frozen" && i + 1 < argc)
+            frozenFilename = argv[++i];
+        else if (option == "--changes" && i + 1 < argc)
+            changeFilenames.push_back(argv[++i]);
+        else if (option == "--check-changes")
+            checkChanges = true;
+        else {
+            cout << "usage: " << argv[0] << " [--search-stats stats.json] [--trace trace.json]"
+                 << " [--latency latency.jsonl|-] [--latency-interval secs] [--memory]"
+                 << " [--map map.osm] [--batch queries.tsv|-] [--output answers.txt] [--threads n] [--serve port]"
+                 << " [--freeze map.nav] [--frozen map.nav] [--changes changes.osc ...] [--check-changes]" << endl;
+            return 0;
+        }
+    }
+
+    if (!traceFilename.empty())
+        TraceEnable(true);
+
+    if (!latencyFilename.empty() && !latency.startDumping(latencyFilename, latencyInterval)) {
+        cout << "**Error: unable to write '" << latencyFilename << "'." << endl;
+        return 0;
+    }
+
+    //
+    // The batch's queries and answers; the answers go out through a large
+    // buffer, written when full:
+    //
+    ifstream batchFile;
+    ofstream outputFile;
+    vector<char> outputBuffer(1 << 20);
 
-    // Spanning tree for path implemented by storing predecessors of all vertices (-1 for start)
-    unordered_map<long long, long long> predecessors;  
+    if (!batchFilename.empty() && batchFilename != "-") {
+        batchFile.open(batchFilename);
+        if (!batchFile.good()) {
+            cout << "**Error: unable to open '" << batchFilename << "'." << endl;
+            return 0;
+        }
+    }
 
+    if (!outputFilename.empty()) {
+        outputFile.rdbuf()->pubsetbuf(outputBuffer.data(), outputBuffer.size());
+        outputFile.open(outputFilename);
+        if (!outputFile.good()) {
+            cout << "**Error: unable to write '" << outputFilename << "'." << endl;
+            return 0;
+        }
+    }
 
     cout << "** Navigating UIC open street map **" << endl;
     cout << endl;
     cout << std::setprecision(8);
 
     string def_filename = "map.osm";
-    string filename;
+    string filename = mapFilename;
 
-    cout << "Enter map filename> ";
-    getline(cin, filename);
+    if (mapFilename.empty() && frozenFilename.empty()) {
+        cout << "Enter map filename> ";
+        getline(cin, filename);
+    }
 
     if (filename == "")
     {
@@ -230,139 +1544,126 @@ int main()
     }
 
     //
-    // Load XML-based map file 
+    // Load the map file (and apply the changes), or map the frozen one; and
+    // freeze it, if asked:
     //
-    if (!LoadOpenStreetMap(filename, xmldoc))
-    {
-        cout << "**Error: unable to load open street map." << endl;
-        cout << endl;
+    if (!openMap(filename, frozenFilename, changeFilenames, checkChanges, routing, showMemory, memory))
         return 0;
+
+    if (!freezeFilename.empty()) {
+        TraceScope scope("freeze", "load");
+
+        if (!WriteFrozenMap(freezeFilename, routing.Graph, routing.Coords, routing.Chains,
+                            routing.Buildings, routing.Snaps))
+            cout << "**Error: unable to write '" << freezeFilename << "'." << endl;
     }
 
-    //
-    // Read the nodes, which are the various known positions on the map:
-    //
-    int nodeCount = ReadMapNodes(xmldoc, Nodes);
+    cout << endl;
 
-    //
-    // Read the footways, which are the walking paths:
-    //
-    int footwayCount = ReadFootways(xmldoc, Footways);
+    SearchHistograms* stats = searchStatsFilename.empty() ? nullptr : &searchHistograms;
+    mutex statsLock;
 
-    //
-    // Read the university buildings:
-    //
-    int buildingCount = ReadUniversityBuildings(xmldoc, Nodes, Buildings);
+    Navigator nav(routing.Buildings, routing.Index, routing.Snaps, routing.Graph, routing.Coords,
+                  routing.Chains, latency, stats, statsLock);
 
     //
-    // Stats
+    // Batch navigation, from the queries given:
     //
-    assert(nodeCount == Nodes.size());
-    assert(footwayCount == Footways.size());
-    assert(buildingCount == Buildings.size());
+    if (!batchFilename.empty()) {
+        istream& queries = batchFile.is_open() ? (istream&)batchFile : cin;
+        ostream& answers = outputFile.is_open() ? (ostream&)outputFile : cout;
 
-    cout << endl;
-    cout << "# of nodes: " << Nodes.size() << endl;
-    cout << "# of footways: " << Footways.size() << endl;
-    cout << "# of buildings: " << Buildings.size() << endl;
+        size_t numQueries = navigateBatch(queries, answers, nav, numThreads, SPT_CACHE_SIZE);
 
-    //
-    // Add vertices:
-    //
-    for (auto& node : Nodes) {
-        G.addVertex(node.first);
+        if (!answers.good())
+            cout << "**Error: unable to write '" << outputFilename << "'." << endl;
+        cout << "# of queries: " << numQueries << endl;
+        cout << endl;
     }
 
     //
-    // Add edges:
-    //
-    addEdge(G, Nodes, Footways);
-   
-    cout << "# of vertices: " << G.NumVertices() << endl;
-    cout << "# of edges: " << G.NumEdges() << endl;
-    cout << endl;
-
-    //
-    // Navigation from building to building
+    // Serving routes, until interrupted.  The map loaded is the server's
+    // first version; SIGHUP loads the next, in the background:
     //
-    string startBuilding, destBuilding;
+    if (servePort >= 0) {
+        int numWorkers = (numThreads > 0) ? numThreads : max(1, (int)thread::hardware_concurrency());
 
-    cout << "Enter start (partial name or abbreviation), or #> ";
-    getline(cin, startBuilding);
+        VersionManager<MapVersion> versions(numWorkers);
 
-    bool foundStart, foundDest;
-    long long startId, destId;
-    BuildingInfo buildingStart, buildingDest;
-    double startLat, startLong, destLat, destLong;
-    while (startBuilding != "#")
-    {
-        cout << "Enter destination (partial name or abbreviation)> ";
-        getline(cin, destBuilding);
+        unique_ptr<MapVersion> first(new MapVersion());
+        first->Map = move(routing);
+        prepareVersion(*first, numWorkers, SPT_CACHE_SIZE, latency, stats, statsLock);
+        versions.publish(move(first));
 
-        // Look for start building:
-        foundStart = findBuilding(startBuilding, Buildings, buildingStart);
+        HttpServer server([&](int worker, const HttpRequest& request, HttpResponse& response) {
+            auto version = versions.pin(worker);
+            serveRequest(request, response, *version->Nav, *version->Caches[worker], version->Grid);
+        }, numWorkers);
 
-        if (!foundStart)
-            cout << "Start building not found" << endl;
-      
-        else
-        {
-            // Look for destination building:
-            foundDest = findBuilding(destBuilding, Buildings, buildingDest);
-
-            if (!foundDest)
-                cout << "Destination building not found" << endl;
-
-            // Starting and destination buildings found, now search for path:
-            else
-            {
-                // get info for start building:
-                startId = buildingStart.Coords.ID;
-                startLat = buildingStart.Coords.Lat;
-                startLong = buildingStart.Coords.Lon;
-
-                cout << "Starting point:" << endl;
-                cout << " " << buildingStart.Fullname << endl;
-                cout << " (" << startLat << ", " << startLong << ")" << endl;
-
-                // get info for destination building:
-                destId = buildingDest.Coords.ID;
-                destLat = buildingDest.Coords.Lat;
-                destLong = buildingDest.Coords.Lon;
-
-                cout << "Destination point:" << endl;
-                cout << " " << buildingDest.Fullname << endl;
-                cout << " (" << destLat << ", " << destLong << ")" << endl;
-
-                //
-                // There is no direct path between buildings
-                // We must search the nearest nodes (on a footpath) to the
-                // start and destination building
-                //
-                findNearestNodes(startId, destId, startLat, startLong, destLat, destLong, Footways, Nodes);
-
-                cout << "Nearest start node:" << endl;
-                cout << " " << startId << endl;
-                cout << " (" << startLat << "," << " " << startLong << ")" << endl;
-
-                cout << "Nearest destination node:" << endl;
-                cout << " " << destId << endl;
-                cout << " (" << destLat << "," << " " << destLong << ")" << endl;
-
-                // Use Dijkstra's algorithm to find the shortest path:
-                cout << "Navigating with Dijkstra..." << endl;
-
-                Dijkstra(G, startId, predecessors, distances);
-                displayShortestPath(distances, predecessors, startId, destId);
-            }
+        if (!server.listen("127.0.0.1", servePort)) {
+            cout << "**Error: unable to listen on port " << servePort << "." << endl;
+            return 0;
         }
-       
-        //
-        // another navigation?
-        //
+
+        runningServer = &server;
+        signal(SIGINT, stopServer);
+        signal(SIGTERM, stopServer);
+        signal(SIGHUP, requestReload);
+
+        atomic<bool> serving(true);
+        thread loader(reloadMaps, ref(versions), ref(serving), cref(filename), cref(frozenFilename),
+                      cref(changeFilenames), numWorkers, SPT_CACHE_SIZE, ref(latency), stats, ref(statsLock));
+
+        cout << "Serving on http://127.0.0.1:" << server.port() << "/ with "
+             << numWorkers << " workers (Ctrl-C to stop, SIGHUP to reload the map)" << endl;
+        server.run();
+
+        serving = false;
+        loader.join();
+
+        runningServer = nullptr;
         cout << endl;
+    }
+
+    //
+    // Navigation from building to building, unless in batch or server mode:
+    //
+    if (batchFilename.empty() && servePort < 0) {
+        SPTCache sptCache(routing.Graph.vertices(), SPT_CACHE_SIZE);
+
+        string startBuilding;
+        string destBuilding;
+
         cout << "Enter start (partial name or abbreviation), or #> ";
         getline(cin, startBuilding);
+
+        while (startBuilding != "#")
+        {
+            cout << "Enter destination (partial name or abbreviation)> ";
+            getline(cin, destBuilding);
+
+            navigate(cout, startBuilding, destBuilding, nav, sptCache);
+
+            //
+            // another navigation?
+            //
+            cout << endl;
+            cout << "Enter start (partial name or abbreviation), or #> ";
+            getline(cin, startBuilding);
+        }
+    }
+
+    latency.stopDumping();
+
+    if (!traceFilename.empty() && !WriteChromeTrace(traceFilename))
+        cout << "**Error: unable to write '" << traceFilename << "'." << endl;
+
+    if (!searchStatsFilename.empty()) {
+        ofstream statsFile(searchStatsFilename);
+        searchHistograms.writeJSON(statsFile);
+
+        if (!statsFile.good())
+            cout << "**Error: unable to write '" << searchStatsFilename << "'." << endl;
     }
 
     //
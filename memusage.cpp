@@ -0,0 +1,103 @@
+/*memusage.cpp*/
+
+//
+// Resident set size of the process, and the memory report
+//
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <algorithm>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "memusage.h"
+
+using namespace std;
+
+//
+// CurrentRSS
+//
+// From /proc/self/statm (resident pages); 0 if it can't be read.
+//
+size_t CurrentRSS()
+{
+  ifstream statm("/proc/self/statm");
+  size_t pages = 0, resident = 0;
+
+  if (!(statm >> pages >> resident))
+    return 0;
+
+  return resident * (size_t)sysconf(_SC_PAGESIZE);
+}
+
+//
+// PeakRSS
+//
+// The high-water mark kept by the kernel (ru_maxrss, in KB on Linux).
+//
+size_t PeakRSS()
+{
+  struct rusage usage;
+
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0;
+
+  return (size_t)usage.ru_maxrss * 1024;
+}
+
+
+//
+// MemoryReport
+//
+void MemoryReport::add(const string& name, const MemoryUsage& usage)
+{
+  structures.push_back(make_pair(name, usage));
+}
+
+void MemoryReport::checkpoint(const string& stage)
+{
+  size_t current = CurrentRSS();
+
+  // the kernel updates its high-water mark lazily, so it can trail:
+  checkpoints.push_back(make_pair(stage, make_pair(current, max(current, PeakRSS()))));
+}
+
+void MemoryReport::print(ostream& output) const
+{
+  const size_t KB = 1024;
+  MemoryUsage total;
+  ios::fmtflags flags = output.flags();
+
+  output << left << setw(22) << "Memory (KB)" << right
+         << setw(12) << "payload" << setw(12) << "overhead" << setw(12) << "total" << '\n';
+
+  for (auto& s : structures)
+  {
+    output << "  " << left << setw(20) << s.first << right
+           << setw(12) << s.second.Payload / KB
+           << setw(12) << s.second.Overhead / KB
+           << setw(12) << s.second.total() / KB << '\n';
+    total += s.second;
+  }
+
+  output << "  " << left << setw(20) << "(all of the above)" << right
+         << setw(12) << total.Payload / KB
+         << setw(12) << total.Overhead / KB
+         << setw(12) << total.total() / KB << '\n';
+
+  if (!checkpoints.empty())
+  {
+    output << left << setw(22) << "RSS (KB) after" << right
+           << setw(12) << "current" << setw(12) << "peak" << '\n';
+  }
+
+  for (auto& c : checkpoints)
+  {
+    output << "  " << left << setw(20) << c.first << right
+           << setw(12) << c.second.first / KB
+           << setw(12) << c.second.second / KB << '\n';
+  }
+
+  output.flags(flags);
+}
@@ -0,0 +1,249 @@
+/*memusage.h*/
+
+//
+// Memory accounting: how many bytes a structure holds, by category:
+//   Payload    the data itself: keys, values, coordinates, characters
+//   Overhead   what holding it costs on top: the container objects, tree
+//              and hash node links, bucket arrays, vector capacity not in
+//              use, allocator headers and rounding
+//
+// MemoryOf(x) gives both for x, deep: x's own bytes (sizeof) plus what
+// it owns.  The overloads below cover the standard containers; they are
+// computed from the containers' layout in libstdc++ and the chunk sizes
+// of glibc's malloc (or, for pmr containers, of an arena: no header),
+// not measured, so they are estimates -- good ones for the big
+// structures, which is what sizing a host needs.  A type holding
+// containers gets its own MemoryOf overload (or memoryUsage() method),
+// summing its members'.
+//
+// The process as a whole is measured: CurrentRSS and PeakRSS, and a
+// MemoryReport to print both kinds next to each other.
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <list>
+#include <unordered_map>
+#include <memory_resource>
+#include <type_traits>
+#include <utility>
+#include <ostream>
+#include <cstddef>
+
+using namespace std;
+
+struct MemoryUsage
+{
+  size_t Payload;
+  size_t Overhead;
+
+  MemoryUsage()
+  {
+    Payload = 0;
+    Overhead = 0;
+  }
+
+  MemoryUsage(size_t payload, size_t overhead)
+  {
+    Payload = payload;
+    Overhead = overhead;
+  }
+
+  size_t total() const
+  {
+    return Payload + Overhead;
+  }
+
+  MemoryUsage& operator+=(const MemoryUsage& other)
+  {
+    Payload += other.Payload;
+    Overhead += other.Overhead;
+    return *this;
+  }
+
+  MemoryUsage operator+(const MemoryUsage& other) const
+  {
+    return MemoryUsage(Payload + other.Payload, Overhead + other.Overhead);
+  }
+};
+
+//
+// Bytes actually taken by an allocation of the given size: a glibc malloc
+// chunk (8-byte header, 16-byte granularity, 32 bytes at least), or for
+// pmr containers a piece of an arena, just aligned.
+//
+template<typename Alloc>
+struct AllocationSize
+{
+  static size_t of(size_t bytes)
+  {
+    if (bytes == 0)
+      return 0;
+
+    size_t chunk = (bytes + 8 + 15) & ~(size_t)15;
+    return (chunk < 32) ? 32 : chunk;
+  }
+};
+
+template<typename T>
+struct AllocationSize<pmr::polymorphic_allocator<T>>
+{
+  static size_t of(size_t bytes)
+  {
+    return (bytes + 7) & ~(size_t)7;
+  }
+};
+
+// libstdc++ node sizes, besides the element: tree nodes have color,
+// parent, left and right; list nodes prev and next; hash nodes next:
+const size_t TREE_NODE_LINKS = 32;
+const size_t LIST_NODE_LINKS = 16;
+const size_t HASH_NODE_LINKS = 8;
+
+//
+// Anything without pointers to more memory: its bytes are all payload
+//
+template<typename T>
+typename enable_if<is_trivially_copyable<T>::value, MemoryUsage>::type
+MemoryOf(const T&)
+{
+  return MemoryUsage(sizeof(T), 0);
+}
+
+// (declared ahead, so the containers of containers find each other)
+template<typename C, typename Tr, typename A>
+MemoryUsage MemoryOf(const basic_string<C, Tr, A>& s);
+template<typename A, typename B>
+typename enable_if<!is_trivially_copyable<pair<A, B>>::value, MemoryUsage>::type
+MemoryOf(const pair<A, B>& p);
+template<typename T, typename A>
+MemoryUsage MemoryOf(const vector<T, A>& v);
+template<typename T, typename A>
+MemoryUsage MemoryOf(const list<T, A>& l);
+template<typename K, typename V, typename C, typename A>
+MemoryUsage MemoryOf(const map<K, V, C, A>& m);
+template<typename K, typename C, typename A>
+MemoryUsage MemoryOf(const set<K, C, A>& s);
+template<typename K, typename V, typename H, typename E, typename A>
+MemoryUsage MemoryOf(const unordered_map<K, V, H, E, A>& m);
+
+// a node-based container's elements, each in a node of its own:
+template<typename Container>
+MemoryUsage NodesMemoryOf(const Container& c, size_t links)
+{
+  typedef typename Container::value_type value_type;
+  typedef typename allocator_traits<typename Container::allocator_type>::template rebind_alloc<char> alloc;
+
+  MemoryUsage usage(0, sizeof(Container));
+  size_t node = links + sizeof(value_type);
+  size_t perNode = AllocationSize<alloc>::of(node) - sizeof(value_type);
+
+  for (auto& element : c)
+    usage += MemoryOf(element);
+
+  usage.Overhead += c.size() * perNode;
+  return usage;
+}
+
+template<typename C, typename Tr, typename A>
+MemoryUsage MemoryOf(const basic_string<C, Tr, A>& s)
+{
+  size_t payload = s.size() * sizeof(C);
+  size_t total = sizeof(s);
+
+  // short strings are kept inside the object; longer ones on the heap:
+  const char* data = (const char*)s.data();
+  bool inside = data >= (const char*)&s && data < (const char*)(&s + 1);
+
+  if (!inside)
+    total += AllocationSize<A>::of((s.capacity() + 1) * sizeof(C));
+
+  return MemoryUsage(payload, total - payload);
+}
+
+template<typename A, typename B>
+typename enable_if<!is_trivially_copyable<pair<A, B>>::value, MemoryUsage>::type
+MemoryOf(const pair<A, B>& p)
+{
+  MemoryUsage usage = MemoryOf(p.first) + MemoryOf(p.second);
+  usage.Overhead += sizeof(p) - sizeof(A) - sizeof(B);   // padding
+  return usage;
+}
+
+template<typename T, typename A>
+MemoryUsage MemoryOf(const vector<T, A>& v)
+{
+  MemoryUsage usage(0, sizeof(v));
+
+  if (is_trivially_copyable<T>::value)
+    usage.Payload += v.size() * sizeof(T);
+  else
+  {
+    for (auto& element : v)
+      usage += MemoryOf(element);
+  }
+
+  size_t bytes = v.capacity() * sizeof(T);
+  usage.Overhead += AllocationSize<A>::of(bytes) - v.size() * sizeof(T);
+
+  return usage;
+}
+
+template<typename T, typename A>
+MemoryUsage MemoryOf(const list<T, A>& l)
+{
+  return NodesMemoryOf(l, LIST_NODE_LINKS);
+}
+
+template<typename K, typename V, typename C, typename A>
+MemoryUsage MemoryOf(const map<K, V, C, A>& m)
+{
+  return NodesMemoryOf(m, TREE_NODE_LINKS);
+}
+
+template<typename K, typename C, typename A>
+MemoryUsage MemoryOf(const set<K, C, A>& s)
+{
+  return NodesMemoryOf(s, TREE_NODE_LINKS);
+}
+
+template<typename K, typename V, typename H, typename E, typename A>
+MemoryUsage MemoryOf(const unordered_map<K, V, H, E, A>& m)
+{
+  // nodes keep the hash too, unless it is cheap to recompute:
+  size_t links = HASH_NODE_LINKS + (is_integral<K>::value ? 0 : sizeof(size_t));
+
+  MemoryUsage usage = NodesMemoryOf(m, links);
+  usage.Overhead += AllocationSize<A>::of(m.bucket_count() * sizeof(void*));
+  return usage;
+}
+
+
+//
+// The process: resident set size now, and at its largest so far (bytes)
+//
+size_t CurrentRSS();
+size_t PeakRSS();
+
+//
+// MemoryReport
+//
+// Structures (name, usage) and pipeline checkpoints (stage, RSS and peak
+// RSS when it was reached), printed as two tables in KB.
+//
+class MemoryReport
+{
+private:
+  vector<pair<string, MemoryUsage>> structures;
+  vector<pair<string, pair<size_t, size_t>>> checkpoints;
+
+public:
+  void add(const string& name, const MemoryUsage& usage);
+  void checkpoint(const string& stage);
+
+  void print(ostream& output) const;
+};
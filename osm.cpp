@@ -24,9 +24,11 @@
 #include <cstdlib>
 #include <cstring>
 #include <cassert>
+#include <algorithm>
 
 #include "tinyxml2.h"
 #include "osm.h"
+#include "trace.h"
 
 using namespace std;
 using namespace tinyxml2;
@@ -68,11 +70,68 @@ bool LoadOpenStreetMap(string filename, XMLDocument& xmldoc)
 
 
 
+//
+// XMLDocumentMemory
+//
+// Estimates the memory held by a parsed document.  tinyxml2 copies the
+// text it parses (textBytes, with the terminating 0) and points names
+// and values into it: that is the payload.  Elements, attributes and
+// text nodes come from pools, in blocks of 4 KB: that is overhead.
+//
+static size_t poolBytes(size_t items, size_t itemSize)
+{
+  size_t perBlock = 4 * 1024 / itemSize;
+  size_t blocks = (items + perBlock - 1) / perBlock;
+
+  return blocks * AllocationSize<allocator<char>>::of(perBlock * itemSize);
+}
+
+MemoryUsage XMLDocumentMemory(const XMLDocument& xmldoc, size_t textBytes)
+{
+  size_t elements = 0, attributes = 0, texts = 0, others = 0;
+  vector<const XMLNode*> pending;
+
+  for (const XMLNode* node = xmldoc.FirstChild(); node != nullptr; node = node->NextSibling())
+    pending.push_back(node);
+
+  while (!pending.empty())
+  {
+    const XMLNode* node = pending.back();
+    pending.pop_back();
+
+    if (const XMLElement* element = node->ToElement())
+    {
+      elements++;
+      for (const XMLAttribute* a = element->FirstAttribute(); a != nullptr; a = a->Next())
+        attributes++;
+    }
+    else if (node->ToText() != nullptr)
+      texts++;
+    else
+      others++;   // comments, declarations, ...: all from the comment pool
+
+    for (const XMLNode* child = node->FirstChild(); child != nullptr; child = child->NextSibling())
+      pending.push_back(child);
+  }
+
+  size_t text = AllocationSize<allocator<char>>::of(textBytes);
+
+  return MemoryUsage(textBytes,
+                     sizeof(XMLDocument) + (text - textBytes)
+                     + poolBytes(elements, sizeof(XMLElement))
+                     + poolBytes(attributes, sizeof(XMLAttribute))
+                     + poolBytes(texts, sizeof(XMLText))
+                     + poolBytes(others, sizeof(XMLComment)));
+}
+
+
 //
 // ReadMapNodes
 //
 int ReadMapNodes(XMLDocument& xmldoc, map<long long, Coordinates>& Nodes)
 {
+  TraceScope scope("read_nodes", "load");
+
   XMLElement* osm = xmldoc.FirstChildElement("osm");
   assert(osm != nullptr);
 
@@ -122,6 +181,8 @@ int ReadMapNodes(XMLDocument& xmldoc, map<long long, Coordinates>& Nodes)
 //
 int ReadFootways(XMLDocument& xmldoc, vector<FootwayInfo>& Footways)
 {
+  TraceScope scope("read_footways", "load");
+
   XMLElement* osm = xmldoc.FirstChildElement("osm");
   assert(osm != nullptr);
 
@@ -203,6 +264,31 @@ int ReadFootways(XMLDocument& xmldoc, vector<FootwayInfo>& Footways)
 }
 
 
+//
+// BuildingAbbrev
+//
+// Returns the abbreviation of a building given its full name, or "?"
+// if it has none.
+//
+string BuildingAbbrev(const string& fullname)
+{
+  //
+  // do we have an abbreviation?  Appears as "... (SEO)" in the string:
+  //
+  string abbrev = "?";
+
+  size_t left = fullname.find('(');
+  size_t right = fullname.find(')');
+
+  if (left != string::npos && right != string::npos && left < right)
+  {
+    abbrev = fullname.substr(left + 1, right - left - 1);
+  }
+
+  return abbrev;
+}
+
+
 //
 // ReadUniversityBuildings
 //
@@ -210,6 +296,8 @@ int ReadUniversityBuildings(XMLDocument& xmldoc,
   map<long long, Coordinates>& Nodes,
   vector<BuildingInfo>& Buildings)
 {
+  TraceScope scope("read_buildings", "load");
+
   XMLElement* osm = xmldoc.FirstChildElement("osm");
   assert(osm != nullptr);
 
@@ -244,7 +332,6 @@ int ReadUniversityBuildings(XMLDocument& xmldoc,
 
         if ((strcmp(k_value, "building") == 0) && (strcmp(v_value, "university") == 0))
         {
-          buildingCount++;
           isBuilding = true;
         }
 
@@ -273,23 +360,45 @@ int ReadUniversityBuildings(XMLDocument& xmldoc,
       double totalLat = 0.0;
       double totalLon = 0.0;
       int    numNodes = 0;
+      vector<long long> perimeter;
 
       while (nd != nullptr)
       {
         const XMLAttribute* ndref = nd->FindAttribute("ref");
-        assert(ndref != nullptr);
-
-        long long id = ndref->Int64Value();
-        assert(Nodes.find(id) != Nodes.end());
+        long long id = (ndref == nullptr) ? 0 : ndref->Int64Value();
+
+        //
+        // NOTE: lookup with find rather than [] so that Nodes is only read,
+        // and several threads may read buildings against it at once.  A
+        // ref to a node that isn't in the file (e.g. cut off by the
+        // extract) is skipped:
+        //
+        auto it = Nodes.find(id);
+        if (ndref == nullptr || it == Nodes.end())
+        {
+          nd = nd->NextSiblingElement("nd");
+          continue;
+        }
 
-        totalLat += Nodes[id].Lat;
-        totalLon += Nodes[id].Lon;
+        totalLat += it->second.Lat;
+        totalLon += it->second.Lon;
         numNodes++;
+        perimeter.push_back(id);
 
         // advance to next node ref:
         nd = nd->NextSiblingElement("nd");
       }//while
 
+      //
+      // a building without a name, or without a node to place it at,
+      // can't be looked up or routed to; leave it out:
+      //
+      if (numNodes == 0 || buildingName == nullptr)
+      {
+        way = way->NextSiblingElement("way");
+        continue;
+      }
+
       //
       // compute average to get a rough position of building, and store
       // building info into vector:
@@ -297,24 +406,13 @@ int ReadUniversityBuildings(XMLDocument& xmldoc,
       double lat = totalLat / numNodes;
       double lon = totalLon / numNodes;
 
-      assert(buildingName != nullptr);
-
       string  fullname(buildingName);
 
-      //
-      // do we have an abbreviation?  Appears as "... (SEO)" in the string:
-      //
-      string abbrev = "?";
-
-      size_t left = fullname.find('(');
-      size_t right = fullname.find(')');
-
-      if (left != string::npos && right != string::npos && left < right)
-      {
-        abbrev = fullname.substr(left + 1, right - left - 1);
-      }
+      string abbrev = BuildingAbbrev(fullname);
 
       Buildings.push_back(BuildingInfo(fullname, abbrev, id, lat, lon));
+      Buildings.back().Perimeter = perimeter;
+      buildingCount++;
     }//if
 
     way = way->NextSiblingElement("way");
@@ -325,3 +423,59 @@ int ReadUniversityBuildings(XMLDocument& xmldoc,
   //
   return buildingCount;
 }
+
+
+//
+// PruneMapNodes
+//
+// Most nodes in a map are not on a footway: they are building outlines,
+// streets, points of interest, ...  Keeps only the nodes that are on a
+// footway (the graph's vertices) or on the perimeter of a building (needed
+// for the building's position), and returns the # of nodes removed.
+//
+// A pass over the nodes once they are all read: the memory they take
+// while loading is the same, only what is kept afterwards shrinks.
+//
+int PruneMapNodes(map<long long, Coordinates>& Nodes,
+  vector<FootwayInfo>& Footways,
+  vector<BuildingInfo>& Buildings)
+{
+  //
+  // collect the referenced node ids, in sorted order:
+  //
+  vector<long long> keep;
+
+  for (auto& footway : Footways)
+    keep.insert(keep.end(), footway.Nodes.begin(), footway.Nodes.end());
+
+  for (auto& building : Buildings)
+    keep.insert(keep.end(), building.Perimeter.begin(), building.Perimeter.end());
+
+  sort(keep.begin(), keep.end());
+  keep.erase(unique(keep.begin(), keep.end()), keep.end());
+
+  //
+  // one merge-like pass over both sorted sequences, building the pruned
+  // map in order (so every insert is at the end):
+  //
+  map<long long, Coordinates> pruned;
+  auto k = keep.begin();
+
+  for (auto& node : Nodes)
+  {
+    while (k != keep.end() && *k < node.first)
+      ++k;
+
+    if (k == keep.end())
+      break;
+
+    if (*k == node.first)
+      pruned.insert(pruned.end(), node);
+  }
+
+  int removed = (int)(Nodes.size() - pruned.size());
+
+  Nodes.swap(pruned);
+
+  return removed;
+}
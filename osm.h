@@ -15,6 +15,7 @@
 #include <map>
 
 #include "tinyxml2.h"
+#include "memusage.h"
 
 using namespace std;
 using namespace tinyxml2;
@@ -74,18 +75,26 @@ struct FootwayInfo
   }
 };
 
+inline MemoryUsage MemoryOf(const FootwayInfo& footway)
+{
+  return MemoryOf(footway.ID) + MemoryOf(footway.Nodes);
+}
+
 
 //
 // BuildingInfo
 //
 // Defines a campus building with a fullname, an abbreviation (e.g. SEO),
-// and the coordinates of the building (id, lat, lon).
+// and the coordinates of the building (id, lat, lon).  The coordinates are
+// the average of the nodes on the building's perimeter, whose IDs are kept
+// in Perimeter.
 //
 struct BuildingInfo
 {
   string Fullname;
   string Abbrev;
   Coordinates Coords;
+  vector<long long> Perimeter;
 
   BuildingInfo()
   {
@@ -102,6 +111,12 @@ struct BuildingInfo
   }
 };
 
+inline MemoryUsage MemoryOf(const BuildingInfo& building)
+{
+  return MemoryOf(building.Fullname) + MemoryOf(building.Abbrev)
+       + MemoryOf(building.Coords) + MemoryOf(building.Perimeter);
+}
+
 
 //
 // Functions:
@@ -112,3 +127,35 @@ int  ReadFootways(XMLDocument& xmldoc, vector<FootwayInfo>& Footways);
 int  ReadUniversityBuildings(XMLDocument& xmldoc,
        map<long long, Coordinates>& Nodes,
        vector<BuildingInfo>& Buildings);
+string BuildingAbbrev(const string& fullname);
+int  PruneMapNodes(map<long long, Coordinates>& Nodes,
+       vector<FootwayInfo>& Footways,
+       vector<BuildingInfo>& Buildings);
+MemoryUsage XMLDocumentMemory(const XMLDocument& xmldoc, size_t textBytes);
+
+//
+// Parallel ingest (osmparallel.cpp): loads the map file and reads the
+// nodes, footways and buildings in one call, parsing chunks of the file
+// on numThreads worker threads (0 => one per core).  The results are the
+// same as LoadOpenStreetMap followed by the 3 Read functions above.  If
+// domMemory is given, it is set to the memory the chunks' XML documents
+// held, all together, at their largest.
+//
+bool LoadOpenStreetMapParallel(string filename,
+       map<long long, Coordinates>& Nodes,
+       vector<FootwayInfo>& Footways,
+       vector<BuildingInfo>& Buildings,
+       int& nodeCount, int& footwayCount, int& buildingCount,
+       int numThreads = 0, MemoryUsage* domMemory = nullptr);
+
+//
+// PBF input (osmpbf.cpp): reads a binary .osm.pbf map file into the same
+// structures, decoding the file's blocks on numThreads worker threads
+// (0 => one per core).
+//
+bool LoadOpenStreetMapPBF(string filename,
+       map<long long, Coordinates>& Nodes,
+       vector<FootwayInfo>& Footways,
+       vector<BuildingInfo>& Buildings,
+       int& nodeCount, int& footwayCount, int& buildingCount,
+       int numThreads = 0);
@@ -0,0 +1,277 @@
+/*osm2pbf.cpp*/
+
+//
+// Converts an open street map XML file (.osm) into the binary PBF
+// format (.osm.pbf) read by LoadOpenStreetMapPBF, e.g. to generate small
+// test fixtures locally:
+//
+//   g++ -std=c++17 -O2 -o osm2pbf osm2pbf.cpp tinyxml2.cpp -lz
+//   ./osm2pbf fixtures/campus.osm fixtures/campus.osm.pbf
+//
+// Nodes (with their tags) are written as DenseNodes and ways with their
+// tags and delta-coded node refs, 8000 per zlib-compressed block.
+// Relations are not written, since nothing reads them.
+//
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <cmath>
+#include <zlib.h>
+
+#include "tinyxml2.h"
+#include "pbf.h"
+
+using namespace std;
+using namespace tinyxml2;
+
+const size_t ENTITIES_PER_BLOCK = 8000;
+
+//
+// String table of one block; index 0 is always the empty string
+//
+class BlockStrings
+{
+private:
+  map<string, uint64_t> index;
+  vector<string> strings;
+
+public:
+  BlockStrings()
+  {
+    strings.push_back("");
+  }
+
+  uint64_t get(const string& s)
+  {
+    auto it = index.find(s);
+    if (it != index.end())
+      return it->second;
+
+    index[s] = strings.size();
+    strings.push_back(s);
+    return strings.size() - 1;
+  }
+
+  string encode() const
+  {
+    PBFWriter table;
+    for (auto& s : strings)
+      table.bytesField(1, s);
+    return table.Data;
+  }
+};
+
+//
+// Writes one blob: <4-byte length><BlobHeader><Blob>, zlib-compressed
+//
+static bool writeBlob(ostream& output, const string& type, const string& raw)
+{
+  uLongf zsize = compressBound((uLong)raw.size());
+  string zdata(zsize, '\0');
+
+  if (compress((Bytef*)&zdata[0], &zsize, (const Bytef*)raw.data(), (uLong)raw.size()) != Z_OK)
+    return false;
+  zdata.resize(zsize);
+
+  PBFWriter blob;
+  blob.varintField(2, raw.size());
+  blob.bytesField(3, zdata);
+
+  PBFWriter header;
+  header.bytesField(1, type);
+  header.varintField(3, blob.Data.size());
+
+  uint32_t len = (uint32_t)header.Data.size();
+  char prefix[4] = { (char)(len >> 24), (char)(len >> 16), (char)(len >> 8), (char)len };
+
+  output.write(prefix, 4);
+  output << header.Data << blob.Data;
+
+  return output.good();
+}
+
+//
+// Wraps a primitive group into a block with its string table, using the
+// default granularity (100 nanodegrees) and offsets (0)
+//
+static bool writeBlock(ostream& output, const BlockStrings& strings, const string& group)
+{
+  PBFWriter block;
+  block.bytesField(1, strings.encode());
+  block.bytesField(2, group);
+
+  return writeBlob(output, "OSMData", block.Data);
+}
+
+static long long toNanoUnits(double degrees)
+{
+  return llround(degrees * 1e7);  // units of granularity = 100 nanodegrees
+}
+
+static bool writeNodes(ostream& output, vector<XMLElement*>& nodes)
+{
+  BlockStrings strings;
+  vector<int64_t> ids, lats, lons;
+  vector<uint64_t> keysVals;
+
+  for (XMLElement* node : nodes)
+  {
+    ids.push_back(node->Int64Attribute("id"));
+    lats.push_back(toNanoUnits(node->DoubleAttribute("lat")));
+    lons.push_back(toNanoUnits(node->DoubleAttribute("lon")));
+
+    for (XMLElement* tag = node->FirstChildElement("tag"); tag != nullptr;
+         tag = tag->NextSiblingElement("tag"))
+    {
+      const char* k = tag->Attribute("k");
+      const char* v = tag->Attribute("v");
+
+      if (k != nullptr && v != nullptr)
+      {
+        keysVals.push_back(strings.get(k));
+        keysVals.push_back(strings.get(v));
+      }
+    }
+    keysVals.push_back(0);
+  }
+
+  PBFWriter dense;
+  dense.packedDeltas(1, ids);
+  dense.packedDeltas(8, lats);
+  dense.packedDeltas(9, lons);
+  dense.packedVarints(10, keysVals);
+
+  PBFWriter group;
+  group.bytesField(2, dense.Data);
+
+  return writeBlock(output, strings, group.Data);
+}
+
+static bool writeWays(ostream& output, vector<XMLElement*>& ways)
+{
+  BlockStrings strings;
+  PBFWriter group;
+
+  for (XMLElement* way : ways)
+  {
+    vector<uint64_t> keys, vals;
+    vector<int64_t> refs;
+
+    for (XMLElement* tag = way->FirstChildElement("tag"); tag != nullptr;
+         tag = tag->NextSiblingElement("tag"))
+    {
+      const char* k = tag->Attribute("k");
+      const char* v = tag->Attribute("v");
+
+      if (k != nullptr && v != nullptr)
+      {
+        keys.push_back(strings.get(k));
+        vals.push_back(strings.get(v));
+      }
+    }
+
+    for (XMLElement* nd = way->FirstChildElement("nd"); nd != nullptr;
+         nd = nd->NextSiblingElement("nd"))
+    {
+      refs.push_back(nd->Int64Attribute("ref"));
+    }
+
+    PBFWriter w;
+    w.varintField(1, (uint64_t)way->Int64Attribute("id"));
+    w.packedVarints(2, keys);
+    w.packedVarints(3, vals);
+    w.packedDeltas(8, refs);
+
+    group.bytesField(3, w.Data);
+  }
+
+  return writeBlock(output, strings, group.Data);
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc != 3)
+  {
+    cout << "usage: " << argv[0] << " input.osm output.osm.pbf" << endl;
+    return 1;
+  }
+
+  XMLDocument xmldoc;
+  xmldoc.LoadFile(argv[1]);
+
+  XMLElement* osm = xmldoc.FirstChildElement("osm");
+  if (xmldoc.ErrorID() != 0 || osm == nullptr)
+  {
+    cout << "**ERROR: unable to load open street map '" << argv[1] << "'." << endl;
+    return 1;
+  }
+
+  ofstream output(argv[2], ios::binary);
+  if (!output.good())
+  {
+    cout << "**ERROR: unable to create '" << argv[2] << "'." << endl;
+    return 1;
+  }
+
+  //
+  // header block:
+  //
+  PBFWriter header;
+  header.bytesField(4, "OsmSchema-V0.6");
+  header.bytesField(4, "DenseNodes");
+  header.bytesField(16, "osm2pbf");
+
+  bool ok = writeBlob(output, "OSMHeader", header.Data);
+
+  //
+  // nodes, then ways, in file order:
+  //
+  vector<XMLElement*> batch;
+  int numNodes = 0, numWays = 0;
+
+  for (XMLElement* node = osm->FirstChildElement("node"); ok && node != nullptr;
+       node = node->NextSiblingElement("node"))
+  {
+    batch.push_back(node);
+    numNodes++;
+
+    if (batch.size() == ENTITIES_PER_BLOCK)
+    {
+      ok = writeNodes(output, batch);
+      batch.clear();
+    }
+  }
+
+  if (ok && !batch.empty())
+    ok = writeNodes(output, batch);
+  batch.clear();
+
+  for (XMLElement* way = osm->FirstChildElement("way"); ok && way != nullptr;
+       way = way->NextSiblingElement("way"))
+  {
+    batch.push_back(way);
+    numWays++;
+
+    if (batch.size() == ENTITIES_PER_BLOCK)
+    {
+      ok = writeWays(output, batch);
+      batch.clear();
+    }
+  }
+
+  if (ok && !batch.empty())
+    ok = writeWays(output, batch);
+
+  if (!ok)
+  {
+    cout << "**ERROR: failed writing '" << argv[2] << "'." << endl;
+    return 1;
+  }
+
+  cout << numNodes << " nodes, " << numWays << " ways written to " << argv[2] << endl;
+
+  return 0;
+}
@@ -0,0 +1,401 @@
+/*osmchange.cpp*/
+
+//
+// OsmChange files: reading them, and applying them to a loaded map
+//
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <cstring>
+
+#include "tinyxml2.h"
+#include "osmchange.h"
+#include "trace.h"
+
+using namespace std;
+using namespace tinyxml2;
+
+
+//
+// Reads a <node> or <way> of a change into change; returns false if it
+// is missing an attribute.
+//
+static bool readElement(XMLElement* element, OsmAction action, OsmChange& change)
+{
+  const XMLAttribute* attrId = element->FindAttribute("id");
+  if (attrId == nullptr)
+    return false;
+
+  if (strcmp(element->Name(), "node") == 0)
+  {
+    OsmNodeChange node;
+    node.Action = action;
+    node.Node.ID = attrId->Int64Value();
+
+    const XMLAttribute* attrLat = element->FindAttribute("lat");
+    const XMLAttribute* attrLon = element->FindAttribute("lon");
+
+    if (action != OSM_DELETE)
+    {
+      if (attrLat == nullptr || attrLon == nullptr)
+        return false;
+
+      node.Node.Lat = attrLat->DoubleValue();
+      node.Node.Lon = attrLon->DoubleValue();
+    }
+
+    change.Nodes.push_back(node);
+  }
+  else if (strcmp(element->Name(), "way") == 0)
+  {
+    OsmWayChange way;
+    way.Action = action;
+    way.ID = attrId->Int64Value();
+    way.IsFootway = false;
+    way.IsBuilding = false;
+
+    for (XMLElement* nd = element->FirstChildElement("nd"); nd != nullptr; nd = nd->NextSiblingElement("nd"))
+    {
+      const XMLAttribute* ndref = nd->FindAttribute("ref");
+      if (ndref == nullptr)
+        return false;
+
+      way.Nodes.push_back(ndref->Int64Value());
+    }
+
+    // (the same tags as ReadFootways / ReadUniversityBuildings look for)
+    for (XMLElement* tag = element->FirstChildElement("tag"); tag != nullptr; tag = tag->NextSiblingElement("tag"))
+    {
+      const char* k = tag->Attribute("k");
+      const char* v = tag->Attribute("v");
+
+      if (k == nullptr || v == nullptr)
+        continue;
+
+      if (strcmp(k, "highway") == 0 && strcmp(v, "footway") == 0)
+        way.IsFootway = true;
+      if (strcmp(k, "building") == 0 && strcmp(v, "university") == 0)
+        way.IsBuilding = true;
+      if (strcmp(k, "name") == 0)
+        way.Name = v;
+    }
+
+    change.Ways.push_back(way);
+  }
+
+  // (relations don't matter for walking)
+  return true;
+}
+
+//
+// LoadOsmChange
+//
+bool LoadOsmChange(string filename, OsmChange& change, string& error)
+{
+  TraceScope scope("read_change", "update");
+
+  XMLDocument xmldoc;
+
+  if (xmldoc.LoadFile(filename.c_str()) != XML_SUCCESS)
+  {
+    error = "unable to read '" + filename + "'";
+    return false;
+  }
+
+  XMLElement* root = xmldoc.FirstChildElement("osmChange");
+  if (root == nullptr)
+  {
+    error = "'" + filename + "' is not an OsmChange file";
+    return false;
+  }
+
+  for (XMLElement* block = root->FirstChildElement(); block != nullptr; block = block->NextSiblingElement())
+  {
+    OsmAction action;
+
+    if (strcmp(block->Name(), "create") == 0)
+      action = OSM_CREATE;
+    else if (strcmp(block->Name(), "modify") == 0)
+      action = OSM_MODIFY;
+    else if (strcmp(block->Name(), "delete") == 0)
+      action = OSM_DELETE;
+    else
+      continue;
+
+    for (XMLElement* element = block->FirstChildElement(); element != nullptr; element = element->NextSiblingElement())
+    {
+      if (!readElement(element, action, change))
+      {
+        error = "malformed <" + string(element->Name()) + "> in '" + filename + "'";
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+
+//
+// The centroid of a building's perimeter, summed in order as when the
+// building was read
+//
+static void recenter(BuildingInfo& building, const map<long long, Coordinates>& Nodes)
+{
+  double totalLat = 0.0;
+  double totalLon = 0.0;
+
+  for (long long id : building.Perimeter)
+  {
+    auto it = Nodes.find(id);
+
+    totalLat += it->second.Lat;
+    totalLon += it->second.Lon;
+  }
+
+  building.Coords.Lat = totalLat / building.Perimeter.size();
+  building.Coords.Lon = totalLon / building.Perimeter.size();
+}
+
+//
+// ApplyOsmChange
+//
+bool ApplyOsmChange(const OsmChange& change,
+  map<long long, Coordinates>& Nodes,
+  vector<FootwayInfo>& Footways,
+  vector<BuildingInfo>& Buildings,
+  OsmChangeEffect& effect)
+{
+  TraceScope scope("apply_change", "update");
+
+  effect = OsmChangeEffect();
+
+  //
+  // Check the change first, against the map as it will be: the nodes
+  // created or modified, minus those deleted, and the last version of
+  // each way changed.
+  //
+  unordered_set<long long> setNodes, deletedNodes;
+
+  for (auto& node : change.Nodes)
+  {
+    if (node.Action == OSM_DELETE)
+      deletedNodes.insert(node.Node.ID);
+    else
+      setNodes.insert(node.Node.ID);
+  }
+
+  auto exists = [&](long long id) {
+    return (setNodes.count(id) > 0 || Nodes.count(id) > 0) && deletedNodes.count(id) == 0;
+  };
+
+  unordered_map<long long, const OsmWayChange*> lastChange;
+  for (auto& way : change.Ways)
+    lastChange[way.ID] = &way;
+
+  for (auto& way : change.Ways)
+  {
+    if (way.Action == OSM_DELETE || !(way.IsFootway || way.IsBuilding))
+      continue;
+
+    if (way.IsBuilding && (way.Nodes.empty() || way.Name.empty()))
+    {
+      effect.Error = "building way " + to_string(way.ID) + " has no nodes or no name";
+      return false;
+    }
+
+    for (long long id : way.Nodes)
+    {
+      if (!exists(id))
+      {
+        effect.Error = "node " + to_string(id) + " of way " + to_string(way.ID) + " is not in the map";
+        return false;
+      }
+    }
+  }
+
+  if (!deletedNodes.empty())
+  {
+    auto stillUsed = [&](long long wayId, const vector<long long>& nodes) {
+      if (lastChange.count(wayId) > 0)   // (checked above)
+        return false;
+
+      for (long long id : nodes)
+      {
+        if (deletedNodes.count(id) > 0)
+        {
+          effect.Error = "node " + to_string(id) + " is deleted, but way " + to_string(wayId) + " is still on it";
+          return true;
+        }
+      }
+
+      return false;
+    };
+
+    for (auto& footway : Footways)
+    {
+      if (stillUsed(footway.ID, footway.Nodes))
+        return false;
+    }
+
+    for (auto& building : Buildings)
+    {
+      if (stillUsed(building.Coords.ID, building.Perimeter))
+        return false;
+    }
+  }
+
+  //
+  // Nodes created or modified:
+  //
+  unordered_set<long long> moved;
+
+  for (auto& node : change.Nodes)
+  {
+    if (node.Action == OSM_DELETE)
+      continue;
+
+    auto it = Nodes.find(node.Node.ID);
+
+    if (it == Nodes.end())
+      Nodes[node.Node.ID] = node.Node;
+    else if (it->second.Lat != node.Node.Lat || it->second.Lon != node.Node.Lon)
+    {
+      it->second = node.Node;
+      moved.insert(node.Node.ID);
+    }
+  }
+
+  //
+  // Ways, in order: a way replaces the footway and / or building of the
+  // same ID, or is added, or removes them (deleted, or no longer tagged).
+  // Removals are compacted at the end, keeping the order of the rest:
+  //
+  unordered_map<long long, size_t> footwayAt, buildingAt;
+  vector<bool> footwayRemoved(Footways.size(), false);
+  vector<bool> buildingRemoved(Buildings.size(), false);
+  unordered_set<long long> recentered;    // building IDs
+
+  for (size_t i = 0; i < Footways.size(); ++i)
+    footwayAt[Footways[i].ID] = i;
+  for (size_t i = 0; i < Buildings.size(); ++i)
+    buildingAt[Buildings[i].Coords.ID] = i;
+
+  for (auto& way : change.Ways)
+  {
+    bool keep = (way.Action != OSM_DELETE);
+
+    auto f = footwayAt.find(way.ID);
+    bool isFootway = (f != footwayAt.end() && !footwayRemoved[f->second]);
+
+    if (isFootway && keep && way.IsFootway)
+      Footways[f->second].Nodes = way.Nodes;
+    else if (isFootway)
+      footwayRemoved[f->second] = true;
+    else if (keep && way.IsFootway)
+    {
+      footwayAt[way.ID] = Footways.size();
+      Footways.push_back(FootwayInfo(way.ID));
+      Footways.back().Nodes = way.Nodes;
+      footwayRemoved.push_back(false);
+    }
+
+    if (isFootway || (keep && way.IsFootway))
+      effect.FootwaysChanged = true;
+
+    auto b = buildingAt.find(way.ID);
+    bool isBuilding = (b != buildingAt.end() && !buildingRemoved[b->second]);
+
+    if (isBuilding && keep && way.IsBuilding)
+    {
+      BuildingInfo& building = Buildings[b->second];
+
+      if (building.Fullname != way.Name)
+      {
+        building.Fullname = way.Name;
+        building.Abbrev = BuildingAbbrev(way.Name);
+        effect.BuildingsRenamed = true;
+      }
+
+      building.Perimeter = way.Nodes;
+      recentered.insert(way.ID);
+    }
+    else if (isBuilding)
+    {
+      buildingRemoved[b->second] = true;
+      effect.BuildingsChanged = true;
+    }
+    else if (keep && way.IsBuilding)
+    {
+      buildingAt[way.ID] = Buildings.size();
+      Buildings.push_back(BuildingInfo(way.Name, BuildingAbbrev(way.Name), way.ID, 0.0, 0.0));
+      Buildings.back().Perimeter = way.Nodes;
+      buildingRemoved.push_back(false);
+      recentered.insert(way.ID);
+      effect.BuildingsChanged = true;
+    }
+  }
+
+  //
+  // Nodes deleted, last (nothing is on them anymore):
+  //
+  for (auto& node : change.Nodes)
+  {
+    if (node.Action == OSM_DELETE)
+    {
+      Nodes.erase(node.Node.ID);
+      moved.erase(node.Node.ID);
+    }
+  }
+
+  size_t kept = 0;
+  for (size_t i = 0; i < Footways.size(); ++i)
+  {
+    if (footwayRemoved[i])
+      continue;
+
+    if (kept != i)
+      Footways[kept] = move(Footways[i]);
+    kept++;
+  }
+  Footways.resize(kept);
+
+  kept = 0;
+  for (size_t i = 0; i < Buildings.size(); ++i)
+  {
+    if (buildingRemoved[i])
+      continue;
+
+    if (kept != i)
+      Buildings[kept] = move(Buildings[i]);
+    kept++;
+  }
+  Buildings.resize(kept);
+
+  //
+  // Centroids: of the buildings changed, and of those a moved node is on.
+  //
+  for (size_t i = 0; i < Buildings.size(); ++i)
+  {
+    BuildingInfo& building = Buildings[i];
+    bool affected = recentered.count(building.Coords.ID) > 0;
+
+    for (size_t p = 0; !affected && !moved.empty() && p < building.Perimeter.size(); ++p)
+      affected = moved.count(building.Perimeter[p]) > 0;
+
+    if (affected)
+    {
+      recenter(building, Nodes);
+      effect.Recentered.push_back((int)i);
+    }
+  }
+
+  effect.MovedNodes.assign(moved.begin(), moved.end());
+  sort(effect.MovedNodes.begin(), effect.MovedNodes.end());
+  return true;
+}
@@ -0,0 +1,115 @@
+/*osmchange.h*/
+
+//
+// OsmChange (.osc) files: edits to a map -- nodes and ways created,
+// modified or deleted -- as published by OpenStreetMap for keeping an
+// extract up to date (https://wiki.openstreetmap.org/wiki/OsmChange).
+//
+// Applying a change to the loaded Nodes, Footways and Buildings touches
+// only what it names: nodes are set or erased, footways and buildings
+// replaced, added or removed by ID, and the centroids recomputed only for
+// the buildings whose way changed or whose perimeter nodes moved.  What
+// the change did is returned in an OsmChangeEffect, so the structures
+// built from the map (see updateMap in main.cpp) can be updated just as
+// narrowly.
+//
+// Ways are classified as when loading: highway=footway is a footway,
+// building=university a building.  Ways are always given whole (all
+// their nodes and tags), so a modified way replaces the old one, and may
+// stop (or start) being a footway or building.  Relations are ignored.
+//
+// The nodes the ways refer to must be in Nodes or created by the change,
+// so Nodes must be the map's nodes as loaded, before PruneMapNodes.
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include "osm.h"
+
+using namespace std;
+
+enum OsmAction { OSM_CREATE, OSM_MODIFY, OSM_DELETE };
+
+struct OsmNodeChange
+{
+  OsmAction   Action;
+  Coordinates Node;     // (position not given for deletes)
+};
+
+struct OsmWayChange
+{
+  OsmAction         Action;
+  long long         ID;
+  vector<long long> Nodes;
+  bool              IsFootway;
+  bool              IsBuilding;
+  string            Name;
+};
+
+//
+// OsmChange
+//
+// The nodes and ways of a change, each in the order of the file.
+//
+struct OsmChange
+{
+  vector<OsmNodeChange> Nodes;
+  vector<OsmWayChange>  Ways;
+};
+
+//
+// OsmChangeEffect
+//
+// What applying a change did:
+//
+//   MovedNodes          nodes that existed and have a new position
+//   FootwaysChanged     footways created, modified or deleted
+//   BuildingsChanged    buildings created or deleted (the indices of
+//                       Buildings changed)
+//   BuildingsRenamed    a building's name changed
+//   Recentered          indices of the buildings whose centroid was
+//                       (re)computed, new ones included
+//
+struct OsmChangeEffect
+{
+  vector<long long> MovedNodes;
+  bool FootwaysChanged;
+  bool BuildingsChanged;
+  bool BuildingsRenamed;
+  vector<int> Recentered;
+  string Error;
+
+  OsmChangeEffect()
+  {
+    FootwaysChanged = false;
+    BuildingsChanged = false;
+    BuildingsRenamed = false;
+  }
+};
+
+//
+// Functions:
+//
+
+//
+// Reads an OsmChange file; returns false (with the reason in error) if it
+// can't be read or isn't one.
+//
+bool LoadOsmChange(string filename, OsmChange& change, string& error);
+
+//
+// Applies a change: node creates and modifies first, then the ways, then
+// node deletes, so a file is valid in any order.  Returns false, changing
+// nothing, if the change is inconsistent with the map -- a way on a node
+// that doesn't exist, or a node deleted while a footway or building is
+// still on it -- with the reason in effect.Error.
+//
+bool ApplyOsmChange(const OsmChange& change,
+       map<long long, Coordinates>& Nodes,
+       vector<FootwayInfo>& Footways,
+       vector<BuildingInfo>& Buildings,
+       OsmChangeEffect& effect);
@@ -0,0 +1,132 @@
+/*osmgen.cpp*/
+
+//
+// Generates a synthetic road network (see roadgen.h) and writes it as an
+// open street map XML file, to load like map.osm; e.g. a 1M junction map:
+//
+//   g++ -std=c++17 -O2 -o osmgen osmgen.cpp roadgen.cpp dist.cpp osm.cpp tinyxml2.cpp
+//   ./osmgen delaunay 1000000 big.osm --buildings-every 500
+//
+// Options:
+//   --seed S              random seed (default 1)
+//   --buildings-every B   one building per B junctions (default 100, 0 => none)
+//   --shape K             shape points per road (default 0)
+//   --keep F              delaunay: fraction of edges kept (default 0.8)
+//   --degree D            geometric: average degree (default 8; below about
+//                         4.5 the largest component, the only one kept, is
+//                         a fraction of the junctions)
+//
+// For grid, the size is the side of the grid; otherwise the number of
+// junctions.
+//
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <cstdlib>
+
+#include "roadgen.h"
+
+using namespace std;
+
+static void usage(const char* program)
+{
+  cout << "usage: " << program << " grid|delaunay|geometric size output.osm"
+       << " [--seed S] [--buildings-every B] [--shape K] [--keep F] [--degree D]" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc < 4)
+  {
+    usage(argv[0]);
+    return 1;
+  }
+
+  string kind = argv[1];
+  int size = atoi(argv[2]);
+  string filename = argv[3];
+
+  unsigned seed = 1;
+  int buildingEvery = 100;
+  int shapePoints = 0;
+  double keep = 0.8;
+  double degree = 8.0;
+
+  for (int i = 4; i < argc; i++)
+  {
+    string option = argv[i];
+
+    if (i + 1 >= argc)
+    {
+      usage(argv[0]);
+      return 1;
+    }
+
+    const char* value = argv[++i];
+
+    if (option == "--seed")
+      seed = (unsigned)strtoul(value, nullptr, 10);
+    else if (option == "--buildings-every")
+      buildingEvery = atoi(value);
+    else if (option == "--shape")
+      shapePoints = atoi(value);
+    else if (option == "--keep")
+      keep = atof(value);
+    else if (option == "--degree")
+      degree = atof(value);
+    else
+    {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (size < 1)
+  {
+    usage(argv[0]);
+    return 1;
+  }
+
+  auto start = chrono::steady_clock::now();
+
+  RoadNetwork net;
+  if (kind == "grid")
+    GeneratePerturbedGrid(size, seed, net);
+  else if (kind == "delaunay")
+    GenerateDelaunay(size, keep, seed, net);
+  else if (kind == "geometric")
+    GenerateGeometric(size, degree, seed, net);
+  else
+  {
+    usage(argv[0]);
+    return 1;
+  }
+
+  double generated = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+  map<long long, Coordinates> Nodes;
+  vector<FootwayInfo> Footways;
+  vector<BuildingInfo> Buildings;
+
+  RoadNetworkToMap(net, buildingEvery, shapePoints, Nodes, Footways, Buildings);
+
+  if (!WriteOpenStreetMap(filename, Nodes, Footways, Buildings))
+  {
+    cout << "**ERROR: unable to write '" << filename << "'." << endl;
+    return 1;
+  }
+
+  double total = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+  cout << net.Junctions.size() << " junctions, " << net.Roads.size() << " roads"
+       << " (average degree " << (net.Junctions.empty() ? 0.0 : 2.0 * net.Roads.size() / net.Junctions.size())
+       << "), generated in " << generated << " secs" << endl;
+  cout << Nodes.size() << " nodes, " << Footways.size() << " footways, "
+       << Buildings.size() << " buildings written to " << filename
+       << " in " << total << " secs" << endl;
+
+  return 0;
+}
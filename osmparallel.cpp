@@ -0,0 +1,301 @@
+/*osmparallel.cpp*/
+
+//
+// Parallel ingest of open street map XML files.
+//
+// Parsing a large .osm file into a single tinyxml2 DOM is single-threaded.
+// Instead, we read the raw file, split the contents of the top-level <osm>
+// element into chunks at <node>/<way>/<relation> element boundaries, and
+// parse each chunk as its own small document on a worker thread.  The
+// existing ReadMapNodes / ReadFootways / ReadUniversityBuildings functions
+// then run per chunk, and the results are merged in file order, so the
+// content is the same as reading the whole document at once.
+//
+// Buildings need the coordinates of their perimeter nodes, which may be
+// in any chunk, so they are read in a second parallel phase once all the
+// nodes have been merged.
+//
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <cstring>
+
+#include "tinyxml2.h"
+#include "osm.h"
+#include "trace.h"
+
+using namespace std;
+using namespace tinyxml2;
+
+
+//
+// Is there the start tag of a top-level OSM element at text[pos]?  In
+// OSM files, <node>, <way> and <relation> are never nested inside other
+// elements, and a '<' cannot appear inside attribute values, so any such
+// tag is a safe place to split.
+//
+static bool isElementStart(const string& text, size_t pos)
+{
+  static const char* names[] = { "node", "way", "relation" };
+
+  if (text[pos] != '<')
+    return false;
+
+  for (const char* name : names)
+  {
+    size_t len = strlen(name);
+
+    if (text.compare(pos + 1, len, name) == 0 && pos + 1 + len < text.size())
+    {
+      char next = text[pos + 1 + len];
+
+      if (next == ' ' || next == '\t' || next == '\r' || next == '\n' ||
+          next == '>' || next == '/')
+        return true;
+    }
+  }
+
+  return false;
+}
+
+//
+// Returns the position of the first element boundary at or after pos
+// (and before end), or end if there is none.
+//
+static size_t nextBoundary(const string& text, size_t pos, size_t end)
+{
+  while (pos < end)
+  {
+    pos = text.find('<', pos);
+
+    if (pos == string::npos || pos >= end)
+      return end;
+
+    if (isElementStart(text, pos))
+      return pos;
+
+    pos++;
+  }
+
+  return end;
+}
+
+
+//
+// Per-chunk state: the chunk's document and what was read from it
+//
+struct OSMChunk
+{
+  XMLDocument              xmldoc;
+  bool                     ok;
+  map<long long, Coordinates> Nodes;
+  vector<FootwayInfo>      Footways;
+  vector<BuildingInfo>     Buildings;
+  int                      nodeCount;
+  int                      footwayCount;
+  int                      buildingCount;
+  MemoryUsage              domMemory;
+
+  OSMChunk()
+  {
+    ok = false;
+    nodeCount = 0;
+    footwayCount = 0;
+    buildingCount = 0;
+  }
+};
+
+
+//
+// LoadOpenStreetMapParallel
+//
+bool LoadOpenStreetMapParallel(string filename,
+  map<long long, Coordinates>& Nodes,
+  vector<FootwayInfo>& Footways,
+  vector<BuildingInfo>& Buildings,
+  int& nodeCount, int& footwayCount, int& buildingCount,
+  int numThreads, MemoryUsage* domMemory)
+{
+  nodeCount = 0;
+  footwayCount = 0;
+  buildingCount = 0;
+
+  if (domMemory != nullptr)
+    *domMemory = MemoryUsage();
+
+  //
+  // read the raw file:
+  //
+  ifstream input(filename, ios::binary);
+
+  if (!input.good())
+  {
+    cout << "**ERROR: unable to open map file '" << filename << "'." << endl;
+    return false;
+  }
+
+  string text;
+  {
+    TraceScope scope("read_file", "load");
+
+    stringstream buffer;
+    buffer << input.rdbuf();
+    text = buffer.str();
+  }
+
+  //
+  // find the body of the top-level "osm" element:
+  //
+  size_t osmStart = text.find("<osm");
+  size_t bodyStart = (osmStart == string::npos) ? string::npos : text.find('>', osmStart);
+
+  if (bodyStart == string::npos)
+  {
+    cout << "**ERROR: unable to find top-level 'osm' XML element." << endl;
+    return false;
+  }
+
+  if (text[bodyStart - 1] == '/')  // <osm ... />, an empty map:
+    return true;
+
+  bodyStart++;
+
+  size_t bodyEnd = text.rfind("</osm>");
+
+  if (bodyEnd == string::npos || bodyEnd < bodyStart)
+  {
+    cout << "**ERROR: unable to open map file '" << filename << "'." << endl;
+    return false;
+  }
+
+  //
+  // split the body into roughly equal chunks at element boundaries:
+  //
+  if (numThreads <= 0)
+    numThreads = (int)thread::hardware_concurrency();
+  if (numThreads <= 0)
+    numThreads = 1;
+
+  vector<size_t> bounds;
+  bounds.push_back(bodyStart);
+
+  size_t chunkSize = (bodyEnd - bodyStart) / numThreads + 1;
+
+  for (int i = 1; i < numThreads; i++)
+  {
+    size_t pos = nextBoundary(text, bodyStart + i * chunkSize, bodyEnd);
+
+    if (pos > bounds.back() && pos < bodyEnd)
+      bounds.push_back(pos);
+  }
+
+  bounds.push_back(bodyEnd);
+
+  int numChunks = (int)bounds.size() - 1;
+  vector<OSMChunk> chunks(numChunks);
+
+  //
+  // phase 1: parse each chunk and read its nodes and footways:
+  //
+  vector<thread> workers;
+
+  for (int c = 0; c < numChunks; c++)
+  {
+    workers.push_back(thread([&, c]()
+    {
+      OSMChunk& chunk = chunks[c];
+
+      string xml = "<osm>";
+      xml.append(text, bounds[c], bounds[c + 1] - bounds[c]);
+      xml.append("</osm>");
+
+      {
+        TraceScope scope("parse_chunk", "load");
+        chunk.xmldoc.Parse(xml.c_str(), xml.size());
+      }
+
+      if (chunk.xmldoc.ErrorID() != 0)
+        return;
+
+      if (domMemory != nullptr)
+        chunk.domMemory = XMLDocumentMemory(chunk.xmldoc, xml.size() + 1);
+
+      chunk.nodeCount = ReadMapNodes(chunk.xmldoc, chunk.Nodes);
+      chunk.footwayCount = ReadFootways(chunk.xmldoc, chunk.Footways);
+      chunk.ok = true;
+    }));
+  }
+
+  for (auto& worker : workers)
+    worker.join();
+  workers.clear();
+
+  // the raw text is no longer needed:
+  string().swap(text);
+
+  for (auto& chunk : chunks)
+  {
+    if (!chunk.ok)
+    {
+      cout << "**ERROR: unable to open map file '" << filename << "'." << endl;
+      return false;
+    }
+  }
+
+  //
+  // merge in file order; a later node with the same id replaces an
+  // earlier one, just as in ReadMapNodes:
+  //
+  TraceScope mergeScope("merge_chunks", "load");
+
+  for (auto& chunk : chunks)
+  {
+    for (auto& node : chunk.Nodes)
+      Nodes.insert_or_assign(Nodes.end(), node.first, node.second);
+
+    map<long long, Coordinates>().swap(chunk.Nodes);
+
+    Footways.insert(Footways.end(), chunk.Footways.begin(), chunk.Footways.end());
+    vector<FootwayInfo>().swap(chunk.Footways);
+
+    nodeCount += chunk.nodeCount;
+    footwayCount += chunk.footwayCount;
+
+    if (domMemory != nullptr)
+      *domMemory += chunk.domMemory;
+  }
+
+  //
+  // phase 2: now that all the nodes are known, read the buildings (Nodes
+  // is only read from here on):
+  //
+  for (int c = 0; c < numChunks; c++)
+  {
+    workers.push_back(thread([&, c]()
+    {
+      OSMChunk& chunk = chunks[c];
+
+      chunk.buildingCount = ReadUniversityBuildings(chunk.xmldoc, Nodes, chunk.Buildings);
+      chunk.xmldoc.Clear();
+    }));
+  }
+
+  for (auto& worker : workers)
+    worker.join();
+
+  for (auto& chunk : chunks)
+  {
+    Buildings.insert(Buildings.end(), chunk.Buildings.begin(), chunk.Buildings.end());
+    buildingCount += chunk.buildingCount;
+  }
+
+  //
+  // success:
+  //
+  return true;
+}
@@ -0,0 +1,592 @@
+/*osmpbf.cpp*/
+
+//
+// Reads open street maps in the binary PBF format (.osm.pbf):
+//   https://wiki.openstreetmap.org/wiki/PBF_Format
+//
+// The file is a sequence of blobs, each preceded by a 4-byte big-endian
+// length and a BlobHeader.  The first blob is an OSMHeader block; the
+// rest are OSMData blocks, each a zlib-compressed PrimitiveBlock with its
+// own string table and groups of nodes (plain or "dense", delta-coded),
+// ways (with delta-coded node refs) and relations.
+//
+// Blobs are independent, so after framing the file sequentially the
+// blocks are decompressed and decoded on worker threads, then merged in
+// file order to give the same Nodes, Footways and Buildings as reading
+// the equivalent XML file.  Only zlib-compressed and raw blobs are
+// supported.
+//
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <atomic>
+#include <zlib.h>
+
+#include "osm.h"
+#include "pbf.h"
+#include "trace.h"
+
+using namespace std;
+
+
+//
+// A way that is a university building; its position is computed once all
+// the nodes are known
+//
+struct PBFBuilding
+{
+  long long         ID;
+  string            Name;
+  vector<long long> Refs;
+};
+
+//
+// What was decoded from one block
+//
+struct PBFBlock
+{
+  const unsigned char* data;   // the blob, within the file contents
+  size_t               size;
+  bool                 ok;
+
+  vector<Coordinates>  Nodes;
+  vector<FootwayInfo>  Footways;
+  vector<PBFBuilding>  Buildings;
+};
+
+
+//
+// Unpacks a Blob message into raw bytes; false if the compression
+// method isn't supported or the data is corrupt.
+//
+static bool unpackBlob(const unsigned char* data, size_t size, string& raw)
+{
+  PBFReader blob(data, size);
+  uint64_t rawSize = 0;
+  const unsigned char* zdata = nullptr;
+  size_t zsize = 0;
+  bool isRaw = false;
+
+  while (blob.next())
+  {
+    switch (blob.field())
+    {
+      case 1:  // raw
+        blob.bytes(zdata, zsize);
+        isRaw = true;
+        break;
+      case 2:  // raw_size
+        rawSize = blob.varint();
+        break;
+      case 3:  // zlib_data
+        blob.bytes(zdata, zsize);
+        break;
+      case 4:  // lzma_data
+      case 6:  // lz4_data
+      case 7:  // zstd_data
+        return false;
+      default:
+        blob.skip();
+    }
+  }
+
+  if (blob.Error || zdata == nullptr)
+    return false;
+
+  if (isRaw)
+  {
+    raw.assign((const char*)zdata, zsize);
+    return true;
+  }
+
+  // the spec limits uncompressed blocks to 32MB:
+  if (rawSize == 0 || rawSize > 32 * 1024 * 1024)
+    return false;
+
+  raw.resize(rawSize);
+  uLongf destLen = (uLongf)rawSize;
+
+  if (uncompress((Bytef*)&raw[0], &destLen, zdata, (uLong)zsize) != Z_OK || destLen != rawSize)
+    return false;
+
+  return true;
+}
+
+
+//
+// Per-block string table, plus the indices of the strings we look for
+// (-1 if the block doesn't contain them)
+//
+struct StringTable
+{
+  vector<string> s;
+  int highway, footway, building, university, name;
+
+  void lookup()
+  {
+    highway = footway = building = university = name = -1;
+
+    for (size_t i = 0; i < s.size(); i++)
+    {
+      if (s[i] == "highway")         highway = (int)i;
+      else if (s[i] == "footway")    footway = (int)i;
+      else if (s[i] == "building")   building = (int)i;
+      else if (s[i] == "university") university = (int)i;
+      else if (s[i] == "name")       name = (int)i;
+    }
+  }
+};
+
+
+//
+// Way: a footway (highway=footway) and / or university building
+// (building=university, with its name), like ReadFootways and
+// ReadUniversityBuildings.  Returns false if the way is malformed --
+// truncated, or with keys and values that don't pair up -- so the block
+// is rejected rather than read as a shorter way.
+//
+static bool decodeWay(PBFReader way, StringTable& strings, PBFBlock& block)
+{
+  long long id = 0;
+  vector<uint64_t> keys, vals;
+  vector<long long> refs;
+
+  while (way.next())
+  {
+    switch (way.field())
+    {
+      case 1:
+        id = (long long)way.varint();
+        break;
+      case 2:
+      {
+        PBFReader packed = way.message();
+        while (!packed.atEnd())
+          keys.push_back(packed.varint());
+        if (packed.Error)
+          return false;
+        break;
+      }
+      case 3:
+      {
+        PBFReader packed = way.message();
+        while (!packed.atEnd())
+          vals.push_back(packed.varint());
+        if (packed.Error)
+          return false;
+        break;
+      }
+      case 8:  // refs, delta coded
+      {
+        PBFReader packed = way.message();
+        long long ref = 0;
+        while (!packed.atEnd())
+        {
+          ref += packed.svarint();
+          refs.push_back(ref);
+        }
+        if (packed.Error)
+          return false;
+        break;
+      }
+      default:
+        way.skip();
+    }
+  }
+
+  if (way.Error || keys.size() != vals.size())
+    return false;
+
+  bool isFootway = false;
+  bool isBuilding = false;
+  const string* buildingName = nullptr;
+
+  for (size_t i = 0; i < keys.size(); i++)
+  {
+    if (keys[i] >= strings.s.size() || vals[i] >= strings.s.size())
+      continue;
+
+    int k = (int)keys[i];
+    int v = (int)vals[i];
+
+    if (k == strings.highway && v == strings.footway)
+      isFootway = true;
+    if (k == strings.building && v == strings.university)
+      isBuilding = true;
+    if (k == strings.name)
+      buildingName = &strings.s[v];
+  }
+
+  if (isFootway)
+  {
+    FootwayInfo footway(id);
+    footway.Nodes = refs;
+    block.Footways.push_back(footway);
+  }
+
+  // (a building without a name can't be looked up; left out, as by
+  // ReadUniversityBuildings)
+  if (isBuilding && buildingName != nullptr)
+  {
+    PBFBuilding b;
+    b.ID = id;
+    b.Name = *buildingName;
+    b.Refs = refs;
+    block.Buildings.push_back(b);
+  }
+
+  return true;
+}
+
+
+//
+// Decodes one OSMData blob.  Coordinates are (offset + granularity * value)
+// nanodegrees; dividing the exact integer by 1e9 gives the same double as
+// parsing the 7-decimal text of the XML file.
+//
+static bool decodeBlock(PBFBlock& block)
+{
+  TraceScope scope("decode_block", "load");
+
+  string raw;
+
+  if (!unpackBlob(block.data, block.size, raw))
+    return false;
+
+  PBFReader primitive((const unsigned char*)raw.data(), raw.size());
+  StringTable strings;
+  vector<PBFReader> groups;
+  long long granularity = 100, latOffset = 0, lonOffset = 0;
+
+  //
+  // the groups refer to fields that may come after them, so collect them
+  // first:
+  //
+  while (primitive.next())
+  {
+    switch (primitive.field())
+    {
+      case 1:  // stringtable
+      {
+        PBFReader table = primitive.message();
+        while (table.next())
+        {
+          if (table.field() == 1)
+            strings.s.push_back(table.bytes());
+          else
+            table.skip();
+        }
+        if (table.Error)
+          return false;
+        break;
+      }
+      case 2:
+        groups.push_back(primitive.message());
+        break;
+      case 17:
+        granularity = (long long)primitive.varint();
+        break;
+      case 19:
+        latOffset = (long long)primitive.varint();
+        break;
+      case 20:
+        lonOffset = (long long)primitive.varint();
+        break;
+      default:
+        primitive.skip();
+    }
+  }
+
+  if (primitive.Error)
+    return false;
+
+  strings.lookup();
+
+  for (auto& group : groups)
+  {
+    while (group.next())
+    {
+      switch (group.field())
+      {
+        case 1:  // node
+        {
+          PBFReader node = group.message();
+          long long id = 0, lat = 0, lon = 0;
+
+          while (node.next())
+          {
+            if (node.field() == 1)      id = node.svarint();
+            else if (node.field() == 8) lat = node.svarint();
+            else if (node.field() == 9) lon = node.svarint();
+            else node.skip();
+          }
+
+          if (node.Error)
+            return false;
+
+          block.Nodes.push_back(Coordinates(id,
+            (latOffset + granularity * lat) / 1e9,
+            (lonOffset + granularity * lon) / 1e9));
+          break;
+        }
+        case 2:  // dense nodes
+        {
+          PBFReader dense = group.message();
+          vector<long long> ids, lats, lons;
+
+          while (dense.next())
+          {
+            vector<long long>* column = nullptr;
+
+            if (dense.field() == 1)      column = &ids;
+            else if (dense.field() == 8) column = &lats;
+            else if (dense.field() == 9) column = &lons;
+            else
+            {
+              dense.skip();
+              continue;
+            }
+
+            PBFReader packed = dense.message();
+            long long value = 0;
+            while (!packed.atEnd())
+            {
+              value += packed.svarint();
+              column->push_back(value);
+            }
+            if (packed.Error)
+              return false;
+          }
+
+          if (dense.Error || ids.size() != lats.size() || ids.size() != lons.size())
+            return false;
+
+          for (size_t i = 0; i < ids.size(); i++)
+          {
+            block.Nodes.push_back(Coordinates(ids[i],
+              (latOffset + granularity * lats[i]) / 1e9,
+              (lonOffset + granularity * lons[i]) / 1e9));
+          }
+          break;
+        }
+        case 3:  // way
+          if (!decodeWay(group.message(), strings, block))
+            return false;
+          break;
+        default:  // relations, changesets
+          group.skip();
+      }
+    }
+
+    if (group.Error)
+      return false;
+  }
+
+  return true;
+}
+
+
+//
+// LoadOpenStreetMapPBF
+//
+bool LoadOpenStreetMapPBF(string filename,
+  map<long long, Coordinates>& Nodes,
+  vector<FootwayInfo>& Footways,
+  vector<BuildingInfo>& Buildings,
+  int& nodeCount, int& footwayCount, int& buildingCount,
+  int numThreads)
+{
+  nodeCount = 0;
+  footwayCount = 0;
+  buildingCount = 0;
+
+  ifstream input(filename, ios::binary);
+
+  if (!input.good())
+  {
+    cout << "**ERROR: unable to open map file '" << filename << "'." << endl;
+    return false;
+  }
+
+  stringstream buffer;
+  buffer << input.rdbuf();
+  string file = buffer.str();
+
+  //
+  // blob framing: <4-byte length><BlobHeader><Blob> ...
+  //
+  const unsigned char* data = (const unsigned char*)file.data();
+  size_t pos = 0;
+  bool sawHeader = false;
+  vector<PBFBlock> blocks;
+
+  while (pos < file.size())
+  {
+    if (file.size() - pos < 4)
+      break;
+
+    size_t headerSize = ((size_t)data[pos] << 24) | ((size_t)data[pos + 1] << 16) |
+                        ((size_t)data[pos + 2] << 8) | (size_t)data[pos + 3];
+    pos += 4;
+
+    if (headerSize > 64 * 1024 || headerSize > file.size() - pos)
+      break;
+
+    PBFReader header(data + pos, headerSize);
+    string type;
+    uint64_t blobSize = 0;
+
+    while (header.next())
+    {
+      if (header.field() == 1)      type = header.bytes();
+      else if (header.field() == 3) blobSize = header.varint();
+      else header.skip();
+    }
+
+    pos += headerSize;
+
+    if (header.Error || blobSize > file.size() - pos)
+      break;
+
+    if (type == "OSMHeader")
+    {
+      //
+      // make sure we can read everything the file requires:
+      //
+      string raw;
+      if (!unpackBlob(data + pos, (size_t)blobSize, raw))
+        break;
+
+      PBFReader headerBlock((const unsigned char*)raw.data(), raw.size());
+      while (headerBlock.next())
+      {
+        if (headerBlock.field() == 4)
+        {
+          string feature = headerBlock.bytes();
+
+          if (feature != "OsmSchema-V0.6" && feature != "DenseNodes")
+          {
+            cout << "**ERROR: map file '" << filename << "' requires unsupported feature '"
+                 << feature << "'." << endl;
+            return false;
+          }
+        }
+        else
+          headerBlock.skip();
+      }
+
+      sawHeader = true;
+    }
+    else if (type == "OSMData")
+    {
+      PBFBlock block;
+      block.data = data + pos;
+      block.size = (size_t)blobSize;
+      block.ok = false;
+      blocks.push_back(block);
+    }
+
+    pos += blobSize;
+  }
+
+  if (!sawHeader || pos != file.size())
+  {
+    cout << "**ERROR: '" << filename << "' is not a valid OSM PBF file." << endl;
+    return false;
+  }
+
+  //
+  // decode the blocks in parallel, each worker taking the next one:
+  //
+  if (numThreads <= 0)
+    numThreads = (int)thread::hardware_concurrency();
+  if (numThreads <= 0)
+    numThreads = 1;
+
+  atomic<size_t> nextBlock(0);
+  vector<thread> workers;
+
+  for (int t = 0; t < numThreads && t < (int)blocks.size(); t++)
+  {
+    workers.push_back(thread([&]()
+    {
+      size_t b;
+      while ((b = nextBlock++) < blocks.size())
+        blocks[b].ok = decodeBlock(blocks[b]);
+    }));
+  }
+
+  for (auto& worker : workers)
+    worker.join();
+
+  //
+  // merge in file order:
+  //
+  vector<PBFBuilding> buildings;
+
+  for (auto& block : blocks)
+  {
+    if (!block.ok)
+    {
+      cout << "**ERROR: '" << filename << "' is not a valid OSM PBF file." << endl;
+      return false;
+    }
+
+    for (auto& node : block.Nodes)
+      Nodes.insert_or_assign(Nodes.end(), node.ID, node);
+    nodeCount += (int)block.Nodes.size();
+
+    Footways.insert(Footways.end(), block.Footways.begin(), block.Footways.end());
+    footwayCount += (int)block.Footways.size();
+
+    buildings.insert(buildings.end(), block.Buildings.begin(), block.Buildings.end());
+
+    vector<Coordinates>().swap(block.Nodes);
+    vector<FootwayInfo>().swap(block.Footways);
+  }
+
+  //
+  // buildings: average of the perimeter nodes, as in ReadUniversityBuildings
+  // (refs to nodes not in the file are skipped, and a building with none
+  // left out):
+  //
+  for (auto& b : buildings)
+  {
+    double totalLat = 0.0;
+    double totalLon = 0.0;
+    int    numNodes = 0;
+    vector<long long> perimeter;
+
+    for (long long id : b.Refs)
+    {
+      auto it = Nodes.find(id);
+      if (it == Nodes.end())
+        continue;
+
+      totalLat += it->second.Lat;
+      totalLon += it->second.Lon;
+      numNodes++;
+      perimeter.push_back(id);
+    }
+
+    if (numNodes == 0)
+      continue;
+
+    double lat = totalLat / numNodes;
+    double lon = totalLon / numNodes;
+
+    Buildings.push_back(BuildingInfo(b.Name, BuildingAbbrev(b.Name), b.ID, lat, lon));
+    Buildings.back().Perimeter = perimeter;
+    buildingCount++;
+  }
+
+  //
+  // success:
+  //
+  return true;
+}
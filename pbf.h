@@ -0,0 +1,233 @@
+/*pbf.h*/
+
+//
+// Minimal protocol buffers wire-format reader / writer, just enough for
+// the OSM PBF format (https://wiki.openstreetmap.org/wiki/PBF_Format):
+// varints, zigzag-encoded signed varints, length-delimited fields and
+// packed repeated fields.  Fixed 32/64-bit fields are only skipped.
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+using namespace std;
+
+//
+// PBFReader
+//
+// Reads the fields of one message from a byte range.  Malformed input
+// never reads out of range; it sets Error and ends the message instead.
+//
+// Usage:
+//   PBFReader msg(data, size);
+//   while (msg.next()) {
+//     if (msg.field() == 1) x = msg.varint();
+//     else msg.skip();
+//   }
+//   if (msg.Error) ...
+//
+class PBFReader
+{
+private:
+  const unsigned char* p;
+  const unsigned char* end;
+  int fieldNum;
+  int wireType;
+
+public:
+  bool Error;
+
+  PBFReader()
+    : p(nullptr), end(nullptr), fieldNum(0), wireType(0), Error(false)
+  { }
+
+  PBFReader(const unsigned char* data, size_t size)
+    : p(data), end(data + size), fieldNum(0), wireType(0), Error(false)
+  { }
+
+  //
+  // Advances to the next field; returns false at the end of the message
+  // (or on error).
+  //
+  bool next()
+  {
+    if (Error || p >= end)
+      return false;
+
+    uint64_t key = varint();
+    fieldNum = (int)(key >> 3);
+    wireType = (int)(key & 7);
+
+    return !Error;
+  }
+
+  int field() const
+  {
+    return fieldNum;
+  }
+
+  bool atEnd() const
+  {
+    return Error || p >= end;
+  }
+
+  uint64_t varint()
+  {
+    uint64_t result = 0;
+
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+      if (p >= end)
+        break;
+
+      unsigned char byte = *p++;
+      result |= (uint64_t)(byte & 0x7F) << shift;
+
+      if ((byte & 0x80) == 0)
+        return result;
+    }
+
+    Error = true;
+    p = end;
+    return 0;
+  }
+
+  // zigzag-encoded (sint32 / sint64):
+  int64_t svarint()
+  {
+    uint64_t v = varint();
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+  }
+
+  //
+  // The current length-delimited field as a sub-message (also used for
+  // packed repeated fields, and for bytes / strings):
+  //
+  PBFReader message()
+  {
+    uint64_t len = varint();
+
+    if (Error || len > (uint64_t)(end - p))
+    {
+      Error = true;
+      p = end;
+      return PBFReader();
+    }
+
+    PBFReader sub(p, (size_t)len);
+    p += len;
+    return sub;
+  }
+
+  string bytes()
+  {
+    PBFReader sub = message();
+    return string((const char*)sub.p, sub.end - sub.p);
+  }
+
+  void bytes(const unsigned char*& data, size_t& size)
+  {
+    PBFReader sub = message();
+    data = sub.p;
+    size = sub.end - sub.p;
+  }
+
+  //
+  // Skips the current field's value:
+  //
+  void skip()
+  {
+    size_t n = 0;
+
+    switch (wireType)
+    {
+      case 0: varint(); return;
+      case 1: n = 8; break;
+      case 2: message(); return;
+      case 5: n = 4; break;
+      default: Error = true; p = end; return;
+    }
+
+    if (n > (size_t)(end - p))
+    {
+      Error = true;
+      p = end;
+      return;
+    }
+
+    p += n;
+  }
+};
+
+
+//
+// PBFWriter
+//
+// Appends fields to a message buffer.
+//
+class PBFWriter
+{
+public:
+  string Data;
+
+  void varint(uint64_t v)
+  {
+    while (v >= 0x80)
+    {
+      Data.push_back((char)((v & 0x7F) | 0x80));
+      v >>= 7;
+    }
+    Data.push_back((char)v);
+  }
+
+  void key(int field, int wireType)
+  {
+    varint(((uint64_t)field << 3) | wireType);
+  }
+
+  void varintField(int field, uint64_t v)
+  {
+    key(field, 0);
+    varint(v);
+  }
+
+  void svarintField(int field, int64_t v)
+  {
+    key(field, 0);
+    varint(((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+  }
+
+  void bytesField(int field, const string& bytes)
+  {
+    key(field, 2);
+    varint(bytes.size());
+    Data.append(bytes);
+  }
+
+  void packedVarints(int field, const vector<uint64_t>& values)
+  {
+    PBFWriter packed;
+    for (auto v : values)
+      packed.varint(v);
+    bytesField(field, packed.Data);
+  }
+
+  // zigzag-encoded, each value delta-coded against the previous:
+  void packedDeltas(int field, const vector<int64_t>& values)
+  {
+    PBFWriter packed;
+    int64_t prev = 0;
+
+    for (auto v : values)
+    {
+      int64_t delta = v - prev;
+      packed.varint(((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63));
+      prev = v;
+    }
+
+    bytesField(field, packed.Data);
+  }
+};
@@ -0,0 +1,84 @@
+/*psort.h*/
+
+//
+// Parallel stable sort: the range is split into one chunk per thread,
+// the chunks are sorted concurrently with stable_sort, and then merged
+// pairwise (again concurrently) with inplace_merge, which is also stable.
+// Elements that compare equal therefore keep their original order.
+//
+
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <algorithm>
+
+using namespace std;
+
+template<typename T, typename Compare>
+void parallelStableSort(vector<T>& v, Compare comp, int numThreads = 0)
+{
+  if (numThreads <= 0)
+    numThreads = (int)thread::hardware_concurrency();
+  if (numThreads <= 0)
+    numThreads = 1;
+
+  // not worth spawning threads for small inputs:
+  const size_t MIN_CHUNK = 1 << 14;
+
+  size_t n = v.size();
+  size_t chunks = min((size_t)numThreads, max((size_t)1, n / MIN_CHUNK));
+
+  if (chunks <= 1)
+  {
+    stable_sort(v.begin(), v.end(), comp);
+    return;
+  }
+
+  vector<size_t> bounds;
+  for (size_t c = 0; c <= chunks; c++)
+    bounds.push_back(n * c / chunks);
+
+  vector<thread> workers;
+  for (size_t c = 0; c < chunks; c++)
+  {
+    workers.push_back(thread([&, c]()
+    {
+      stable_sort(v.begin() + bounds[c], v.begin() + bounds[c + 1], comp);
+    }));
+  }
+
+  for (auto& worker : workers)
+    worker.join();
+
+  //
+  // merge neighboring runs until there is one left:
+  //
+  while (bounds.size() > 2)
+  {
+    vector<size_t> merged;
+    workers.clear();
+
+    for (size_t r = 0; r + 1 < bounds.size(); r += 2)
+    {
+      merged.push_back(bounds[r]);
+
+      if (r + 2 < bounds.size())
+      {
+        size_t first = bounds[r], middle = bounds[r + 1], last = bounds[r + 2];
+
+        workers.push_back(thread([&v, comp, first, middle, last]()
+        {
+          inplace_merge(v.begin() + first, v.begin() + middle, v.begin() + last, comp);
+        }));
+      }
+    }
+
+    merged.push_back(n);
+
+    for (auto& worker : workers)
+      worker.join();
+
+    bounds.swap(merged);
+  }
+}
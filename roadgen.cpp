@@ -0,0 +1,742 @@
+/*roadgen.cpp*/
+
+//
+// Synthetic road network generation, and OSM XML output
+//
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <random>
+#include <algorithm>
+#include <cmath>
+
+#include "roadgen.h"
+#include "dist.h"
+
+using namespace std;
+
+// origin and (average) junction spacing, in degrees:
+static const double ORIGIN_LAT = 41.86;
+static const double ORIGIN_LON = -87.66;
+static const double SPACING = 0.0003;
+
+//
+// Rounds to the 7 decimals OSM (and WriteOpenStreetMap) uses, so a map
+// read back from its XML is the very same map:
+//
+static double osmDegrees(double degrees)
+{
+  return llround(degrees * 1e7) / 1e7;
+}
+
+static void addJunction(RoadNetwork& net, double lat, double lon)
+{
+  long long id = (long long)net.Junctions.size() + 1;
+  net.Junctions.push_back(Coordinates(id, osmDegrees(lat), osmDegrees(lon)));
+}
+
+// junction a to junction b, by index:
+static void addRoad(RoadNetwork& net, size_t a, size_t b)
+{
+  const Coordinates& A = net.Junctions[a];
+  const Coordinates& B = net.Junctions[b];
+
+  net.Roads.push_back(make_tuple(A.ID, B.ID, distBetween2Points(A.Lat, A.Lon, B.Lat, B.Lon)));
+}
+
+//
+// GeneratePerturbedGrid
+//
+void GeneratePerturbedGrid(int side, unsigned seed, RoadNetwork& net)
+{
+  mt19937 rng(seed);
+  uniform_real_distribution<double> jitter(-SPACING / 4, SPACING / 4);
+  uniform_int_distribution<int> keep(0, 9);
+
+  net.Junctions.clear();
+  net.Roads.clear();
+
+  for (int r = 0; r < side; r++)
+  {
+    for (int c = 0; c < side; c++)
+    {
+      double lat = ORIGIN_LAT + r * SPACING + jitter(rng);
+      double lon = ORIGIN_LON + c * SPACING + jitter(rng);
+      addJunction(net, lat, lon);
+    }
+  }
+
+  for (int r = 0; r < side; r++)
+  {
+    for (int c = 0; c < side; c++)
+    {
+      size_t v = (size_t)r * side + c;
+
+      if (c + 1 < side && keep(rng) != 0)
+        addRoad(net, v, v + 1);
+      if (r + 1 < side && keep(rng) != 0)
+        addRoad(net, v, v + side);
+    }
+  }
+}
+
+//
+// Random junctions, uniform over a square holding numJunctions of them
+// at the average spacing:
+//
+static void randomJunctions(int numJunctions, mt19937& rng, RoadNetwork& net)
+{
+  double size = sqrt((double)numJunctions) * SPACING;
+  uniform_real_distribution<double> position(0.0, size);
+
+  net.Junctions.clear();
+  net.Roads.clear();
+
+  for (int i = 0; i < numJunctions; i++)
+  {
+    double lat = ORIGIN_LAT + position(rng);
+    double lon = ORIGIN_LON + position(rng);
+    addJunction(net, lat, lon);
+  }
+}
+
+//
+// Delaunay triangulation
+//
+// Incremental, with Lawson flips: each point is located by walking
+// from the last triangle created, the triangle containing it is split
+// in 3, and edges that fail the empty-circle test are flipped.  Points
+// are inserted in Hilbert curve order, so the walks are short, and the
+// whole thing is O(n log n) for the sort plus about O(n).  Starts from a
+// super-triangle around all the points; triangles touching it are
+// dropped at the end (which may lose a few edges on the convex hull).
+//
+struct Point
+{
+  double x, y;
+};
+
+struct Triangle
+{
+  int v[3];   // counter-clockwise
+  int n[3];   // n[i] is across the edge opposite v[i], -1 if none
+};
+
+static double orient(const Point& a, const Point& b, const Point& c)
+{
+  return (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+}
+
+// > 0 if d is inside the circle through the counter-clockwise a, b, c:
+static double incircle(const Point& a, const Point& b, const Point& c, const Point& d)
+{
+  double adx = a.x - d.x, ady = a.y - d.y;
+  double bdx = b.x - d.x, bdy = b.y - d.y;
+  double cdx = c.x - d.x, cdy = c.y - d.y;
+
+  double ad = adx * adx + ady * ady;
+  double bd = bdx * bdx + bdy * bdy;
+  double cd = cdx * cdx + cdy * cdy;
+
+  return adx * (bdy * cd - bd * cdy)
+       - ady * (bdx * cd - bd * cdx)
+       + ad * (bdx * cdy - bdy * cdx);
+}
+
+// position of (x, y) along a Hilbert curve over a 2^16 x 2^16 grid:
+static unsigned long long hilbertIndex(unsigned x, unsigned y)
+{
+  unsigned long long d = 0;
+
+  for (unsigned s = 1u << 15; s > 0; s >>= 1)
+  {
+    unsigned rx = (x & s) ? 1 : 0;
+    unsigned ry = (y & s) ? 1 : 0;
+    d += (unsigned long long)s * s * ((3 * rx) ^ ry);
+
+    if (ry == 0)
+    {
+      if (rx == 1)
+      {
+        x = s - 1 - x;
+        y = s - 1 - y;
+      }
+      swap(x, y);
+    }
+  }
+
+  return d;
+}
+
+// the neighbor of triangle t that pointed at old now points at replacement:
+static void relink(vector<Triangle>& tris, int t, int old, int replacement)
+{
+  if (t < 0)
+    return;
+
+  for (int i = 0; i < 3; i++)
+  {
+    if (tris[t].n[i] == old)
+    {
+      tris[t].n[i] = replacement;
+      return;
+    }
+  }
+}
+
+//
+// Returns the edges (a < b, indices into points) of the triangulation
+//
+static vector<pair<int, int>> delaunayEdges(const vector<Point>& input)
+{
+  int n = (int)input.size();
+  vector<Point> pts = input;
+
+  double minX = pts[0].x, maxX = pts[0].x, minY = pts[0].y, maxY = pts[0].y;
+  for (auto& p : pts)
+  {
+    minX = min(minX, p.x);  maxX = max(maxX, p.x);
+    minY = min(minY, p.y);  maxY = max(maxY, p.y);
+  }
+
+  double size = max(max(maxX - minX, maxY - minY), 1e-9);
+  double cx = (minX + maxX) / 2, cy = (minY + maxY) / 2;
+
+  // the super-triangle, points n, n+1, n+2:
+  pts.push_back(Point{ cx - 20 * size, cy - 10 * size });
+  pts.push_back(Point{ cx + 20 * size, cy - 10 * size });
+  pts.push_back(Point{ cx, cy + 20 * size });
+
+  vector<Triangle> tris;
+  tris.reserve(2 * (size_t)n + 1);
+  tris.push_back(Triangle{ { n, n + 1, n + 2 }, { -1, -1, -1 } });
+
+  // insertion order:
+  vector<pair<unsigned long long, int>> order;
+  for (int i = 0; i < n; i++)
+  {
+    unsigned x = (unsigned)((pts[i].x - minX) / size * 65535.0);
+    unsigned y = (unsigned)((pts[i].y - minY) / size * 65535.0);
+    order.push_back(make_pair(hilbertIndex(x, y), i));
+  }
+  sort(order.begin(), order.end());
+
+  int last = 0;
+  vector<int> stack;
+
+  for (auto& o : order)
+  {
+    int p = o.second;
+    const Point& P = pts[p];
+
+    //
+    // walk to the triangle containing P:
+    //
+    int t = last;
+    int steps = 0;
+    while (true)
+    {
+      const Triangle& T = tris[t];
+      int next = -1;
+
+      for (int k = 0; k < 3; k++)
+      {
+        int i = (k + steps) % 3;   // vary the first edge tried, so the walk can't cycle
+        if (T.n[i] >= 0 && orient(pts[T.v[(i + 1) % 3]], pts[T.v[(i + 2) % 3]], P) < 0)
+        {
+          next = T.n[i];
+          break;
+        }
+      }
+
+      if (next < 0)
+        break;
+
+      t = next;
+      steps++;
+    }
+
+    //
+    // (coordinates are rounded to 1e-7 degrees, so on a big map a point
+    // can land exactly on a vertex -- it is left out -- or on an edge)
+    //
+    Triangle old = tris[t];
+    int onEdge = -1, zeros = 0;
+
+    for (int i = 0; i < 3; i++)
+    {
+      if (orient(pts[old.v[(i + 1) % 3]], pts[old.v[(i + 2) % 3]], P) == 0)
+      {
+        onEdge = i;
+        zeros++;
+      }
+    }
+
+    if (zeros > 1)
+      continue;
+
+    //
+    // split it in 3 (or, on an edge, it and its neighbor in 2 each);
+    // each new triangle has P first, and its outer edge opposite P:
+    //
+    if (onEdge < 0)
+    {
+      int t0 = t;
+      int t1 = (int)tris.size();
+      int t2 = t1 + 1;
+      tris.resize(tris.size() + 2);
+
+      tris[t0] = Triangle{ { p, old.v[1], old.v[2] }, { old.n[0], t1, t2 } };
+      tris[t1] = Triangle{ { p, old.v[2], old.v[0] }, { old.n[1], t2, t0 } };
+      tris[t2] = Triangle{ { p, old.v[0], old.v[1] }, { old.n[2], t0, t1 } };
+
+      relink(tris, old.n[1], t, t1);
+      relink(tris, old.n[2], t, t2);
+
+      stack.push_back(t0);
+      stack.push_back(t1);
+      stack.push_back(t2);
+    }
+    else
+    {
+      // t = (c, a, b) with P on (a, b); o = (d, b, a) across it:
+      int i = onEdge;
+      int c = old.v[i], a = old.v[(i + 1) % 3], b = old.v[(i + 2) % 3];
+      int o = old.n[i];
+
+      int j = 0;
+      while (tris[o].n[j] != t)
+        j++;
+
+      Triangle other = tris[o];
+      int d = other.v[j];
+
+      int t1 = t, t3 = o;
+      int t2 = (int)tris.size();
+      int t4 = t2 + 1;
+      tris.resize(tris.size() + 2);
+
+      tris[t1] = Triangle{ { p, c, a }, { old.n[(i + 2) % 3], t4, t2 } };
+      tris[t2] = Triangle{ { p, b, c }, { old.n[(i + 1) % 3], t1, t3 } };
+      tris[t3] = Triangle{ { p, d, b }, { other.n[(j + 2) % 3], t2, t4 } };
+      tris[t4] = Triangle{ { p, a, d }, { other.n[(j + 1) % 3], t3, t1 } };
+
+      relink(tris, old.n[(i + 1) % 3], t, t2);
+      relink(tris, other.n[(j + 1) % 3], o, t4);
+
+      stack.push_back(t1);
+      stack.push_back(t2);
+      stack.push_back(t3);
+      stack.push_back(t4);
+    }
+
+    //
+    // flip the outer edges that aren't Delaunay:
+    //
+    while (!stack.empty())
+    {
+      int a = stack.back();
+      stack.pop_back();
+
+      int b = tris[a].n[0];
+      if (b < 0)
+        continue;
+
+      int j = 0;
+      while (tris[b].n[j] != a)
+        j++;
+
+      Triangle A = tris[a];
+      Triangle B = tris[b];
+      int d = B.v[j];
+
+      if (incircle(pts[A.v[0]], pts[A.v[1]], pts[A.v[2]], pts[d]) <= 0)
+        continue;
+
+      // A = (p, u, w), B = (d, w, u) => A = (p, u, d), B = (p, d, w):
+      int u = A.v[1], w = A.v[2];
+      int bud = B.n[(j + 1) % 3];   // across (u, d)
+      int bdw = B.n[(j + 2) % 3];   // across (d, w)
+
+      tris[a] = Triangle{ { p, u, d }, { bud, b, A.n[2] } };
+      tris[b] = Triangle{ { p, d, w }, { bdw, A.n[1], a } };
+
+      relink(tris, bud, b, a);
+      relink(tris, A.n[1], a, b);
+
+      stack.push_back(a);
+      stack.push_back(b);
+    }
+
+    last = t;
+  }
+
+  //
+  // the edges of the triangles not touching the super-triangle:
+  //
+  vector<pair<int, int>> edges;
+  for (auto& T : tris)
+  {
+    if (T.v[0] >= n || T.v[1] >= n || T.v[2] >= n)
+      continue;
+
+    for (int i = 0; i < 3; i++)
+    {
+      int a = T.v[(i + 1) % 3], b = T.v[(i + 2) % 3];
+      edges.push_back(make_pair(min(a, b), max(a, b)));
+    }
+  }
+
+  sort(edges.begin(), edges.end());
+  edges.erase(unique(edges.begin(), edges.end()), edges.end());
+
+  return edges;
+}
+
+//
+// GenerateDelaunay
+//
+// Keeps keepFraction of the triangulation's edges, at random; edges
+// more than 3 times the median length (slivers along the hull) are
+// always dropped.
+//
+void GenerateDelaunay(int numJunctions, double keepFraction, unsigned seed, RoadNetwork& net)
+{
+  mt19937 rng(seed);
+  randomJunctions(numJunctions, rng, net);
+
+  if (numJunctions < 3)
+    return;
+
+  vector<Point> pts;
+  for (auto& junction : net.Junctions)
+    pts.push_back(Point{ junction.Lon, junction.Lat });
+
+  vector<pair<int, int>> edges = delaunayEdges(pts);
+  if (edges.empty())
+    return;
+
+  vector<double> lengths;
+  for (auto& e : edges)
+    lengths.push_back(hypot(pts[e.first].x - pts[e.second].x, pts[e.first].y - pts[e.second].y));
+
+  vector<double> sorted = lengths;
+  nth_element(sorted.begin(), sorted.begin() + sorted.size() / 2, sorted.end());
+  double longest = 3 * sorted[sorted.size() / 2];
+
+  uniform_real_distribution<double> coin(0.0, 1.0);
+  for (size_t i = 0; i < edges.size(); i++)
+  {
+    if (coin(rng) < keepFraction && lengths[i] <= longest)
+      addRoad(net, edges[i].first, edges[i].second);
+  }
+}
+
+//
+// Keeps only the largest connected component of the network -- dropping
+// the junctions (and roads) cut off from it -- and renumbers the
+// junctions kept 1, 2, ... in their order.
+//
+static void keepLargestComponent(RoadNetwork& net)
+{
+  size_t n = net.Junctions.size();
+
+  // union-find over junction indices (ID - 1):
+  vector<size_t> parent(n);
+  for (size_t i = 0; i < n; i++)
+    parent[i] = i;
+
+  auto root = [&](size_t i) {
+    while (parent[i] != i)
+    {
+      parent[i] = parent[parent[i]];
+      i = parent[i];
+    }
+    return i;
+  };
+
+  for (auto& road : net.Roads)
+    parent[root((size_t)get<0>(road) - 1)] = root((size_t)get<1>(road) - 1);
+
+  vector<size_t> componentSize(n, 0);
+  size_t largest = 0;
+  for (size_t i = 0; i < n; i++)
+  {
+    size_t r = root(i);
+    if (++componentSize[r] > componentSize[largest])
+      largest = r;
+  }
+
+  vector<long long> newId(n, 0);
+  vector<Coordinates> junctions;
+  for (size_t i = 0; i < n; i++)
+  {
+    if (root(i) != largest)
+      continue;
+
+    newId[i] = (long long)junctions.size() + 1;
+    junctions.push_back(Coordinates(newId[i], net.Junctions[i].Lat, net.Junctions[i].Lon));
+  }
+
+  vector<tuple<long long, long long, double>> roads;
+  for (auto& road : net.Roads)
+  {
+    long long from = newId[get<0>(road) - 1];
+    if (from != 0)
+      roads.push_back(make_tuple(from, newId[get<1>(road) - 1], get<2>(road)));
+  }
+
+  net.Junctions.swap(junctions);
+  net.Roads.swap(roads);
+}
+
+//
+// GenerateGeometric
+//
+// Junctions are bucketed in a grid of cells the size of the radius, so
+// only neighboring cells need comparing.  Below an average degree of
+// about ln(numJunctions) a random geometric graph isn't connected, so
+// only its largest component is kept: fewer junctions than asked for,
+// but every building reachable from every other.
+//
+void GenerateGeometric(int numJunctions, double degree, unsigned seed, RoadNetwork& net)
+{
+  mt19937 rng(seed);
+  randomJunctions(numJunctions, rng, net);
+
+  if (numJunctions < 2)
+    return;
+
+  // numJunctions / size^2 junctions per square degree, so
+  // degree = density * pi * radius^2:
+  double size = sqrt((double)numJunctions) * SPACING;
+  double radius = sqrt(degree / (3.14159265358979 * numJunctions)) * size;
+  int cells = max(1, (int)(size / radius));
+
+  auto cellOf = [&](const Coordinates& c, int& cx, int& cy) {
+    cx = max(0, min(cells - 1, (int)((c.Lon - ORIGIN_LON) / size * cells)));
+    cy = max(0, min(cells - 1, (int)((c.Lat - ORIGIN_LAT) / size * cells)));
+  };
+
+  vector<vector<int>> bucket((size_t)cells * cells);
+  for (int i = 0; i < numJunctions; i++)
+  {
+    int cx, cy;
+    cellOf(net.Junctions[i], cx, cy);
+    bucket[(size_t)cy * cells + cx].push_back(i);
+  }
+
+  for (int i = 0; i < numJunctions; i++)
+  {
+    const Coordinates& a = net.Junctions[i];
+    int cx, cy;
+    cellOf(a, cx, cy);
+
+    for (int y = max(0, cy - 1); y <= min(cells - 1, cy + 1); y++)
+    {
+      for (int x = max(0, cx - 1); x <= min(cells - 1, cx + 1); x++)
+      {
+        for (int j : bucket[(size_t)y * cells + x])
+        {
+          const Coordinates& b = net.Junctions[j];
+          if (j > i && hypot(a.Lat - b.Lat, a.Lon - b.Lon) < radius)
+            addRoad(net, i, j);
+        }
+      }
+    }
+  }
+
+  keepLargestComponent(net);
+}
+
+//
+// RoadNetworkToMap
+//
+void RoadNetworkToMap(const RoadNetwork& net, int buildingEvery, int shapePoints,
+  map<long long, Coordinates>& Nodes,
+  vector<FootwayInfo>& Footways,
+  vector<BuildingInfo>& Buildings)
+{
+  long long nextNode = 1;
+  for (auto& junction : net.Junctions)
+  {
+    Nodes.emplace_hint(Nodes.end(), junction.ID, junction);
+    nextNode = max(nextNode, junction.ID + 1);
+  }
+
+  //
+  // the roads at each junction, to join them into footways:
+  //
+  map<long long, vector<size_t>> roadsAt;
+  for (size_t r = 0; r < net.Roads.size(); r++)
+  {
+    roadsAt[get<0>(net.Roads[r])].push_back(r);
+    roadsAt[get<1>(net.Roads[r])].push_back(r);
+  }
+
+  // appends the road's shape points and far end, going from 'from';
+  // returns the far end:
+  auto follow = [&](size_t r, long long from, vector<long long>& nodes) {
+    long long to = (get<0>(net.Roads[r]) == from) ? get<1>(net.Roads[r]) : get<0>(net.Roads[r]);
+    Coordinates A = Nodes[from];
+    Coordinates B = Nodes[to];
+
+    for (int s = 1; s <= shapePoints; s++)
+    {
+      double f = (double)s / (shapePoints + 1);
+      long long id = nextNode++;
+      Nodes[id] = Coordinates(id, osmDegrees(A.Lat + f * (B.Lat - A.Lat)),
+                              osmDegrees(A.Lon + f * (B.Lon - A.Lon)));
+      nodes.push_back(id);
+    }
+
+    nodes.push_back(to);
+    return to;
+  };
+
+  long long wayId = 1;
+  vector<bool> used(net.Roads.size(), false);
+
+  for (size_t r = 0; r < net.Roads.size(); r++)
+  {
+    if (used[r])
+      continue;
+
+    FootwayInfo footway(wayId++);
+    long long at = get<0>(net.Roads[r]);
+    footway.Nodes.push_back(at);
+
+    size_t road = r;
+    for (int length = 0; length < 5; length++)
+    {
+      used[road] = true;
+      at = follow(road, at, footway.Nodes);
+
+      // carry on along a road not used yet, if any:
+      bool more = false;
+      for (auto next : roadsAt[at])
+      {
+        if (!used[next])
+        {
+          road = next;
+          more = true;
+          break;
+        }
+      }
+
+      if (!more)
+        break;
+    }
+
+    Footways.push_back(footway);
+  }
+
+  //
+  // buildings: a closed square of 4 new nodes
+  //
+  if (buildingEvery < 1)
+    return;
+
+  for (size_t j = 0; j < net.Junctions.size(); j += buildingEvery)
+  {
+    double lat = net.Junctions[j].Lat + 0.2 * SPACING;
+    double lon = net.Junctions[j].Lon + 0.2 * SPACING;
+    double size = 0.3 * SPACING;
+
+    vector<long long> perimeter;
+    double corners[4][2] = { {0, 0}, {0, 1}, {1, 1}, {1, 0} };
+
+    for (auto& corner : corners)
+    {
+      long long id = nextNode++;
+      Nodes[id] = Coordinates(id, osmDegrees(lat + corner[0] * size),
+                              osmDegrees(lon + corner[1] * size));
+      perimeter.push_back(id);
+    }
+    perimeter.push_back(perimeter[0]);
+
+    //
+    // positioned like ReadUniversityBuildings does, at the average of
+    // the perimeter nodes (the first one twice, as the way is closed):
+    //
+    double totalLat = 0.0, totalLon = 0.0;
+    for (auto id : perimeter)
+    {
+      totalLat += Nodes[id].Lat;
+      totalLon += Nodes[id].Lon;
+    }
+
+    int n = (int)Buildings.size() + 1;
+    string fullname = "Synthetic Hall " + to_string(n) + " (SH" + to_string(n) + ")";
+
+    Buildings.push_back(BuildingInfo(fullname, BuildingAbbrev(fullname), wayId++,
+                                     totalLat / perimeter.size(), totalLon / perimeter.size()));
+    Buildings.back().Perimeter = perimeter;
+  }
+}
+
+//
+// GenerateGridMap
+//
+void GenerateGridMap(int side, int buildingEvery, unsigned seed,
+  map<long long, Coordinates>& Nodes,
+  vector<FootwayInfo>& Footways,
+  vector<BuildingInfo>& Buildings)
+{
+  RoadNetwork net;
+  GeneratePerturbedGrid(side, seed, net);
+  RoadNetworkToMap(net, buildingEvery, 0, Nodes, Footways, Buildings);
+}
+
+//
+// WriteOpenStreetMap
+//
+bool WriteOpenStreetMap(string filename,
+  map<long long, Coordinates>& Nodes,
+  vector<FootwayInfo>& Footways,
+  vector<BuildingInfo>& Buildings)
+{
+  ofstream output(filename);
+  if (!output.good())
+    return false;
+
+  output << fixed << setprecision(7);
+  output << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>" << '\n';
+  output << "<osm version=\"0.6\" generator=\"roadgen\">" << '\n';
+
+  for (auto& node : Nodes)
+  {
+    output << " <node id=\"" << node.first << "\" lat=\"" << node.second.Lat
+           << "\" lon=\"" << node.second.Lon << "\"/>" << '\n';
+  }
+
+  for (auto& footway : Footways)
+  {
+    output << " <way id=\"" << footway.ID << "\">" << '\n';
+    for (auto id : footway.Nodes)
+      output << "  <nd ref=\"" << id << "\"/>" << '\n';
+    output << "  <tag k=\"highway\" v=\"footway\"/>" << '\n';
+    output << " </way>" << '\n';
+  }
+
+  //
+  // buildings are ways too; their ID is the way's:
+  //
+  for (auto& building : Buildings)
+  {
+    output << " <way id=\"" << building.Coords.ID << "\">" << '\n';
+    for (auto id : building.Perimeter)
+      output << "  <nd ref=\"" << id << "\"/>" << '\n';
+    output << "  <tag k=\"building\" v=\"university\"/>" << '\n';
+    output << "  <tag k=\"name\" v=\"" << building.Fullname << "\"/>" << '\n';
+    output << " </way>" << '\n';
+  }
+
+  output << "</osm>" << '\n';
+
+  return output.good();
+}
@@ -0,0 +1,105 @@
+/*roadgen.h*/
+
+//
+// Synthetic road networks, for testing and benchmarking at scale.
+//
+// A generator lays out junctions (with coordinates, around the UIC
+// campus, spaced about 33 m apart on average) and the road segments
+// between them, as a RoadNetwork.  The network can then be used:
+//   - directly, as a graph (BuildRoadGraph), skipping the map stages;
+//   - as a map, in the structures the loaders fill in (RoadNetworkToMap):
+//     roads become footways, with optional shape points, and some
+//     junctions get a university building next to them;
+//   - as a map file, written out as OSM XML (WriteOpenStreetMap), to be
+//     read back like a real map.
+//
+// The generators, all deterministic for a given seed:
+//   GeneratePerturbedGrid   side x side grid, junctions moved randomly,
+//                           a tenth of the segments missing
+//   GenerateDelaunay        random junctions, joined by a random subset
+//                           of their Delaunay triangulation: planar, with
+//                           junctions of irregular degree
+//   GenerateGeometric       random junctions, joined whenever they are
+//                           closer than the radius giving the requested
+//                           average degree (not planar); only the
+//                           largest connected component is kept
+//
+// osmgen.cpp is the command line front end.
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <tuple>
+
+#include "osm.h"
+#include "graph.h"
+
+using namespace std;
+
+struct RoadNetwork
+{
+  vector<Coordinates> Junctions;                       // ID, lat, lon
+  vector<tuple<long long, long long, double>> Roads;   // (from, to, miles), each once
+};
+
+void GeneratePerturbedGrid(int side, unsigned seed, RoadNetwork& net);
+void GenerateDelaunay(int numJunctions, double keepFraction, unsigned seed, RoadNetwork& net);
+void GenerateGeometric(int numJunctions, double degree, unsigned seed, RoadNetwork& net);
+
+//
+// BuildRoadGraph
+//
+// The network as an undirected graph: junctions are the vertices, roads
+// the edges, weighted by their length in miles.
+//
+template<typename MemoryT>
+void BuildRoadGraph(const RoadNetwork& net, graph<long long, double, MemoryT>& G,
+                    int numThreads = 0)
+{
+  vector<long long> vertices;
+  vertices.reserve(net.Junctions.size());
+
+  for (auto& junction : net.Junctions)
+    vertices.push_back(junction.ID);
+
+  G.bulkBuildUndirected(vertices, net.Roads, numThreads);
+}
+
+//
+// RoadNetworkToMap
+//
+// The network as a map.  Roads are joined into footways of up to 5
+// roads each; shapePoints extra nodes are spaced evenly along each road
+// (these become shape points, as on real footways).  One junction in
+// buildingEvery (0 => none) gets a small square university building
+// ("Synthetic Hall <n> (SH<n>)") to the north-east of it.
+//
+void RoadNetworkToMap(const RoadNetwork& net, int buildingEvery, int shapePoints,
+       map<long long, Coordinates>& Nodes,
+       vector<FootwayInfo>& Footways,
+       vector<BuildingInfo>& Buildings);
+
+//
+// GenerateGridMap
+//
+// GeneratePerturbedGrid as a map, one building per buildingEvery
+// junctions.
+//
+void GenerateGridMap(int side, int buildingEvery, unsigned seed,
+       map<long long, Coordinates>& Nodes,
+       vector<FootwayInfo>& Footways,
+       vector<BuildingInfo>& Buildings);
+
+//
+// WriteOpenStreetMap
+//
+// Writes the map as OSM XML, in the form LoadOpenStreetMap and the Read
+// functions expect; returns false if the file can't be written.
+//
+bool WriteOpenStreetMap(string filename,
+       map<long long, Coordinates>& Nodes,
+       vector<FootwayInfo>& Footways,
+       vector<BuildingInfo>& Buildings);
@@ -0,0 +1,237 @@
+/*routetraits.h*/
+
+//
+// Compile-time policies for routing on a FlatGraph.
+//
+// A traits class fixes, for one instantiation of FlatGraph and of the
+// Dijkstra that runs on it:
+//   weight_type   how edge weights are stored
+//   accum_type    what distances are summed in
+//   index_type    dense vertex index, as stored in the edge array
+//   infinity()    the distance of vertices not reached (yet)
+//   heap_type     the priority queue of (distance, vertex) entries
+//   before        the order entries come out of it, i.e. tie-breaking
+// All of it is resolved when the algorithm is compiled: the relax loop
+// works on the narrow types directly, with nothing to decide at runtime.
+//
+
+#pragma once
+
+#include <vector>
+#include <limits>
+#include <cstdint>
+#include <type_traits>
+#include <algorithm>
+
+using namespace std;
+
+//
+// Tie-breaking policies, for entries with equal distances
+//
+
+// Smaller index (= smaller vertex ID) first; gives the same trees on a
+// FlatGraph as the map-based Dijkstra does with MapRoute:
+struct LowerIndexFirst
+{
+  template<typename Entry>
+  static bool before(const Entry& a, const Entry& b)
+  {
+    return a.dist < b.dist || (a.dist == b.dist && a.vertex < b.vertex);
+  }
+};
+
+// Any order (one comparison less per step); among equally short paths,
+// the one found may differ:
+struct AnyTie
+{
+  template<typename Entry>
+  static bool before(const Entry& a, const Entry& b)
+  {
+    return a.dist < b.dist;
+  }
+};
+
+
+//
+// Heap policies: min-heaps of Entry, in the order given by Before
+//
+
+// Binary heap on a vector, as priority_queue:
+template<typename Entry, typename Before>
+class BinaryHeap
+{
+private:
+  vector<Entry> entries;
+
+  // std's heap functions keep the *largest* element first:
+  static bool after(const Entry& a, const Entry& b)
+  {
+    return Before()(b, a);
+  }
+
+public:
+  bool empty() const
+  {
+    return entries.empty();
+  }
+
+  size_t size() const
+  {
+    return entries.size();
+  }
+
+  const Entry& top() const
+  {
+    return entries.front();
+  }
+
+  void push(const Entry& e)
+  {
+    entries.push_back(e);
+    push_heap(entries.begin(), entries.end(), after);
+  }
+
+  void pop()
+  {
+    pop_heap(entries.begin(), entries.end(), after);
+    entries.pop_back();
+  }
+};
+
+// 4-ary heap: half as deep as the binary heap, and the 4 children of a
+// node are next to each other in memory; pops compare more, pushes less.
+template<typename Entry, typename Before>
+class QuaternaryHeap
+{
+private:
+  vector<Entry> entries;
+
+public:
+  bool empty() const
+  {
+    return entries.empty();
+  }
+
+  size_t size() const
+  {
+    return entries.size();
+  }
+
+  const Entry& top() const
+  {
+    return entries.front();
+  }
+
+  void push(const Entry& e)
+  {
+    size_t i = entries.size();
+    entries.push_back(e);
+
+    // sift up:
+    while (i > 0) {
+      size_t parent = (i - 1) / 4;
+      if (!Before()(e, entries[parent]))
+        break;
+
+      entries[i] = entries[parent];
+      i = parent;
+    }
+
+    entries[i] = e;
+  }
+
+  void pop()
+  {
+    Entry last = entries.back();
+    entries.pop_back();
+
+    size_t n = entries.size();
+    if (n == 0)
+      return;
+
+    // sift the last entry down from the root:
+    size_t i = 0;
+    while (true) {
+      size_t first = 4 * i + 1;
+      if (first >= n)
+        break;
+
+      size_t best = first;
+      size_t end = min(first + 4, n);
+      for (size_t c = first + 1; c < end; ++c) {
+        if (Before()(entries[c], entries[best]))
+          best = c;
+      }
+
+      if (!Before()(entries[best], last))
+        break;
+
+      entries[i] = entries[best];
+      i = best;
+    }
+
+    entries[i] = last;
+  }
+};
+
+
+//
+// RouteTraits
+//
+// The default sums are double for floating-point weights, uint64_t for
+// fixed-point ones.
+//
+template<typename WeightT,
+         typename AccumT = typename conditional<is_integral<WeightT>::value, uint64_t, double>::type,
+         typename IndexT = uint32_t,
+         template<typename, typename> class HeapT = BinaryHeap,
+         typename TieT = LowerIndexFirst>
+struct RouteTraits
+{
+  typedef WeightT weight_type;
+  typedef AccumT  accum_type;
+  typedef IndexT  index_type;
+
+  static_assert(is_integral<WeightT>::value == is_integral<AccumT>::value,
+                "weights and sums must both be fixed point, or both floating point");
+
+  static constexpr accum_type infinity()
+  {
+    return numeric_limits<accum_type>::max();
+  }
+
+  struct entry
+  {
+    accum_type dist;
+    index_type vertex;
+
+    entry() { }
+    entry(accum_type d, index_type v) : dist(d), vertex(v) { }
+  };
+
+  struct before
+  {
+    bool operator()(const entry& a, const entry& b) const
+    {
+      return TieT::before(a, b);
+    }
+  };
+
+  typedef HeapT<entry, before> heap_type;
+};
+
+
+//
+// The instantiations we route with (see Dijkstra.cpp):
+//
+typedef RouteTraits<double>    DoubleRoute;    // same results as the map-based Dijkstra
+typedef RouteTraits<float>     FloatRoute;
+typedef RouteTraits<uint32_t>  FixedRoute;     // uint32 weights, uint64 sums
+typedef RouteTraits<uint16_t>  Fixed16Route;   // uint16 weights, uint64 sums
+
+// uint32 weights *and* sums, 4-ary heap, any tie: the narrowest hot loop
+typedef RouteTraits<uint32_t, uint32_t, uint32_t, QuaternaryHeap, AnyTie> Fixed32Route;
+
+// The map-based Dijkstra's queue: entries of vertex IDs rather than dense
+// indices (its distances are the graph's doubles, INF unreached)
+typedef RouteTraits<double, double, long long> MapRoute;
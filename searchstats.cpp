@@ -0,0 +1,218 @@
+/*searchstats.cpp*/
+
+//
+// Aggregation of search counters into histograms, and JSON output
+//
+
+#include <iostream>
+#include <algorithm>
+
+#include "searchstats.h"
+
+using namespace std;
+
+static const char* METRIC_NAMES[] = {
+  "settled", "relaxed", "improved", "pushes", "pops", "stale_pops", "max_heap",
+  "init_us", "loop_us", "finish_us", "total_us"
+};
+
+// the values of one search, in the order of METRIC_NAMES:
+static void metricValues(const SearchStats& stats, uint64_t values[])
+{
+  int m = 0;
+  values[m++] = stats.Settled;
+  values[m++] = stats.Relaxed;
+  values[m++] = stats.Improved;
+  values[m++] = stats.Pushes;
+  values[m++] = stats.Pops;
+  values[m++] = stats.StalePops;
+  values[m++] = stats.MaxHeap;
+
+  for (auto& nanos : stats.PhaseNanos)
+    values[m++] = nanos / 1000;
+
+  values[m++] = stats.totalNanos() / 1000;
+}
+
+static string jsonString(const string& s)
+{
+  string quoted = "\"";
+
+  for (char c : s)
+  {
+    if (c == '"' || c == '\\')
+      quoted += '\\';
+
+    if ((unsigned char)c < 0x20)
+      quoted += ' ';
+    else
+      quoted += c;
+  }
+
+  return quoted + "\"";
+}
+
+
+//
+// Log2Histogram
+//
+Log2Histogram::Log2Histogram()
+{
+  for (auto& b : buckets)
+    b = 0;
+
+  count = sum = maxValue = 0;
+  minValue = UINT64_MAX;
+}
+
+static int bucketOf(uint64_t value)
+{
+  int bits = 0;
+  while (value != 0)
+  {
+    bits++;
+    value >>= 1;
+  }
+  return bits;
+}
+
+static uint64_t bucketHigh(int b)
+{
+  return (b == 0) ? 0 : (b == 64) ? UINT64_MAX : (((uint64_t)1 << b) - 1);
+}
+
+void Log2Histogram::add(uint64_t value)
+{
+  buckets[bucketOf(value)]++;
+  count++;
+  sum += value;
+  minValue = min(minValue, value);
+  maxValue = max(maxValue, value);
+}
+
+void Log2Histogram::merge(const Log2Histogram& other)
+{
+  for (int b = 0; b < 65; b++)
+    buckets[b] += other.buckets[b];
+
+  count += other.count;
+  sum += other.sum;
+  minValue = min(minValue, other.minValue);
+  maxValue = max(maxValue, other.maxValue);
+}
+
+double Log2Histogram::mean() const
+{
+  return (count == 0) ? 0.0 : (double)sum / count;
+}
+
+uint64_t Log2Histogram::percentile(double p) const
+{
+  if (count == 0)
+    return 0;
+
+  // the rank-th smallest value, 1-based:
+  uint64_t rank = (uint64_t)(p / 100.0 * count + 0.5);
+  rank = max<uint64_t>(1, min(rank, count));
+
+  uint64_t seen = 0;
+  for (int b = 0; b < 65; b++)
+  {
+    seen += buckets[b];
+    if (seen >= rank)
+      return min(bucketHigh(b), maxValue);
+  }
+
+  return maxValue;
+}
+
+void Log2Histogram::writeJSON(ostream& output) const
+{
+  output << "{\"count\": " << count
+         << ", \"mean\": " << mean()
+         << ", \"min\": " << (count == 0 ? 0 : minValue)
+         << ", \"p50\": " << percentile(50)
+         << ", \"p90\": " << percentile(90)
+         << ", \"p99\": " << percentile(99)
+         << ", \"max\": " << maxValue
+         << ", \"buckets\": [";
+
+  bool first = true;
+  for (int b = 0; b < 65; b++)
+  {
+    if (buckets[b] == 0)
+      continue;
+
+    uint64_t low = (b == 0) ? 0 : ((uint64_t)1 << (b - 1));
+    output << (first ? "" : ", ") << "[" << low << ", " << bucketHigh(b) << ", " << buckets[b] << "]";
+    first = false;
+  }
+
+  output << "]}";
+}
+
+
+//
+// SearchHistograms
+//
+SearchHistograms::SearchHistograms(size_t keepSlowest)
+  : keepSlowest(keepSlowest)
+{
+}
+
+void SearchHistograms::add(const string& label, const SearchStats& stats)
+{
+  uint64_t values[NUM_METRICS];
+  metricValues(stats, values);
+
+  for (int m = 0; m < NUM_METRICS; m++)
+    metrics[m].add(values[m]);
+
+  //
+  // keep the slowest, in order:
+  //
+  auto slower = [](const pair<string, SearchStats>& a, const pair<string, SearchStats>& b) {
+    return a.second.totalNanos() > b.second.totalNanos();
+  };
+
+  pair<string, SearchStats> entry(label, stats);
+  auto pos = upper_bound(slowest.begin(), slowest.end(), entry, slower);
+
+  if ((size_t)(pos - slowest.begin()) < keepSlowest)
+  {
+    slowest.insert(pos, entry);
+    if (slowest.size() > keepSlowest)
+      slowest.pop_back();
+  }
+}
+
+void SearchHistograms::writeJSON(ostream& output) const
+{
+  output << "{" << endl;
+  output << "  \"searches\": " << numSearches() << "," << endl;
+  output << "  \"metrics\": {" << endl;
+
+  for (int m = 0; m < NUM_METRICS; m++)
+  {
+    output << "    \"" << METRIC_NAMES[m] << "\": ";
+    metrics[m].writeJSON(output);
+    output << (m + 1 < NUM_METRICS ? "," : "") << endl;
+  }
+
+  output << "  }," << endl;
+  output << "  \"slowest\": [" << endl;
+
+  for (size_t i = 0; i < slowest.size(); i++)
+  {
+    uint64_t values[NUM_METRICS];
+    metricValues(slowest[i].second, values);
+
+    output << "    {\"query\": " << jsonString(slowest[i].first);
+    for (int m = 0; m < NUM_METRICS; m++)
+      output << ", \"" << METRIC_NAMES[m] << "\": " << values[m];
+    output << "}" << (i + 1 < slowest.size() ? "," : "") << endl;
+  }
+
+  output << "  ]" << endl;
+  output << "}" << endl;
+}
@@ -0,0 +1,164 @@
+/*searchstats.h*/
+
+//
+// Per-query search counters, and their aggregation over many queries.
+//
+// The FlatGraph Dijkstra takes a stats policy, the way it takes its
+// RouteTraits, and reports each step of the search to it:
+//   settle()        a vertex is settled (popped with its final distance)
+//   relax()         an edge of a settled vertex is examined
+//   improve()       ... and gives its target a shorter distance
+//   push(size)      an entry is pushed, leaving size entries in the heap
+//   pop()           an entry is popped
+//   stale()         ... and skipped, as its vertex was already settled
+//                   (the checkVisited case of the map-based Dijkstra)
+//   begin(phase), end(phase)
+// With NoSearchStats these are all empty and inline, and the search
+// compiles to the same code as with no stats at all; with SearchStats
+// they count, and time the phases.
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+using namespace std;
+
+enum SearchPhase
+{
+  SEARCH_INIT,      // distance array, sources
+  SEARCH_LOOP,      // the main loop
+  SEARCH_FINISH,    // distances back to miles
+  NUM_SEARCH_PHASES
+};
+
+//
+// NoSearchStats: counts nothing
+//
+struct NoSearchStats
+{
+  void settle() { }
+  void relax() { }
+  void improve() { }
+  void push(size_t) { }
+  void pop() { }
+  void stale() { }
+  void begin(SearchPhase) { }
+  void end(SearchPhase) { }
+};
+
+//
+// SearchStats: the counters of one search (or, added up, of several)
+//
+struct SearchStats
+{
+  uint64_t Settled;
+  uint64_t Relaxed;
+  uint64_t Improved;
+  uint64_t Pushes;
+  uint64_t Pops;
+  uint64_t StalePops;
+  uint64_t MaxHeap;
+  uint64_t PhaseNanos[NUM_SEARCH_PHASES];
+
+  chrono::steady_clock::time_point phaseStart;
+
+  SearchStats()
+  {
+    Settled = Relaxed = Improved = Pushes = Pops = StalePops = MaxHeap = 0;
+    for (auto& nanos : PhaseNanos)
+      nanos = 0;
+  }
+
+  void settle() { Settled++; }
+  void relax() { Relaxed++; }
+  void improve() { Improved++; }
+  void pop() { Pops++; }
+  void stale() { StalePops++; }
+
+  void push(size_t heapSize)
+  {
+    Pushes++;
+    if (heapSize > MaxHeap)
+      MaxHeap = heapSize;
+  }
+
+  void begin(SearchPhase)
+  {
+    phaseStart = chrono::steady_clock::now();
+  }
+
+  void end(SearchPhase phase)
+  {
+    PhaseNanos[phase] += chrono::duration_cast<chrono::nanoseconds>(
+      chrono::steady_clock::now() - phaseStart).count();
+  }
+
+  uint64_t totalNanos() const
+  {
+    uint64_t total = 0;
+    for (auto& nanos : PhaseNanos)
+      total += nanos;
+    return total;
+  }
+};
+
+//
+// Log2Histogram
+//
+// Counts of values by power of 2: bucket b holds the values of b bits,
+// i.e. [2^(b-1), 2^b), and bucket 0 the zeros.  Percentiles are given as
+// the upper end of their bucket, so are at most 2x too high.
+//
+class Log2Histogram
+{
+private:
+  uint64_t buckets[65];
+  uint64_t count, sum, minValue, maxValue;
+
+public:
+  Log2Histogram();
+
+  void add(uint64_t value);
+  void merge(const Log2Histogram& other);
+
+  uint64_t numValues() const { return count; }
+  double mean() const;
+  uint64_t percentile(double p) const;
+
+  // {"count": .., "mean": .., "min": .., "p50": .., "p90": .., "p99": ..,
+  //  "max": .., "buckets": [[low, high, count], ...]}, non-empty buckets only
+  void writeJSON(ostream& output) const;
+};
+
+//
+// SearchHistograms
+//
+// Histograms of each counter (and of each phase's time, in microseconds)
+// over the searches added, plus the slowest few searches themselves with
+// a label saying what they were (e.g. the pair of buildings), so slow
+// queries can be picked out and explained.
+//
+class SearchHistograms
+{
+private:
+  static const int NUM_METRICS = 7 + NUM_SEARCH_PHASES + 1;
+
+  Log2Histogram metrics[NUM_METRICS];
+  size_t keepSlowest;
+  vector<pair<string, SearchStats>> slowest;   // slowest first
+
+public:
+  SearchHistograms(size_t keepSlowest = 10);
+
+  void add(const string& label, const SearchStats& stats);
+
+  size_t numSearches() const { return metrics[0].numValues(); }
+
+  // the whole thing as one JSON object
+  void writeJSON(ostream& output) const;
+};
@@ -0,0 +1,456 @@
+/*snap.cpp*/
+
+//
+// Building-to-footway snap table: computation and persistence
+//
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_set>
+#include <algorithm>
+#include <cmath>
+#include <sys/stat.h>
+
+#include "snap.h"
+#include "dist.h"
+#include "trace.h"
+
+using namespace std;
+
+//
+// Footway nodes in order of first appearance, as indices into Coords
+//
+static void collectFootwayNodes(vector<FootwayInfo>& Footways,
+                                const CoordStore& Coords,
+                                vector<int>& result)
+{
+    unordered_set<long long> seen;
+
+    for (auto& footWay : Footways) {
+        for (auto id : footWay.Nodes) {
+            if (!seen.insert(id).second)
+                continue;
+
+            int i = Coords.index(id);
+            if (i >= 0)
+                result.push_back(i);
+        }
+    }
+}
+
+//
+// Keep the k nearest candidates in Best (nearest first).  A candidate
+// only displaces a strictly farther one, so among equal distances the
+// node seen first wins -- the same tie-breaking the original per-query
+// scan used.
+//
+static void nearestOf(double lat, double lon, int k, const CoordStore& Coords,
+                      vector<int>& candidates, vector<AccessNode>& best)
+{
+    best.clear();
+
+    for (int c : candidates) {
+        double dist = distBetween2Points(lat, lon, Coords.lat(c), Coords.lon(c));
+
+        if (!(dist == dist))  // NaN, e.g. building exactly on the node
+            continue;
+
+        if ((int)best.size() == k && !(dist < best.back().Dist))
+            continue;
+
+        auto pos = upper_bound(best.begin(), best.end(), dist,
+            [](double d, const AccessNode& a) { return d < a.Dist; });
+        best.insert(pos, AccessNode(Coords.id(c), dist));
+
+        if ((int)best.size() > k)
+            best.pop_back();
+    }
+}
+
+//
+// NearestFootwayNodes
+//
+// Returns the k footway nodes nearest to (lat, lon), nearest first.
+//
+vector<AccessNode> NearestFootwayNodes(double lat, double lon, int k,
+       vector<FootwayInfo>& Footways, const CoordStore& Coords)
+{
+    vector<int> candidates;
+    vector<AccessNode> best;
+
+    collectFootwayNodes(Footways, Coords, candidates);
+    nearestOf(lat, lon, k, Coords, candidates, best);
+
+    return best;
+}
+
+//
+// NodeGrid
+//
+NodeGrid::NodeGrid()
+    : coords(nullptr), minLat(0), minLon(0), cellLat(1), cellLon(1),
+      milesLat(0), milesLon(0), rows(0), cols(0)
+{
+}
+
+void NodeGrid::cellOf(double lat, double lon, int& row, int& col) const
+{
+    row = (int)floor((lat - minLat) / cellLat);
+    col = (int)floor((lon - minLon) / cellLon);
+
+    row = max(0, min(row, rows - 1));
+    col = max(0, min(col, cols - 1));
+}
+
+void NodeGrid::build(ArrayView<long long> ids, const CoordStore& Coords)
+{
+    vector<int> indices;
+    for (auto id : ids) {
+        int i = Coords.index(id);
+        if (i >= 0)
+            indices.push_back(i);
+    }
+
+    build(indices, Coords);
+}
+
+void NodeGrid::build(const vector<int>& indices, const CoordStore& Coords)
+{
+    const double NODES_PER_CELL = 4.0;
+    const double MILES_PER_DEGREE = 3963.1 * 3.14159265 / 180.0;   // as in dist.cpp
+
+    coords = &Coords;
+    cellStart.clear();
+    nodes.clear();
+    ranks.clear();
+    rows = cols = 0;
+
+    if (indices.empty())
+        return;
+
+    double maxLat = Coords.lat(indices[0]), maxLon = Coords.lon(indices[0]);
+    minLat = maxLat;
+    minLon = maxLon;
+
+    for (int i : indices) {
+        minLat = min(minLat, Coords.lat(i));
+        maxLat = max(maxLat, Coords.lat(i));
+        minLon = min(minLon, Coords.lon(i));
+        maxLon = max(maxLon, Coords.lon(i));
+    }
+
+    // square-ish cells (in miles), sized for NODES_PER_CELL on average:
+    double widest = max(fabs(minLat), fabs(maxLat));
+    double lonScale = cos(widest * 3.14159265 / 180.0);
+    double height = max(maxLat - minLat, 1e-6);
+    double width = max(maxLon - minLon, 1e-6);
+    double cells = max(1.0, indices.size() / NODES_PER_CELL);
+    double side = sqrt(height * width * lonScale / cells);   // degrees of latitude
+
+    rows = max(1, min((int)ceil(height / side), 1 << 14));
+    cols = max(1, min((int)ceil(width * lonScale / side), 1 << 14));
+    cellLat = height / rows * (1 + 1e-9);
+    cellLon = width / cols * (1 + 1e-9);
+    milesLat = cellLat * MILES_PER_DEGREE * 0.99;
+    milesLon = cellLon * MILES_PER_DEGREE * lonScale * 0.99;
+
+    // counting sort of the nodes into their cells:
+    vector<int> cellOfNode(indices.size());
+    cellStart.assign((size_t)rows * cols + 1, 0);
+
+    for (size_t n = 0; n < indices.size(); ++n) {
+        int row, col;
+        cellOf(Coords.lat(indices[n]), Coords.lon(indices[n]), row, col);
+        cellOfNode[n] = row * cols + col;
+        cellStart[cellOfNode[n] + 1]++;
+    }
+
+    for (size_t c = 1; c < cellStart.size(); ++c)
+        cellStart[c] += cellStart[c - 1];
+
+    nodes.resize(indices.size());
+    ranks.resize(indices.size());
+    vector<int> fill(cellStart.begin(), cellStart.end() - 1);
+    for (size_t n = 0; n < indices.size(); ++n) {
+        ranks[fill[cellOfNode[n]]] = (int)n;
+        nodes[fill[cellOfNode[n]]++] = indices[n];
+    }
+}
+
+bool NodeGrid::nearest(double lat, double lon, AccessNode& result) const
+{
+    if (nodes.empty())
+        return false;
+
+    int row, col;
+    cellOf(lat, lon, row, col);
+
+    int best = -1;
+    double bestDist = 0.0;
+
+    for (int ring = 0; ring <= max(rows, cols); ++ring) {
+        // nodes in this ring and beyond are at least ring - 1 cells away:
+        if (best >= 0 && bestDist <= (ring - 1) * min(milesLat, milesLon))
+            break;
+
+        for (int r = row - ring; r <= row + ring; ++r) {
+            if (r < 0 || r >= rows)
+                continue;
+
+            // the whole row at the top and bottom, the two ends elsewhere:
+            int step = (r == row - ring || r == row + ring) ? 1 : 2 * ring;
+
+            for (int c = col - ring; c <= col + ring; c += max(step, 1)) {
+                if (c < 0 || c >= cols)
+                    continue;
+
+                int cell = r * cols + c;
+                for (int k = cellStart[cell]; k < cellStart[cell + 1]; ++k) {
+                    int i = nodes[k];
+                    double dist = distBetween2Points(lat, lon, coords->lat(i), coords->lon(i));
+
+                    if (!(dist == dist))  // NaN, exactly on the node
+                        dist = 0.0;
+
+                    if (best < 0 || dist < bestDist || (dist == bestDist && i < best)) {
+                        best = i;
+                        bestDist = dist;
+                    }
+                }
+            }
+        }
+    }
+
+    result = AccessNode(coords->id(best), bestDist);
+    return true;
+}
+
+void NodeGrid::nearest(double lat, double lon, int k, vector<AccessNode>& best) const
+{
+    best.clear();
+
+    if (nodes.empty() || k <= 0)
+        return;
+
+    int row, col;
+    cellOf(lat, lon, row, col);
+
+    vector<int> bestRanks;   // of the entries of best
+
+    // (before, in the order of best: nearer, or as near and given first)
+    auto before = [&](double dist, int rank, size_t b) {
+        return dist < best[b].Dist || (dist == best[b].Dist && rank < bestRanks[b]);
+    };
+
+    for (int ring = 0; ring <= max(rows, cols); ++ring) {
+        // nodes in this ring and beyond are at least ring - 1 cells away:
+        if ((int)best.size() == k && best.back().Dist < (ring - 1) * min(milesLat, milesLon))
+            break;
+
+        for (int r = row - ring; r <= row + ring; ++r) {
+            if (r < 0 || r >= rows)
+                continue;
+
+            // the whole row at the top and bottom, the two ends elsewhere:
+            int step = (r == row - ring || r == row + ring) ? 1 : 2 * ring;
+
+            for (int c = col - ring; c <= col + ring; c += max(step, 1)) {
+                if (c < 0 || c >= cols)
+                    continue;
+
+                int cell = r * cols + c;
+                for (int e = cellStart[cell]; e < cellStart[cell + 1]; ++e) {
+                    int i = nodes[e];
+                    double dist = distBetween2Points(lat, lon, coords->lat(i), coords->lon(i));
+
+                    if (!(dist == dist))  // NaN, as skipped by nearestOf
+                        continue;
+
+                    if ((int)best.size() == k && !before(dist, ranks[e], best.size() - 1))
+                        continue;
+
+                    size_t pos = 0;
+                    while (pos < best.size() && !before(dist, ranks[e], pos))
+                        ++pos;
+
+                    best.insert(best.begin() + pos, AccessNode(coords->id(i), dist));
+                    bestRanks.insert(bestRanks.begin() + pos, ranks[e]);
+
+                    if ((int)best.size() > k) {
+                        best.pop_back();
+                        bestRanks.pop_back();
+                    }
+                }
+            }
+        }
+    }
+}
+
+//
+// BuildSnapTable
+//
+// Computes the k nearest footway nodes of every building, through a
+// NodeGrid of the footway nodes: the same nodes as scanning them all in
+// order of first appearance, at a few cells per building.
+//
+void BuildSnapTable(vector<BuildingInfo>& Buildings, vector<FootwayInfo>& Footways,
+       const CoordStore& Coords, int k, SnapTable& table)
+{
+    TraceScope scope("snap", "load");
+
+    vector<int> candidates;
+    collectFootwayNodes(Footways, Coords, candidates);
+
+    NodeGrid grid;
+    grid.build(candidates, Coords);
+
+    table.K = k;
+    table.Access.assign(Buildings.size(), vector<AccessNode>());
+
+    for (size_t i = 0; i < Buildings.size(); ++i)
+        grid.nearest(Buildings[i].Coords.Lat, Buildings[i].Coords.Lon, k, table.Access[i]);
+}
+
+//
+// ResnapBuildings
+//
+// Recomputes the access nodes of the given buildings (indices into
+// Buildings), e.g. after some moved: the same as rebuilding the table,
+// for those buildings only.
+//
+void ResnapBuildings(vector<BuildingInfo>& Buildings, vector<FootwayInfo>& Footways,
+       const CoordStore& Coords, const vector<int>& which, SnapTable& table)
+{
+    TraceScope scope("resnap", "update");
+
+    if (which.empty())
+        return;
+
+    vector<int> candidates;
+    collectFootwayNodes(Footways, Coords, candidates);
+
+    NodeGrid grid;
+    grid.build(candidates, Coords);
+
+    for (int i : which)
+        grid.nearest(Buildings[i].Coords.Lat, Buildings[i].Coords.Lon, table.K, table.Access[i]);
+}
+
+//
+// Size and modification time of the map file; a snap table is only
+// valid for the exact map it was computed from.
+//
+static bool mapStamp(string mapFilename, long long& size, long long& mtime)
+{
+    struct stat st;
+
+    if (stat(mapFilename.c_str(), &st) != 0)
+        return false;
+
+    size = (long long)st.st_size;
+    mtime = (long long)st.st_mtime;
+    return true;
+}
+
+//
+// LoadSnapTable
+//
+// Loads a table previously written by SaveSnapTable.  Returns false if the
+// file doesn't exist or was computed for a different map, building list
+// or k, or names a node that isn't a footway node in Coords (a stale or
+// corrupt file), in which case the caller should rebuild it.
+//
+// Format (text):
+//   snap 1
+//   <map size> <map mtime> <k> <# of buildings>
+//   <building id> <n> <node id> <dist> ... (one line per building)
+//
+bool LoadSnapTable(string filename, string mapFilename,
+       vector<BuildingInfo>& Buildings, vector<FootwayInfo>& Footways,
+       const CoordStore& Coords, int k, SnapTable& table)
+{
+    TraceScope scope("load_snap_table", "load");
+
+    ifstream input(filename);
+    if (!input.good())
+        return false;
+
+    string magic;
+    int version;
+    long long size, mtime, curSize, curMtime;
+    int fileK;
+    size_t count;
+
+    input >> magic >> version >> size >> mtime >> fileK >> count;
+
+    if (!input || magic != "snap" || version != 1)
+        return false;
+    if (!mapStamp(mapFilename, curSize, curMtime) || size != curSize || mtime != curMtime)
+        return false;
+    if (fileK != k || count != Buildings.size())
+        return false;
+
+    vector<int> candidates;
+    collectFootwayNodes(Footways, Coords, candidates);
+
+    vector<bool> isFootwayNode(Coords.size(), false);
+    for (int c : candidates)
+        isFootwayNode[c] = true;
+
+    table.K = k;
+    table.Access.assign(count, vector<AccessNode>());
+
+    for (size_t i = 0; i < count; ++i) {
+        long long buildingId;
+        int n;
+
+        input >> buildingId >> n;
+        if (!input || buildingId != Buildings[i].Coords.ID || n < 0 || n > k)
+            return false;
+
+        for (int j = 0; j < n; ++j) {
+            AccessNode a;
+            input >> a.ID >> a.Dist;
+
+            int c = Coords.index(a.ID);
+            if (!input || c < 0 || !isFootwayNode[c] || !(a.Dist >= 0.0))
+                return false;
+
+            table.Access[i].push_back(a);
+        }
+    }
+
+    return !input.fail();
+}
+
+//
+// SaveSnapTable
+//
+bool SaveSnapTable(string filename, string mapFilename,
+       vector<BuildingInfo>& Buildings, SnapTable& table)
+{
+    long long size, mtime;
+    if (!mapStamp(mapFilename, size, mtime))
+        return false;
+
+    ofstream output(filename);
+    if (!output.good())
+        return false;
+
+    output << setprecision(17);
+    output << "snap 1" << '\n';
+    output << size << " " << mtime << " " << table.K << " " << Buildings.size() << '\n';
+
+    for (size_t i = 0; i < Buildings.size(); ++i) {
+        output << Buildings[i].Coords.ID << " " << table.Access[i].size();
+        for (auto& a : table.Access[i])
+            output << " " << a.ID << " " << a.Dist;
+        output << '\n';
+    }
+
+    return output.good();
+}
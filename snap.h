@@ -0,0 +1,143 @@
+/*snap.h*/
+
+//
+// Building-to-footway snap table.
+//
+// There is no direct path between buildings, so every query starts and
+// ends at footway nodes near the buildings.  Buildings don't move, so
+// rather than rescanning every footway per query we compute the k nearest
+// footway nodes ("access nodes") of every building once, and persist the
+// table next to the map file (<map>.snap) so later runs simply load it.
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include "osm.h"
+#include "coords.h"
+
+using namespace std;
+
+//
+// AccessNode
+//
+// A footway node near a building, and its distance (miles) from the
+// building's position.
+//
+struct AccessNode
+{
+  long long ID;
+  double    Dist;
+
+  AccessNode()
+  {
+    ID = 0;
+    Dist = 0.0;
+  }
+
+  AccessNode(long long id, double dist)
+  {
+    ID = id;
+    Dist = dist;
+  }
+};
+
+//
+// SnapTable
+//
+// Access[i] holds the access nodes of Buildings[i], nearest first.
+//
+struct SnapTable
+{
+  int K;
+  vector<vector<AccessNode>> Access;
+
+  SnapTable()
+  {
+    K = 0;
+  }
+
+  MemoryUsage memoryUsage() const
+  {
+    return MemoryOf(K) + MemoryOf(Access);
+  }
+};
+
+//
+// NodeGrid
+//
+// Nearest-node lookup over a fixed set of nodes (e.g. the vertices of the
+// routing graph, or the footway nodes buildings snap to): the nodes are
+// bucketed in a uniform lat / lon grid of a few nodes per cell, and a
+// lookup scans rings of cells around the position until no node beyond
+// the ring can be closer than the nearest one found.
+//
+class NodeGrid
+{
+private:
+  const CoordStore* coords;
+  double minLat, minLon;
+  double cellLat, cellLon;     // degrees
+  double milesLat, milesLon;   // least miles per cell, across the grid
+  int rows, cols;
+  vector<int> cellStart;       // cell -> its first entry in nodes
+  vector<int> nodes;           // indices into coords, cell by cell
+  vector<int> ranks;           // of each entry of nodes: its position in
+                               // the order the nodes were given
+
+  void cellOf(double lat, double lon, int& row, int& col) const;
+
+public:
+  NodeGrid();
+
+  //
+  // build
+  //
+  // (Re)builds the grid over the given nodes; nodes not in Coords are
+  // left out.  Coords must outlive the grid.
+  //
+  void build(ArrayView<long long> ids, const CoordStore& Coords);
+
+  // Same, from indices into Coords:
+  void build(const vector<int>& indices, const CoordStore& Coords);
+
+  //
+  // nearest
+  //
+  // The node nearest to (lat, lon), and its distance (miles); returns
+  // false if the grid has no nodes.
+  //
+  bool nearest(double lat, double lon, AccessNode& result) const;
+
+  //
+  // nearest
+  //
+  // The k nodes nearest to (lat, lon), nearest first, into best; among
+  // equal distances the node given first to build comes first.  The same
+  // as scanning all the nodes in that order (see BuildSnapTable).
+  //
+  void nearest(double lat, double lon, int k, vector<AccessNode>& best) const;
+
+  MemoryUsage memoryUsage() const
+  {
+    return MemoryOf(cellStart) + MemoryOf(nodes) + MemoryOf(ranks);
+  }
+};
+
+//
+// Functions:
+//
+vector<AccessNode> NearestFootwayNodes(double lat, double lon, int k,
+       vector<FootwayInfo>& Footways, const CoordStore& Coords);
+void BuildSnapTable(vector<BuildingInfo>& Buildings, vector<FootwayInfo>& Footways,
+       const CoordStore& Coords, int k, SnapTable& table);
+void ResnapBuildings(vector<BuildingInfo>& Buildings, vector<FootwayInfo>& Footways,
+       const CoordStore& Coords, const vector<int>& which, SnapTable& table);
+bool LoadSnapTable(string filename, string mapFilename,
+       vector<BuildingInfo>& Buildings, vector<FootwayInfo>& Footways,
+       const CoordStore& Coords, int k, SnapTable& table);
+bool SaveSnapTable(string filename, string mapFilename,
+       vector<BuildingInfo>& Buildings, SnapTable& table);
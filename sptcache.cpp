@@ -0,0 +1,149 @@
+/*sptcache.cpp*/
+
+//
+// Bounded LRU cache of shortest-path trees
+//
+
+#include <algorithm>
+
+#include "sptcache.h"
+#include "Dijkstra.h"
+
+using namespace std;
+
+SPTCache::SPTCache(ArrayView<long long> vertices, size_t capacity)
+    : vertices(vertices), capacity(capacity)
+{
+    if (this->capacity == 0)
+        this->capacity = 1;
+}
+
+//
+// indexOf
+//
+// Returns the dense index of vertex v, or -1 if v is not a vertex.
+//
+int SPTCache::indexOf(long long v) const
+{
+    auto it = lower_bound(vertices.begin(), vertices.end(), v);
+
+    if (it == vertices.end() || *it != v)
+        return -1;
+
+    return (int)(it - vertices.begin());
+}
+
+long long SPTCache::vertexAt(int index) const
+{
+    return vertices[index];
+}
+
+const ShortestPathTree* SPTCache::lookup(long long source)
+{
+    auto it = trees.find(source);
+    if (it == trees.end())
+        return nullptr;
+
+    // Move to the front of the LRU list:
+    lru.splice(lru.begin(), lru, it->second.second);
+
+    return &it->second.first;
+}
+
+//
+// Makes room for, and returns, an empty tree for source at the front of
+// the LRU list:
+//
+ShortestPathTree& SPTCache::newTree(long long source)
+{
+    auto existing = trees.find(source);
+    if (existing != trees.end()) {
+        lru.erase(existing->second.second);
+        trees.erase(existing);
+    }
+
+    // Evict the least recently used tree(s) if full:
+    while (trees.size() >= capacity) {
+        trees.erase(lru.back());
+        lru.pop_back();
+    }
+
+    lru.push_front(source);
+    auto& entry = trees[source];
+    entry.second = lru.begin();
+
+    ShortestPathTree& tree = entry.first;
+    tree.Source = source;
+
+    return tree;
+}
+
+const ShortestPathTree& SPTCache::insert(long long source,
+                                         unordered_map<long long, long long>& predecessors,
+                                         map<long long, double>& distances)
+{
+    ShortestPathTree& tree = newTree(source);
+    tree.Pred.assign(vertices.size(), -1);
+    tree.Dist.assign(vertices.size(), INF);
+
+    //
+    // distances is keyed by vertex in sorted order, the same order as
+    // the dense index, so a single pass fills the distance array:
+    //
+    size_t i = 0;
+    for (auto& d : distances) {
+        while (i < vertices.size() && vertices[i] < d.first)
+            ++i;
+        if (i == vertices.size())
+            break;
+        if (vertices[i] == d.first)
+            tree.Dist[i] = d.second;
+    }
+
+    for (auto& p : predecessors) {
+        int v = indexOf(p.first);
+        if (v < 0 || tree.Dist[v] == INF)   // stale entry from a previous search
+            continue;
+        tree.Pred[v] = (p.second == -1) ? -1 : indexOf(p.second);
+    }
+
+    return tree;
+}
+
+const ShortestPathTree& SPTCache::insert(long long source,
+                                         vector<int>& pred,
+                                         vector<double>& dist)
+{
+    ShortestPathTree& tree = newTree(source);
+
+    tree.Pred.swap(pred);
+    tree.Dist.swap(dist);
+
+    return tree;
+}
+
+bool SPTCache::getPath(const ShortestPathTree& tree, long long dest,
+                       vector<long long>& path, double& distance) const
+{
+    path.clear();
+
+    int v = indexOf(dest);
+    if (v < 0 || tree.Dist[v] == INF)
+        return false;
+
+    distance = tree.Dist[v];
+
+    // Walk the predecessors back to the source, then reverse:
+    int source = v;
+    while (v != -1) {
+        path.push_back(vertices[v]);
+        source = v;
+        v = tree.Pred[v];
+    }
+    reverse(path.begin(), path.end());
+
+    // Don't count the source's initial offset (multi-source searches):
+    distance -= tree.Dist[source];
+
+    return true;
+}
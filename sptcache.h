@@ -0,0 +1,115 @@
+/*sptcache.h*/
+
+//
+// Bounded cache of shortest-path trees, keyed by source.
+//
+// Dijkstra's algorithm computes the shortest path from the start vertex
+// to *every* other vertex, so once a tree has been computed, any later
+// query from the same source is answered by walking the predecessors
+// back from the destination.  Trees are stored compactly as flat arrays
+// indexed by a dense vertex index (position in the sorted vertex list),
+// and the least recently used tree is evicted when the cache is full.
+//
+
+#pragma once
+
+#include <vector>
+#include <list>
+#include <map>
+#include <unordered_map>
+
+#include "arrayview.h"
+#include "memusage.h"
+
+using namespace std;
+
+//
+// ShortestPathTree
+//
+// Pred[i] is the dense index of the predecessor of vertex i on the
+// shortest path from Source (-1 for the source and unreachable vertices),
+// Dist[i] is the distance from Source to vertex i (INF if unreachable).
+// Source is a cache key: a start vertex, or for multi-source searches
+// some other ID identifying the set of start vertices (e.g. a building).
+//
+struct ShortestPathTree
+{
+    long long      Source;
+    vector<int>    Pred;
+    vector<double> Dist;
+
+    ShortestPathTree()
+    {
+        Source = -1;
+    }
+};
+
+inline MemoryUsage MemoryOf(const ShortestPathTree& tree)
+{
+    return MemoryOf(tree.Source) + MemoryOf(tree.Pred) + MemoryOf(tree.Dist);
+}
+
+
+class SPTCache
+{
+private:
+    typedef list<long long>::iterator lruPos;
+
+    ArrayView<long long> vertices;  // sorted, dense index -> vertex ID
+    size_t capacity;
+    list<long long> lru;            // most recently used source at the front
+    unordered_map<long long, pair<ShortestPathTree, lruPos>> trees;
+
+    ShortestPathTree& newTree(long long source);
+
+public:
+    //
+    // vertices must be sorted -- a FlatGraph's are -- and outlive the
+    // cache: it is not copied, so any number of caches (one per thread)
+    // can share one array.
+    //
+    SPTCache(ArrayView<long long> vertices, size_t capacity);
+
+    //
+    // Returns the tree rooted at source, or nullptr if it is not cached.
+    //
+    const ShortestPathTree* lookup(long long source);
+
+    //
+    // Converts the output of Dijkstra() into a flat tree and caches it,
+    // evicting the least recently used tree if the cache is full.
+    //
+    const ShortestPathTree& insert(long long source,
+                                   unordered_map<long long, long long>& predecessors,
+                                   map<long long, double>& distances);
+
+    //
+    // Caches a tree already in flat form (e.g. from the FlatGraph
+    // Dijkstra, over the same vertices); pred and dist are swapped in,
+    // and come back empty.
+    //
+    const ShortestPathTree& insert(long long source,
+                                   vector<int>& pred,
+                                   vector<double>& dist);
+
+    //
+    // Walks the tree from dest back to the source, returning the vertex
+    // IDs on the path (source first) and the total distance along it.
+    // Returns false if dest is unreachable or not a vertex.
+    //
+    bool getPath(const ShortestPathTree& tree, long long dest,
+                 vector<long long>& path, double& distance) const;
+
+    int indexOf(long long v) const;
+    long long vertexAt(int index) const;
+
+    size_t size() const
+    {
+        return trees.size();
+    }
+
+    MemoryUsage memoryUsage() const
+    {
+        return MemoryOf(lru) + MemoryOf(trees);
+    }
+};
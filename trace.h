@@ -0,0 +1,244 @@
+/*trace.h*/
+
+//
+// Low-overhead tracing of the load and query phases.
+//
+// A TraceScope records one event -- name, category, start time and
+// duration -- from its construction to the end of its scope:
+//
+//   {
+//     TraceScope scope("snap", "load");
+//     ...
+//   }
+//
+// Events go into a ring buffer belonging to the thread recording them:
+// only that thread writes it, so recording takes no lock and allocates
+// nothing (the buffer is allocated, and registered under a mutex, on
+// the thread's first event).  When a buffer is full its oldest events
+// are overwritten.  Buffers outlive their threads, so the events of
+// worker threads are still there to export after they are joined.
+//
+// WriteChromeTrace exports the events of all threads as Chrome trace
+// event JSON, which chrome://tracing and https://ui.perfetto.dev open.
+//
+// Tracing is off until TraceEnable(true); until then a TraceScope is one
+// relaxed atomic load and a branch, so it can stay in production builds.
+//
+// Names and categories must be string literals: only the pointers are
+// kept.
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+#include <cstdint>
+
+using namespace std;
+
+struct TraceEvent
+{
+  const char* Name;
+  const char* Category;
+  uint64_t    StartNanos;      // steady clock
+  uint64_t    DurationNanos;
+};
+
+//
+// TraceBuffer
+//
+// Single-writer ring: the owning thread stores an event, then publishes
+// it by advancing head (release); readers take head (acquire) and copy
+// the events behind it.
+//
+class TraceBuffer
+{
+public:
+  static const uint64_t CAPACITY = 1 << 14;   // events, a power of 2
+
+  uint32_t ThreadID;
+
+private:
+  vector<TraceEvent> events;
+  atomic<uint64_t> head;                      // # of events ever recorded
+
+public:
+  TraceBuffer(uint32_t threadID)
+    : ThreadID(threadID), events(CAPACITY), head(0)
+  {
+  }
+
+  void record(const TraceEvent& event)
+  {
+    uint64_t h = head.load(memory_order_relaxed);
+    events[h & (CAPACITY - 1)] = event;
+    head.store(h + 1, memory_order_release);
+  }
+
+  //
+  // Copies out the events still in the buffer, oldest first; returns
+  // how many were overwritten before they could be.  If the owner is
+  // recording meanwhile, events it may have overwritten during the copy
+  // are left out.
+  //
+  uint64_t snapshot(vector<TraceEvent>& out) const
+  {
+    uint64_t end = head.load(memory_order_acquire);
+    uint64_t begin = (end > CAPACITY) ? end - CAPACITY : 0;
+
+    vector<TraceEvent> copy;
+    for (uint64_t i = begin; i < end; i++)
+      copy.push_back(events[i & (CAPACITY - 1)]);
+
+    // slots the writer has moved on to (or is writing) since:
+    uint64_t now = head.load(memory_order_acquire);
+    uint64_t valid = (now + 1 > CAPACITY) ? now + 1 - CAPACITY : 0;
+
+    for (uint64_t i = max(begin, valid); i < end; i++)
+      out.push_back(copy[i - begin]);
+
+    return max(begin, valid);
+  }
+};
+
+//
+// The process-wide state: on / off, and every thread's buffer
+//
+inline atomic<bool> traceEnabled(false);
+inline mutex traceLock;
+inline vector<unique_ptr<TraceBuffer>> traceBuffers;
+inline thread_local TraceBuffer* threadTraceBuffer = nullptr;
+
+inline bool TraceEnabled()
+{
+  return traceEnabled.load(memory_order_relaxed);
+}
+
+inline uint64_t TraceNow()
+{
+  return (uint64_t)chrono::duration_cast<chrono::nanoseconds>(
+    chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// the calling thread's buffer, created on first use:
+inline TraceBuffer& TraceThreadBuffer()
+{
+  if (threadTraceBuffer == nullptr)
+  {
+    lock_guard<mutex> guard(traceLock);
+    traceBuffers.push_back(unique_ptr<TraceBuffer>(new TraceBuffer((uint32_t)traceBuffers.size() + 1)));
+    threadTraceBuffer = traceBuffers.back().get();
+  }
+
+  return *threadTraceBuffer;
+}
+
+//
+// The thread turning tracing on gets its buffer first, so it is thread
+// 1, shown as "main" in the trace.
+//
+inline void TraceEnable(bool enable)
+{
+  if (enable)
+    TraceThreadBuffer();
+
+  traceEnabled.store(enable, memory_order_relaxed);
+}
+
+//
+// TraceScope
+//
+class TraceScope
+{
+private:
+  const char* name;      // nullptr => not tracing
+  const char* category;
+  uint64_t start;
+
+public:
+  TraceScope(const char* name, const char* category)
+    : name(nullptr), category(category), start(0)
+  {
+    if (!TraceEnabled())
+      return;
+
+    this->name = name;
+    start = TraceNow();
+  }
+
+  ~TraceScope()
+  {
+    if (name == nullptr)
+      return;
+
+    TraceThreadBuffer().record(TraceEvent{ name, category, start, TraceNow() - start });
+  }
+
+  TraceScope(const TraceScope&) = delete;
+  TraceScope& operator=(const TraceScope&) = delete;
+};
+
+//
+// WriteChromeTrace
+//
+// Writes the events recorded so far, by all threads, as a Chrome trace
+// (complete "X" events, in microseconds from the first one, one track
+// per thread).  Returns false if the file can't be written.
+//
+inline bool WriteChromeTrace(const string& filename)
+{
+  vector<pair<uint32_t, vector<TraceEvent>>> threads;
+  uint64_t dropped = 0;
+  uint64_t origin = UINT64_MAX;
+
+  {
+    lock_guard<mutex> guard(traceLock);
+
+    for (auto& buffer : traceBuffers)
+    {
+      threads.push_back(make_pair(buffer->ThreadID, vector<TraceEvent>()));
+      dropped += buffer->snapshot(threads.back().second);
+
+      for (auto& event : threads.back().second)
+        origin = min(origin, event.StartNanos);
+    }
+  }
+
+  ofstream output(filename);
+  if (!output.good())
+    return false;
+
+  output << fixed << setprecision(3);
+  output << "{\"traceEvents\": [" << '\n';
+
+  bool first = true;
+  for (auto& thread : threads)
+  {
+    string threadName = (thread.first == 1) ? "main" : "thread " + to_string(thread.first);
+
+    output << (first ? "" : ",\n")
+           << " {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << thread.first
+           << ", \"args\": {\"name\": \"" << threadName << "\"}}";
+    first = false;
+
+    for (auto& event : thread.second)
+    {
+      output << ",\n {\"name\": \"" << event.Name << "\", \"cat\": \"" << event.Category
+             << "\", \"ph\": \"X\", \"ts\": " << (event.StartNanos - origin) / 1000.0
+             << ", \"dur\": " << event.DurationNanos / 1000.0
+             << ", \"pid\": 1, \"tid\": " << thread.first << "}";
+    }
+  }
+
+  output << '\n' << "], \"displayTimeUnit\": \"ms\", \"otherData\": {\"dropped_events\": "
+         << dropped << "}}" << '\n';
+
+  return output.good();
+}
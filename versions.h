@@ -0,0 +1,208 @@
+/*versions.h*/
+
+//
+// Versions of a read-mostly structure -- a loaded map, say -- replaced
+// while readers keep reading it, RCU style.  A new version is built on
+// the side and published with one atomic pointer swap; readers never lock
+// and never wait, and a reader that started on the old version finishes
+// on it.  Retired versions are freed once no reader can still hold them,
+// by epoch-based reclamation:
+//
+//   - a global epoch counts the publications;
+//   - each reader has a slot, and while it reads (pinned) the slot holds
+//     the epoch it started in -- 0 when not reading;
+//   - a version retired in epoch e can only be held by readers that
+//     started in e or before, so once every slot is 0 or after e, it is
+//     freed.
+//
+// A pin is an atomic store, an atomic load and, when done, a store: no
+// read-modify-write, and no cache line shared with other readers.
+//
+// Readers are numbered 0 .. numReaders - 1 (worker threads, say); a
+// reader pins one version at a time.
+//
+//   VersionManager<MapVersion> versions(numWorkers);
+//   versions.publish(unique_ptr<MapVersion>(first));
+//
+//   // on worker w:
+//   {
+//     auto version = versions.pin(w);
+//     ... version->Graph ...
+//   }
+//
+//   // on the loader thread, whenever there's a new one:
+//   versions.publish(move(next));
+//   versions.reclaim();      // again later, for readers that were still on it
+//
+
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <cstdint>
+
+using namespace std;
+
+template<typename T>
+class VersionManager
+{
+private:
+  struct alignas(64) Slot
+  {
+    atomic<uint64_t> Epoch;       // 0 => not reading
+
+    Slot()
+      : Epoch(0)
+    {
+    }
+  };
+
+  atomic<T*> current;
+  atomic<uint64_t> epoch;         // starts at 1, so 0 means idle
+  unique_ptr<Slot[]> slots;
+  int numReaders;
+
+  // writers only:
+  mutex retiredLock;
+  vector<pair<uint64_t, T*>> retired;   // (epoch retired in, version)
+  uint64_t published;
+
+public:
+  //
+  // Pinned
+  //
+  // A version, held by a reader until the Pinned goes out of scope.
+  //
+  class Pinned
+  {
+  private:
+    Slot* slot;
+    T* version;
+
+  public:
+    Pinned(Slot* slot, T* version)
+      : slot(slot), version(version)
+    {
+    }
+
+    Pinned(Pinned&& other)
+      : slot(other.slot), version(other.version)
+    {
+      other.slot = nullptr;
+    }
+
+    Pinned(const Pinned&) = delete;
+    Pinned& operator=(const Pinned&) = delete;
+    Pinned& operator=(Pinned&&) = delete;
+
+    ~Pinned()
+    {
+      if (slot != nullptr)
+        slot->Epoch.store(0, memory_order_release);
+    }
+
+    T* get() const
+    {
+      return version;
+    }
+
+    T* operator->() const
+    {
+      return version;
+    }
+
+    T& operator*() const
+    {
+      return *version;
+    }
+  };
+
+  VersionManager(int numReaders)
+    : current(nullptr), epoch(1), slots(new Slot[numReaders > 0 ? numReaders : 1]),
+      numReaders(numReaders > 0 ? numReaders : 1), published(0)
+  {
+  }
+
+  // (readers must be done by now)
+  ~VersionManager()
+  {
+    delete current.load();
+    for (auto& r : retired)
+      delete r.second;
+  }
+
+  VersionManager(const VersionManager&) = delete;
+  VersionManager& operator=(const VersionManager&) = delete;
+
+  //
+  // Pins the current version (nullptr if none published yet) for reader,
+  // until the Pinned is gone.
+  //
+  // The slot is stored before the version is loaded, both sequentially
+  // consistent: a publisher that misses the slot has swapped the pointer
+  // before the load, so the reader gets the new version; one that sees it
+  // keeps the version the reader may have got.
+  //
+  Pinned pin(int reader)
+  {
+    Slot* slot = &slots[reader];
+
+    slot->Epoch.store(epoch.load());
+    return Pinned(slot, current.load());
+  }
+
+  //
+  // Publishes version as the current one, for pins from now on, and
+  // retires the previous one; returns the # of versions published.
+  //
+  uint64_t publish(unique_ptr<T> version)
+  {
+    lock_guard<mutex> lock(retiredLock);
+
+    T* previous = current.exchange(version.release());
+    uint64_t retiredIn = epoch.fetch_add(1);
+
+    if (previous != nullptr)
+      retired.push_back(make_pair(retiredIn, previous));
+
+    reclaimRetired();
+    return ++published;
+  }
+
+  //
+  // Frees the retired versions no reader can hold anymore; returns the #
+  // still retired (held, or possibly held, by some reader).
+  //
+  size_t reclaim()
+  {
+    lock_guard<mutex> lock(retiredLock);
+
+    reclaimRetired();
+    return retired.size();
+  }
+
+private:
+  void reclaimRetired()
+  {
+    // the oldest epoch a reader is in:
+    uint64_t oldest = UINT64_MAX;
+    for (int r = 0; r < numReaders; ++r)
+    {
+      uint64_t e = slots[r].Epoch.load();
+      if (e != 0 && e < oldest)
+        oldest = e;
+    }
+
+    vector<pair<uint64_t, T*>> held;
+    for (auto& r : retired)
+    {
+      if (r.first < oldest)
+        delete r.second;
+      else
+        held.push_back(r);
+    }
+    retired.swap(held);
+  }
+};